@@ -0,0 +1,606 @@
+// gb_aot: recompiles the code reachable in a ROM into a shared library the
+// emulator loads with --aot=<module>. Usage:
+//
+//   gb_aot <rom_file> <output.cpp> [--compile=<module>] [--cxx=<compiler>] [--include=<dir>]
+//
+// Starting from the entry point, the RST and the interrupt vectors, every
+// statically known branch target is followed and cut into the same blocks the
+// emulator's block cache builds. Each block becomes a C++ function with the opcodes
+// and immediates folded in. Register loads, 8-bit ALU ops, INC/DEC and JR/JP are
+// written out inline on AotRegisters, using the same templates as the interpreter
+// (cpu_ops.h); everything else, memory accesses included, calls back into the
+// emulator's interpreter. Targets only known at run time (JP HL, RET, jump tables)
+// are not followed, the emulator interprets whatever the module does not cover.
+
+#include "Instructions.h"
+#include "block_cache.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <string>
+#include <vector>
+
+using namespace GB;
+
+#ifndef GB_AOT_INCLUDE_DIR
+#define GB_AOT_INCLUDE_DIR "include"
+#endif
+
+namespace
+{
+	struct AotInstr
+	{
+		u16 pc;
+		u8 opcode;
+		u8 length;
+		u8 operands[2];
+		const Instruction* instruction;
+	};
+
+	struct AotBlockInfo
+	{
+		std::vector<AotInstr> instructions;
+		u16 endPC = 0;
+	};
+
+	// The block cache never lets a block span the fixed and the switchable ROM bank
+	u8 GetBank(u16 address)
+	{
+		return address < 0x4000 ? 0 : 1;
+	}
+
+	bool EndsBlock(InstrType type)
+	{
+		switch (type)
+		{
+		case InstrType::JP:
+		case InstrType::JR:
+		case InstrType::CALL:
+		case InstrType::RST:
+		case InstrType::RET:
+		case InstrType::RETI:
+		case InstrType::HALT:
+		case InstrType::STOP:
+			return true;
+		default:
+			return false;
+		}
+	}
+
+	// AotRegisters member of an 8-bit register, nullptr for anything else
+	const char* GetByteRegister(RegisterType type)
+	{
+		switch (type)
+		{
+		case RegisterType::A: return "A";
+		case RegisterType::B: return "B";
+		case RegisterType::C: return "C";
+		case RegisterType::D: return "D";
+		case RegisterType::E: return "E";
+		case RegisterType::H: return "H";
+		case RegisterType::L: return "L";
+		default: return nullptr;
+		}
+	}
+
+	// Index into AotRegisters::words of BC/DE/HL/SP, -1 for anything else
+	int GetWordIndex(RegisterType type)
+	{
+		switch (type)
+		{
+		case RegisterType::BC: return 1;
+		case RegisterType::DE: return 2;
+		case RegisterType::HL: return 3;
+		case RegisterType::SP: return 4;
+		default: return -1;
+		}
+	}
+
+	class Recompiler
+	{
+
+	public:
+
+		explicit Recompiler(const std::vector<u8>& rom) : rom(rom)
+		{
+			// Without an MBC only banks 0 and 1 are ever mapped
+			codeEnd = (u32)std::min<size_t>(rom.size(), 0x8000);
+		}
+
+		void Discover()
+		{
+			std::vector<u16> pending = { 0x0100 };
+
+			for (u16 vector = 0x00; vector <= 0x38; vector += 0x08)
+			{
+				pending.push_back(vector);
+			}
+
+			for (u16 vector = 0x40; vector <= 0x60; vector += 0x08)
+			{
+				pending.push_back(vector);
+			}
+
+			while (!pending.empty())
+			{
+				const u16 pc = pending.back();
+				pending.pop_back();
+
+				if (pc >= codeEnd || blocks.contains(pc))
+				{
+					continue;
+				}
+
+				AotBlockInfo block = DecodeBlock(pc);
+				if (block.instructions.empty())
+				{
+					continue;
+				}
+
+				AddSuccessors(block, pending);
+				blocks.emplace(pc, std::move(block));
+			}
+		}
+
+		void WriteSource(std::ostream& out, const std::string& romName) const
+		{
+			out << "// Generated by gb_aot from " << romName << ", regenerate instead of editing\n";
+			out << "#include \"aot_abi.h\"\n\n";
+			out << "using namespace GB;\n\n";
+			out << "namespace\n{\n";
+
+			for (const auto& [pc, block] : blocks)
+			{
+				const std::string name = GetBlockName(pc);
+
+				out << "\tconst uint8_t bytes_" << name << "[] = {";
+				for (u32 address = pc; address < block.endPC; address++)
+				{
+					out << (address == pc ? " " : ", ") << Hex(rom[address], 2);
+				}
+				out << " };\n\n";
+
+				out << "\tuint32_t block_" << name << "(const AotHost* host, void* context, AotRegisters* registers)\n\t{\n";
+
+				for (size_t i = 0; i < block.instructions.size(); i++)
+				{
+					const AotInstr& instr = block.instructions[i];
+
+					out << "\t\t// " << Hex(instr.pc, 4) << " " << instr.instruction->GetInstructionName() << "\n";
+
+					std::string code;
+					std::string mCycles;
+					std::string call;
+
+					if (GetInlineCode(instr, code, mCycles))
+					{
+						out << code;
+						call = "host->Complete(context, " + Hex(instr.pc, 4) + ", " + Hex(instr.opcode, 2) + ", " +
+							std::to_string(instr.length) + ", " + mCycles + ")";
+					}
+					else
+					{
+						call = "host->Step(context, " + Hex(instr.pc, 4) + ", " + Hex(instr.opcode, 2) + ", " +
+							std::to_string(instr.length) + ", " + Hex(instr.operands[0], 2) + ", " + Hex(instr.operands[1], 2) + ")";
+					}
+
+					if (i + 1 < block.instructions.size())
+					{
+						out << "\t\tif (!" << call << ") return " << i + 1 << ";\n";
+					}
+					else
+					{
+						out << "\t\t" << call << ";\n";
+						out << "\t\treturn " << i + 1 << ";\n";
+					}
+				}
+
+				out << "\t}\n\n";
+			}
+
+			out << "\tconst AotBlock blocks[] =\n\t{\n";
+			for (const auto& [pc, block] : blocks)
+			{
+				const std::string name = GetBlockName(pc);
+				out << "\t\t{ " << Hex(GetBank(pc) << 16 | pc, 8) << ", " << block.endPC - pc << ", bytes_" << name << ", block_" << name << " },\n";
+			}
+			out << "\t};\n\n";
+
+			const u16 romChecksum = rom[0x14E] | (rom[0x14F] << 8);
+			out << "\tconst AotModule module = { AOT_ABI_VERSION, " << Hex(romChecksum, 4) << ", " << blocks.size() << ", blocks };\n";
+			out << "}\n\n";
+
+			out << "GB_AOT_EXPORT const AotModule* GB_GetAotModule()\n{\n\treturn &module;\n}\n";
+		}
+
+		size_t GetInlineInstructionCount() const
+		{
+			size_t count = 0;
+			for (const auto& [pc, block] : blocks)
+			{
+				for (const AotInstr& instr : block.instructions)
+				{
+					std::string code;
+					std::string mCycles;
+					count += GetInlineCode(instr, code, mCycles);
+				}
+			}
+			return count;
+		}
+
+		size_t GetBlockCount() const
+		{
+			return blocks.size();
+		}
+
+		size_t GetInstructionCount() const
+		{
+			size_t count = 0;
+			for (const auto& [pc, block] : blocks)
+			{
+				count += block.instructions.size();
+			}
+			return count;
+		}
+
+	private:
+
+		AotBlockInfo DecodeBlock(u16 pc) const
+		{
+			AotBlockInfo block;
+			u32 address = pc;
+
+			while (block.instructions.size() < MAX_BLOCK_INSTRUCTIONS)
+			{
+				AotInstr instr{};
+				instr.pc = (u16)address;
+				instr.opcode = rom[address];
+				instr.instruction = Instruction::GetInstruction(instr.opcode);
+
+				const u8 operandCount = Instruction::GetOperandCount(instr.instruction->mode);
+				instr.length = 1 + operandCount;
+
+				if (address + operandCount >= codeEnd || GetBank((u16)(address + operandCount)) != GetBank(pc))
+				{
+					break;
+				}
+
+				for (u8 i = 0; i < operandCount; i++)
+				{
+					instr.operands[i] = rom[address + 1 + i];
+				}
+
+				block.instructions.push_back(instr);
+				address += instr.length;
+
+				if (EndsBlock(instr.instruction->type) || address >= codeEnd || GetBank((u16)address) != GetBank(pc))
+				{
+					break;
+				}
+			}
+
+			block.endPC = (u16)address;
+			return block;
+		}
+
+		// Statements carrying out 'instr' on 'registers', PC included, and the M-cycles
+		// it costs as the interpreter charges them. False if it goes through host->Step.
+		static bool GetInlineCode(const AotInstr& instr, std::string& code, std::string& mCycles)
+		{
+			const Instruction& instruction = *instr.instruction;
+			const u16 next = instr.pc + instr.length;
+			const u16 immediate = instr.operands[0] | (instr.operands[1] << 8);
+
+			const char* byte1 = GetByteRegister(instruction.reg_1);
+			const char* byte2 = GetByteRegister(instruction.reg_2);
+			const int word1 = GetWordIndex(instruction.reg_1);
+
+			auto line = [&code](const std::string& statement)
+			{
+				code += "\t\t" + statement + "\n";
+			};
+
+			switch (instruction.type)
+			{
+			case InstrType::LD:
+				if (instruction.mode == AddrMode::R_R && byte1 && byte2)
+				{
+					line(std::string("registers->") + byte1 + " = registers->" + byte2 + ";");
+					mCycles = "1";
+				}
+				else if (instruction.mode == AddrMode::R_D8 && byte1)
+				{
+					line(std::string("registers->") + byte1 + " = " + Hex(instr.operands[0], 2) + ";");
+					mCycles = "2";
+				}
+				else if (instruction.mode == AddrMode::R_D16 && word1 >= 0 && instruction.reg_1 != RegisterType::SP)
+				{
+					// LD SP has to tell the shadow call stack, it stays interpreted
+					line("registers->words[" + std::to_string(word1) + "] = " + Hex(immediate, 4) + ";");
+					mCycles = "3";
+				}
+				else
+				{
+					return false;
+				}
+				break;
+			case InstrType::INC:
+			case InstrType::DEC:
+			{
+				if (instruction.mode != AddrMode::R)
+				{
+					return false;
+				}
+
+				const bool bIncrement = instruction.type == InstrType::INC;
+
+				if (byte1)
+				{
+					line(std::string("registers->") + byte1 + " = " + (bIncrement ? "IncByte" : "DecByte") + "(*registers, registers->" + byte1 + ");");
+					mCycles = "1";
+				}
+				else if (word1 >= 0)
+				{
+					line("registers->words[" + std::to_string(word1) + "]" + (bIncrement ? "++;" : "--;"));
+					mCycles = "2";
+				}
+				else
+				{
+					return false;
+				}
+				break;
+			}
+			case InstrType::ADD:
+			case InstrType::ADC:
+			case InstrType::SUB:
+			case InstrType::SBC:
+			case InstrType::AND:
+			case InstrType::OR:
+			case InstrType::XOR:
+			case InstrType::CP:
+			{
+				if (instruction.reg_1 != RegisterType::A)
+				{
+					return false;
+				}
+
+				std::string value;
+				if (instruction.mode == AddrMode::R_R && byte2)
+				{
+					value = std::string("registers->") + byte2;
+					mCycles = "1";
+				}
+				else if (instruction.mode == AddrMode::R_D8)
+				{
+					value = Hex(instr.operands[0], 2);
+					mCycles = "2";
+				}
+				else
+				{
+					return false;
+				}
+
+				switch (instruction.type)
+				{
+				case InstrType::ADD: line("AluAdd(*registers, " + value + ", 0);"); break;
+				case InstrType::ADC: line("AluAdd(*registers, " + value + ", registers->GetCarryFlag());"); break;
+				case InstrType::SUB: line("AluSub(*registers, " + value + ", 0);"); break;
+				case InstrType::SBC: line("AluSub(*registers, " + value + ", registers->GetCarryFlag());"); break;
+				case InstrType::AND: line("AluAnd(*registers, " + value + ");"); break;
+				case InstrType::OR: line("AluOr(*registers, " + value + ");"); break;
+				case InstrType::XOR: line("AluXor(*registers, " + value + ");"); break;
+				default: line("AluCompare(*registers, " + value + ");"); break;
+				}
+				break;
+			}
+			case InstrType::JP:
+			case InstrType::JR:
+			{
+				if (instruction.type == InstrType::JP && instruction.mode == AddrMode::R)
+				{
+					line("registers->PC = registers->words[3];");
+					mCycles = "1";
+					return true;
+				}
+
+				u16 target = 0;
+				u8 notTakenCycles = 0;
+				if (instruction.type == InstrType::JR && instruction.mode == AddrMode::D8)
+				{
+					target = next + (i8)instr.operands[0];
+					notTakenCycles = 2;
+				}
+				else if (instruction.type == InstrType::JP && instruction.mode == AddrMode::D16)
+				{
+					target = immediate;
+					notTakenCycles = 3;
+				}
+				else
+				{
+					return false;
+				}
+
+				if (instruction.cond == CondType::NONE)
+				{
+					line("registers->PC = " + Hex(target, 4) + ";");
+					mCycles = std::to_string(notTakenCycles + 1);
+					return true;
+				}
+
+				const bool bZeroFlag = instruction.cond == CondType::NZ || instruction.cond == CondType::Z;
+				const bool bTakenIfSet = instruction.cond == CondType::Z || instruction.cond == CondType::C;
+
+				line(std::string("const bool bTaken = ") + (bTakenIfSet ? "" : "!") + "registers->" +
+					(bZeroFlag ? "GetZeroFlag()" : "GetCarryFlag()") + ";");
+				line("registers->PC = bTaken ? " + Hex(target, 4) + " : " + Hex(next, 4) + ";");
+				mCycles = "bTaken ? " + std::to_string(notTakenCycles + 1) + " : " + std::to_string(notTakenCycles);
+				return true;
+			}
+			default:
+				return false;
+			}
+
+			line("registers->PC = " + Hex(next, 4) + ";");
+			return true;
+		}
+
+		void AddSuccessors(const AotBlockInfo& block, std::vector<u16>& pending) const
+		{
+			const AotInstr& last = block.instructions.back();
+			const Instruction& instruction = *last.instruction;
+			const u16 next = block.endPC;
+			const u16 immediate = last.operands[0] | (last.operands[1] << 8);
+			const bool bConditional = instruction.cond != CondType::NONE;
+
+			switch (instruction.type)
+			{
+			case InstrType::JP:
+				// JP HL has no static target
+				if (instruction.mode == AddrMode::D16)
+				{
+					pending.push_back(immediate);
+				}
+				if (bConditional)
+				{
+					pending.push_back(next);
+				}
+				break;
+			case InstrType::JR:
+				pending.push_back((u16)(next + (i8)last.operands[0]));
+				if (bConditional)
+				{
+					pending.push_back(next);
+				}
+				break;
+			case InstrType::CALL:
+				pending.push_back(immediate);
+				pending.push_back(next);
+				break;
+			case InstrType::RST:
+				pending.push_back(instruction.param);
+				pending.push_back(next);
+				break;
+			case InstrType::RET:
+				if (bConditional)
+				{
+					pending.push_back(next);
+				}
+				break;
+			case InstrType::RETI:
+				break;
+			default:
+				// HALT, STOP or a block cut short by its length or the bank boundary
+				pending.push_back(next);
+				break;
+			}
+		}
+
+		static std::string GetBlockName(u16 pc)
+		{
+			char name[16];
+			std::snprintf(name, sizeof(name), "%02X_%04X", GetBank(pc), pc);
+			return name;
+		}
+
+		static std::string Hex(u32 value, int digits)
+		{
+			char text[16];
+			std::snprintf(text, sizeof(text), "0x%0*X", digits, value);
+			return text;
+		}
+
+	private:
+
+		const std::vector<u8>& rom;
+		u32 codeEnd = 0;
+
+		// Ordered, so the same ROM always generates the same source
+		std::map<u16, AotBlockInfo> blocks;
+	};
+}
+
+int main(int argc, char** argv)
+{
+	if (argc < 3)
+	{
+		printf("Usage: gb_aot <rom_file> <output.cpp> [--compile=<module>] [--cxx=<compiler>] [--include=<dir>]\n");
+		return -1;
+	}
+
+	const std::string romPath = argv[1];
+	const std::string sourcePath = argv[2];
+
+	std::string modulePath;
+	std::string compiler = "c++";
+	std::string includeDir = GB_AOT_INCLUDE_DIR;
+
+	for (int i = 3; i < argc; i++)
+	{
+		const std::string option = argv[i];
+
+		if (option.starts_with("--compile="))
+		{
+			modulePath = option.substr(10);
+		}
+		else if (option.starts_with("--cxx="))
+		{
+			compiler = option.substr(6);
+		}
+		else if (option.starts_with("--include="))
+		{
+			includeDir = option.substr(10);
+		}
+		else
+		{
+			printf("Unknown option: %s\n", option.c_str());
+		}
+	}
+
+	std::ifstream romStream(romPath, std::ios::binary);
+	std::vector<u8> rom((std::istreambuf_iterator<char>(romStream)), std::istreambuf_iterator<char>());
+
+	if (rom.size() < 0x150)
+	{
+		printf("Failed to load ROM file: %s\n", romPath.c_str());
+		return -2;
+	}
+
+	Recompiler recompiler(rom);
+	recompiler.Discover();
+
+	std::ofstream sourceStream(sourcePath, std::ios::trunc);
+	if (!sourceStream.good())
+	{
+		printf("Failed to write %s\n", sourcePath.c_str());
+		return -3;
+	}
+
+	recompiler.WriteSource(sourceStream, romPath);
+	sourceStream.close();
+
+	printf("%zu blocks, %zu instructions (%zu inline) written to %s\n", recompiler.GetBlockCount(), recompiler.GetInstructionCount(),
+		   recompiler.GetInlineInstructionCount(), sourcePath.c_str());
+
+	if (modulePath.empty())
+	{
+		return 0;
+	}
+
+	// GCC/Clang style command line, MSVC users build the source into a DLL themselves
+	const std::string command = "\"" + compiler + "\" -std=c++17 -O2 -shared -fPIC -I\"" + includeDir + "\" \"" +
+		sourcePath + "\" -o \"" + modulePath + "\"";
+
+	printf("%s\n", command.c_str());
+
+	if (std::system(command.c_str()) != 0)
+	{
+		printf("Compiling %s failed\n", modulePath.c_str());
+		return -4;
+	}
+
+	return 0;
+}
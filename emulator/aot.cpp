@@ -0,0 +1,207 @@
+#include "aot.h"
+#include "Instructions.h"
+#include "block_cache.h"
+#include "cpu.h"
+#include "cpu_registers.h"
+#include "emu.h"
+#include "cart.h"
+#include "ppu.h"
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <dlfcn.h>
+#endif
+
+#include <cstddef>
+#include <type_traits>
+
+using namespace GB;
+
+// Generated code reads and writes CPU_Registers through AotRegisters
+static_assert(std::is_standard_layout_v<CPU_Registers>, "AotRegisters relies on the CPU_Registers layout");
+static_assert(offsetof(AotRegisters, F) == offsetof(CPU_Registers, F) && offsetof(AotRegisters, A) == offsetof(CPU_Registers, A) &&
+	offsetof(AotRegisters, C) == offsetof(CPU_Registers, C) && offsetof(AotRegisters, B) == offsetof(CPU_Registers, B) &&
+	offsetof(AotRegisters, E) == offsetof(CPU_Registers, E) && offsetof(AotRegisters, D) == offsetof(CPU_Registers, D) &&
+	offsetof(AotRegisters, L) == offsetof(CPU_Registers, L) && offsetof(AotRegisters, H) == offsetof(CPU_Registers, H) &&
+	offsetof(AotRegisters, SP) == offsetof(CPU_Registers, SP) && offsetof(AotRegisters, PC) == offsetof(CPU_Registers, PC),
+	"AotRegisters does not match CPU_Registers");
+static_assert(offsetof(AotRegisters, flagOp) == offsetof(CPU_Registers, flagOp) &&
+	offsetof(AotRegisters, flagA) == offsetof(CPU_Registers, flagA) &&
+	offsetof(AotRegisters, flagB) == offsetof(CPU_Registers, flagB) &&
+	offsetof(AotRegisters, flagCarry) == offsetof(CPU_Registers, flagCarry),
+	"AotRegisters does not match CPU_Registers");
+
+namespace
+{
+	// What a running block checks after each instruction, lives on Run's stack
+	struct AotRunContext
+	{
+		CPU* cpu;
+		u32 frame;
+		u32 generation;
+		u32 instructions;
+	};
+
+	// Same exits as compiled blocks, see Jit
+	bool IsStillInBlock(const AotRunContext& run, u16 pc, u8 length)
+	{
+		CPU& cpu = *run.cpu;
+
+		return !cpu.IsHalted() &&
+			cpu.GetPC() == (u16)(pc + length) &&
+			EMU::GetPPU()->GetCurrentFrame() == run.frame &&
+			cpu.GetBlockCache().GetGeneration() == run.generation;
+	}
+
+	void* OpenLibrary(const std::filesystem::path& filePath)
+	{
+#if defined(_WIN32)
+		return (void*)LoadLibraryW(filePath.c_str());
+#else
+		return dlopen(filePath.string().c_str(), RTLD_NOW | RTLD_LOCAL);
+#endif
+	}
+
+	void* FindSymbol(void* library, const char* name)
+	{
+#if defined(_WIN32)
+		return (void*)GetProcAddress((HMODULE)library, name);
+#else
+		return dlsym(library, name);
+#endif
+	}
+
+	void CloseLibrary(void* library)
+	{
+#if defined(_WIN32)
+		FreeLibrary((HMODULE)library);
+#else
+		dlclose(library);
+#endif
+	}
+}
+
+AotCode::~AotCode()
+{
+	if (library)
+	{
+		CloseLibrary(library);
+	}
+}
+
+std::shared_ptr<const AotCode> AotCode::Load(const std::filesystem::path& filePath)
+{
+#if defined(LAZY_FLAGS_LOCKSTEP)
+	// Inline ALU code in the module does not keep the eager shadow F
+	printf("AOT: not available with LAZY_FLAGS_LOCKSTEP\n");
+	return nullptr;
+#endif
+
+	auto code = std::make_shared<AotCode>();
+
+	code->library = OpenLibrary(filePath);
+	if (!code->library)
+	{
+		printf("AOT: failed to load %s\n", filePath.string().c_str());
+		return nullptr;
+	}
+
+	const auto getModule = (AotGetModuleFunc)FindSymbol(code->library, AOT_MODULE_SYMBOL);
+	const AotModule* module = getModule ? getModule() : nullptr;
+
+	if (!module || module->abiVersion != AOT_ABI_VERSION)
+	{
+		printf("AOT: %s is not a module for this emulator version\n", filePath.string().c_str());
+		return nullptr;
+	}
+
+	const Cartridge* cartridge = EMU::GetCartridge();
+
+	if (module->romChecksum != cartridge->GetROMChecksum())
+	{
+		printf("AOT: %s was generated for another ROM\n", filePath.string().c_str());
+		return nullptr;
+	}
+
+	u32 mismatches = 0;
+
+	for (u32 i = 0; i < module->blockCount; i++)
+	{
+		const AotBlock& block = module->blocks[i];
+		const u16 pc = block.key & 0xFFFF;
+
+		bool bMatches = (block.key >> 16) == (pc >= 0x4000 ? cartridge->GetRomBank() : 0);
+
+		for (u16 n = 0; n < block.byteCount && bMatches; n++)
+		{
+			bMatches = cartridge->ReadByte(pc + n) == block.bytes[n];
+		}
+
+		if (bMatches)
+		{
+			code->blocks.emplace(block.key, block.run);
+		}
+		else
+		{
+			mismatches++;
+		}
+	}
+
+	printf("AOT: %u blocks loaded from %s\n", (u32)code->blocks.size(), filePath.string().c_str());
+
+	if (mismatches != 0)
+	{
+		printf("AOT: %u blocks skipped, their bytes differ from the loaded ROM\n", mismatches);
+	}
+
+	return code;
+}
+
+u32 AotCode::Run(CPU& cpu, u16 pc) const
+{
+	// Inline instructions bypass the per-instruction hooks
+	if (cpu.HasInstructionHooks())
+	{
+		return 0;
+	}
+
+	auto it = blocks.find(BlockCache::MakeKey(pc));
+	if (it == blocks.end())
+	{
+		return 0;
+	}
+
+	static const AotHost host = { &AotCode::Step, &AotCode::Complete };
+
+	AotRunContext context{ &cpu, EMU::GetPPU()->GetCurrentFrame(), cpu.GetBlockCache().GetGeneration(), 0 };
+	it->second(&host, &context, reinterpret_cast<AotRegisters*>(&cpu.GetRegisters()));
+
+	return context.instructions;
+}
+
+bool AotCode::Step(void* context, u16 pc, u8 opcode, u8 length, u8 operand0, u8 operand1)
+{
+	AotRunContext& run = *(AotRunContext*)context;
+	CPU& cpu = *run.cpu;
+
+	const DecodedInstr decoded{ Instruction::GetInstruction(opcode), pc, opcode, length, { operand0, operand1 } };
+
+	cpu.StepDecoded(decoded);
+	run.instructions++;
+
+	return IsStillInBlock(run, pc, length);
+}
+
+bool AotCode::Complete(void* context, u16 pc, u8 opcode, u8 length, u8 mCycles)
+{
+	AotRunContext& run = *(AotRunContext*)context;
+
+	const DecodedInstr decoded{ Instruction::GetInstruction(opcode), pc, opcode, length, { 0, 0 } };
+
+	run.cpu->CompleteDecoded(decoded, mCycles);
+	run.instructions++;
+
+	return IsStillInBlock(run, pc, length);
+}
@@ -0,0 +1,682 @@
+#include "apu.h"
+#include "emu.h"
+#include "timer.h"
+#include "wav_writer.h"
+#include "save_state.h"
+
+#include <algorithm>
+
+using namespace GB;
+
+namespace
+{
+	// Each channel owns five consecutive registers starting at FF10 (NRx0 - NRx4)
+	constexpr u8 REGS_PER_CHANNEL = 5;
+
+	// Bits that always read back as 1 (write-only or unused)
+	constexpr std::array<u8, 0x30> ReadMasks = {
+		0x80, 0x3F, 0x00, 0xFF, 0xBF,	// NR10 - NR14
+		0xFF, 0x3F, 0x00, 0xFF, 0xBF,	// NR20 - NR24
+		0x7F, 0xFF, 0x9F, 0xFF, 0xBF,	// NR30 - NR34
+		0xFF, 0xFF, 0x00, 0x00, 0xBF,	// NR40 - NR44
+		0x00, 0x00, 0x70,				// NR50 - NR52
+		0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+		// Wave RAM
+		0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+		0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
+	};
+
+	constexpr std::array<u8, 4> DutyPatterns = { 0b00000001, 0b10000001, 0b10000111, 0b01111110 };
+
+	constexpr std::array<u8, 4> WaveVolumeShift = { 4, 0, 1, 2 };
+
+	constexpr u8 REG_INDEX(u16 address)
+	{
+		return (u8)(address - APU_ADDR::APU_START);
+	}
+}
+
+APU::APU()
+{
+	// Post boot ROM register state
+	registers[REG_INDEX(0xFF10)] = 0x80;
+	registers[REG_INDEX(0xFF11)] = 0xBF;
+	registers[REG_INDEX(0xFF12)] = 0xF3;
+	registers[REG_INDEX(0xFF14)] = 0xBF;
+	registers[REG_INDEX(0xFF16)] = 0x3F;
+	registers[REG_INDEX(0xFF19)] = 0xBF;
+	registers[REG_INDEX(0xFF1A)] = 0x7F;
+	registers[REG_INDEX(0xFF1B)] = 0xFF;
+	registers[REG_INDEX(0xFF1C)] = 0x9F;
+	registers[REG_INDEX(0xFF1E)] = 0xBF;
+	registers[REG_INDEX(0xFF20)] = 0xFF;
+	registers[REG_INDEX(0xFF23)] = 0xBF;
+	registers[REG_INDEX(APU_ADDR::NR50)] = 0x77;
+	registers[REG_INDEX(APU_ADDR::NR51)] = 0xF3;
+
+	channels[SQUARE_1].dacEnabled = true;
+
+	blipLeft.SetRates(CLOCKSPEED, AUDIO_SAMPLE_RATE);
+	blipRight.SetRates(CLOCKSPEED, AUDIO_SAMPLE_RATE);
+}
+
+u8 APU::ReadByte(u16 address)
+{
+	RunUntil(EMU::GetEMU()->GetCycles());
+
+	const u8 index = REG_INDEX(address);
+
+	if (address == APU_ADDR::NR52)
+	{
+		u8 value = ReadMasks[index] | (powered ? 0x80 : 0x00);
+		for (u8 i = 0; i < CHANNEL_COUNT; i++)
+		{
+			value |= channels[i].enabled ? (1 << i) : 0;
+		}
+		return value;
+	}
+
+	return registers[index] | ReadMasks[index];
+}
+
+void APU::WriteByte(u16 address, u8 value)
+{
+	RunUntil(EMU::GetEMU()->GetCycles());
+
+	const u8 index = REG_INDEX(address);
+
+	if (address >= APU_ADDR::WAVE_RAM_START)
+	{
+		registers[index] = value;
+		return;
+	}
+
+	if (address == APU_ADDR::NR52)
+	{
+		const bool powerOn = value & 0x80;
+		if (powered && !powerOn)
+		{
+			PowerOff();
+		}
+		else if (!powered && powerOn)
+		{
+			powered = true;
+			frameSequencerStep = 0;
+		}
+		return;
+	}
+
+	if (!powered)
+	{
+		return;
+	}
+
+	registers[index] = value;
+
+	if (address >= APU_ADDR::NR50)
+	{
+		UpdateAllOutputs(frameTime);
+		return;
+	}
+
+	const u8 channelIndex = index / REGS_PER_CHANNEL;
+	Channel& channel = channels[channelIndex];
+
+	switch (index % REGS_PER_CHANNEL)
+	{
+	case 0:
+	{
+		if (channelIndex == WAVE)
+		{
+			channel.dacEnabled = value & 0x80;
+			channel.enabled &= channel.dacEnabled;
+			UpdateOutput(channelIndex, frameTime);
+		}
+		break;
+	}
+	case 1:
+	{
+		if (channelIndex == WAVE)
+		{
+			channel.lengthCounter = 256 - value;
+		}
+		else
+		{
+			channel.lengthCounter = 64 - (value & 0x3F);
+		}
+		break;
+	}
+	case 2:
+	{
+		if (channelIndex != WAVE)
+		{
+			channel.dacEnabled = (value & 0xF8) != 0;
+			channel.enabled &= channel.dacEnabled;
+		}
+		UpdateOutput(channelIndex, frameTime);
+		break;
+	}
+	case 3:
+	{
+		channel.frequency = (channel.frequency & 0x700) | value;
+		break;
+	}
+	case 4:
+	{
+		channel.frequency = (channel.frequency & 0xFF) | ((value & 0x7) << 8);
+		channel.lengthEnabled = value & 0x40;
+
+		if (value & 0x80)
+		{
+			Trigger(channelIndex, frameTime);
+		}
+		break;
+	}
+	default:
+		break;
+	}
+}
+
+bool APU::IsAPU_Addr(u16 address)
+{
+	return address >= APU_ADDR::APU_START && address <= APU_ADDR::APU_END;
+}
+
+void APU::EndFrame()
+{
+	RunUntil(EMU::GetEMU()->GetCycles());
+	FlushSamples();
+}
+
+void APU::RunUntil(u32 cycle)
+{
+	u32 elapsed = cycle - lastCycle;
+	lastCycle = cycle;
+
+	while (elapsed > 0)
+	{
+		const u32 step = std::min(elapsed, frameSequencerTimer);
+
+		for (u8 i = 0; i < CHANNEL_COUNT; i++)
+		{
+			RunChannel(i, frameTime, frameTime + step);
+		}
+
+		frameTime += step;
+		elapsed -= step;
+		frameSequencerTimer -= step;
+
+		if (frameSequencerTimer == 0)
+		{
+			frameSequencerTimer = FRAME_SEQUENCER_PERIOD;
+
+			if (powered)
+			{
+				ClockFrameSequencer(frameTime);
+			}
+		}
+
+		if (frameTime >= APU_MAX_FRAME_CLOCKS)
+		{
+			FlushSamples();
+		}
+	}
+}
+
+void APU::RunChannel(u8 index, u32 start, u32 end)
+{
+	Channel& channel = channels[index];
+
+	if (!channel.enabled)
+	{
+		return;
+	}
+
+	u32 time = start;
+	u32 remaining = end - start;
+
+	// Only waveform edges are visited, never individual clocks
+	while (channel.timer <= remaining)
+	{
+		time += channel.timer;
+		remaining -= channel.timer;
+		channel.timer = GetPeriod(index);
+
+		switch (index)
+		{
+		case SQUARE_1:
+		case SQUARE_2:
+		{
+			channel.position = (channel.position + 1) & 0x7;
+			break;
+		}
+		case WAVE:
+		{
+			channel.position = (channel.position + 1) & 0x1F;
+			break;
+		}
+		case NOISE:
+		{
+			const u16 feedback = (lfsr ^ (lfsr >> 1)) & 0x1;
+			lfsr = (lfsr >> 1) | (feedback << 14);
+
+			if (registers[REG_INDEX(0xFF22)] & 0x8)
+			{
+				lfsr = (lfsr & ~(1 << 6)) | (feedback << 6);
+			}
+			break;
+		}
+		default:
+			break;
+		}
+
+		UpdateOutput(index, time);
+	}
+
+	channel.timer -= remaining;
+}
+
+void APU::ClockFrameSequencer(u32 time)
+{
+	switch (frameSequencerStep)
+	{
+	case 0:
+	case 4:
+	{
+		ClockLength();
+		break;
+	}
+	case 2:
+	case 6:
+	{
+		ClockLength();
+		ClockSweep();
+		break;
+	}
+	case 7:
+	{
+		ClockEnvelope();
+		break;
+	}
+	default:
+		break;
+	}
+
+	frameSequencerStep = (frameSequencerStep + 1) & 0x7;
+
+	UpdateAllOutputs(time);
+}
+
+void APU::ClockLength()
+{
+	for (Channel& channel : channels)
+	{
+		if (channel.lengthEnabled && channel.lengthCounter > 0)
+		{
+			channel.lengthCounter--;
+
+			if (channel.lengthCounter == 0)
+			{
+				channel.enabled = false;
+			}
+		}
+	}
+}
+
+void APU::ClockEnvelope()
+{
+	for (u8 i : { SQUARE_1, SQUARE_2, NOISE })
+	{
+		Channel& channel = channels[i];
+
+		if (channel.envelopePace == 0)
+		{
+			continue;
+		}
+
+		if (--channel.envelopeTimer == 0)
+		{
+			channel.envelopeTimer = channel.envelopePace;
+
+			if (channel.envelopeUp && channel.volume < 15)
+			{
+				channel.volume++;
+			}
+			else if (!channel.envelopeUp && channel.volume > 0)
+			{
+				channel.volume--;
+			}
+		}
+	}
+}
+
+void APU::ClockSweep()
+{
+	if (sweep.timer > 0 && --sweep.timer > 0)
+	{
+		return;
+	}
+
+	const u8 NR10 = registers[REG_INDEX(APU_ADDR::NR10)];
+	const u8 pace = (NR10 >> 4) & 0x7;
+	const u8 shift = NR10 & 0x7;
+
+	sweep.timer = pace ? pace : 8;
+
+	if (!sweep.enabled || pace == 0)
+	{
+		return;
+	}
+
+	const u16 newFrequency = CalculateSweepFrequency();
+	if (newFrequency <= 2047 && shift)
+	{
+		sweep.shadowFrequency = newFrequency;
+		channels[SQUARE_1].frequency = newFrequency;
+		CalculateSweepFrequency();
+	}
+}
+
+u16 APU::CalculateSweepFrequency()
+{
+	const u8 NR10 = registers[REG_INDEX(APU_ADDR::NR10)];
+	const u16 delta = sweep.shadowFrequency >> (NR10 & 0x7);
+	const u16 newFrequency = (NR10 & 0x8) ? sweep.shadowFrequency - delta : sweep.shadowFrequency + delta;
+
+	if (newFrequency > 2047)
+	{
+		channels[SQUARE_1].enabled = false;
+	}
+
+	return newFrequency;
+}
+
+void APU::Trigger(u8 index, u32 time)
+{
+	Channel& channel = channels[index];
+
+	channel.enabled = channel.dacEnabled;
+
+	if (channel.lengthCounter == 0)
+	{
+		channel.lengthCounter = index == WAVE ? 256 : 64;
+	}
+
+	channel.timer = GetPeriod(index);
+
+	if (index != WAVE)
+	{
+		const u8 NRx2 = registers[index * REGS_PER_CHANNEL + 2];
+		channel.volume = NRx2 >> 4;
+		channel.envelopeUp = NRx2 & 0x8;
+		channel.envelopePace = NRx2 & 0x7;
+		channel.envelopeTimer = channel.envelopePace;
+	}
+
+	if (index == WAVE)
+	{
+		channel.position = 0;
+	}
+
+	if (index == NOISE)
+	{
+		lfsr = 0x7FFF;
+	}
+
+	if (index == SQUARE_1)
+	{
+		const u8 NR10 = registers[REG_INDEX(APU_ADDR::NR10)];
+		const u8 pace = (NR10 >> 4) & 0x7;
+		const u8 shift = NR10 & 0x7;
+
+		sweep.shadowFrequency = channel.frequency;
+		sweep.timer = pace ? pace : 8;
+		sweep.enabled = pace || shift;
+
+		if (shift)
+		{
+			CalculateSweepFrequency();
+		}
+	}
+
+	UpdateOutput(index, time);
+}
+
+u32 APU::GetPeriod(u8 index) const
+{
+	switch (index)
+	{
+	case SQUARE_1:
+	case SQUARE_2: return (2048 - channels[index].frequency) * 4;
+	case WAVE: return (2048 - channels[index].frequency) * 2;
+	case NOISE:
+	{
+		const u8 NR43 = registers[REG_INDEX(0xFF22)];
+		const u32 divisor = (NR43 & 0x7) ? (NR43 & 0x7) * 16 : 8;
+		return divisor << (NR43 >> 4);
+	}
+	default:
+		return FRAME_SEQUENCER_PERIOD;
+	}
+}
+
+u8 APU::GetDigitalOutput(u8 index) const
+{
+	const Channel& channel = channels[index];
+
+	if (!channel.enabled || !channel.dacEnabled)
+	{
+		return 0;
+	}
+
+	switch (index)
+	{
+	case SQUARE_1:
+	case SQUARE_2:
+	{
+		const u8 duty = registers[index * REGS_PER_CHANNEL + 1] >> 6;
+		return BIT(DutyPatterns[duty], channel.position) ? channel.volume : 0;
+	}
+	case WAVE:
+	{
+		const u8 sampleByte = registers[REG_INDEX(APU_ADDR::WAVE_RAM_START) + channel.position / 2];
+		const u8 sample = (channel.position & 1) ? (sampleByte & 0xF) : (sampleByte >> 4);
+		const u8 level = (registers[REG_INDEX(0xFF1C)] >> 5) & 0x3;
+		return sample >> WaveVolumeShift[level];
+	}
+	case NOISE:
+	{
+		return (lfsr & 0x1) ? 0 : channel.volume;
+	}
+	default:
+		return 0;
+	}
+}
+
+void APU::UpdateOutput(u8 index, u32 time)
+{
+	Channel& channel = channels[index];
+
+	const u8 NR50 = registers[REG_INDEX(APU_ADDR::NR50)];
+	const u8 NR51 = registers[REG_INDEX(APU_ADDR::NR51)];
+
+	// Four channels at full volume sum to 1.0
+	const float amplitude = GetDigitalOutput(index) / (15.0f * 4.0f);
+	const float leftVolume = (((NR50 >> 4) & 0x7) + 1) / 8.0f;
+	const float rightVolume = ((NR50 & 0x7) + 1) / 8.0f;
+
+	const float left = BIT(NR51, index + 4) ? amplitude * leftVolume : 0.0f;
+	const float right = BIT(NR51, index) ? amplitude * rightVolume : 0.0f;
+
+	if (left != channel.left)
+	{
+		blipLeft.AddDelta(time, left - channel.left);
+		channel.left = left;
+	}
+
+	if (right != channel.right)
+	{
+		blipRight.AddDelta(time, right - channel.right);
+		channel.right = right;
+	}
+}
+
+void APU::UpdateAllOutputs(u32 time)
+{
+	for (u8 i = 0; i < CHANNEL_COUNT; i++)
+	{
+		UpdateOutput(i, time);
+	}
+}
+
+void APU::FlushSamples()
+{
+	blipLeft.EndFrame(frameTime);
+	blipRight.EndFrame(frameTime);
+	frameTime = 0;
+
+	std::array<float, BlipBuffer::BUFFER_SIZE * 2> mixed;
+	std::array<i16, BlipBuffer::BUFFER_SIZE * 2> frames;
+
+	const u32 count = blipLeft.ReadSamples(mixed.data(), blipLeft.GetSamplesAvailable(), 2);
+	blipRight.ReadSamples(mixed.data() + 1, count, 2);
+
+	for (u32 i = 0; i < count * 2; i++)
+	{
+		const float sample = std::clamp(mixed[i], -1.0f, 1.0f);
+		frames[i] = (i16)(sample * 32767.0f);
+	}
+
+	if (speculating)
+	{
+		return;
+	}
+
+	if (captureWriter)
+	{
+		captureWriter->Push(frames.data(), count);
+	}
+
+	if (dynamicRateControl)
+	{
+		outputBuffer.WaitForFill(AUDIO_TARGET_FILL);
+		UpdateRateControl();
+	}
+
+	// A full ring means the host is behind, newest samples are dropped
+	outputBuffer.Push(frames.data(), count);
+}
+
+void APU::BeginSpeculation()
+{
+	speculationLeft = blipLeft;
+	speculationRight = blipRight;
+	speculationChannels = channels;
+	speculationFrameTime = frameTime;
+	speculating = true;
+}
+
+void APU::EndSpeculation()
+{
+	blipLeft = speculationLeft;
+	blipRight = speculationRight;
+
+	for (u8 i = 0; i < CHANNEL_COUNT; i++)
+	{
+		channels[i].left = speculationChannels[i].left;
+		channels[i].right = speculationChannels[i].right;
+	}
+	frameTime = speculationFrameTime;
+
+	speculating = false;
+}
+
+void APU::SetDynamicRateControl(bool enabled)
+{
+	dynamicRateControl = enabled;
+	rateRatio = 1.0;
+
+	blipLeft.SetRates(CLOCKSPEED, AUDIO_SAMPLE_RATE);
+	blipRight.SetRates(CLOCKSPEED, AUDIO_SAMPLE_RATE);
+}
+
+void APU::UpdateRateControl()
+{
+	// Fill above target produces slightly fewer samples per emulated second, below target slightly more
+	const double fill = (double)outputBuffer.GetFramesAvailable() / AUDIO_TARGET_FILL;
+	const double deviation = std::clamp(1.0 - fill, -1.0, 1.0);
+
+	rateRatio = 1.0 + AUDIO_MAX_RATE_DEVIATION * deviation;
+
+	blipLeft.SetRates(CLOCKSPEED, AUDIO_SAMPLE_RATE * rateRatio);
+	blipRight.SetRates(CLOCKSPEED, AUDIO_SAMPLE_RATE * rateRatio);
+}
+
+void APU::PowerOff()
+{
+	for (u16 address = APU_ADDR::APU_START; address < APU_ADDR::NR52; address++)
+	{
+		registers[REG_INDEX(address)] = 0;
+	}
+
+	for (Channel& channel : channels)
+	{
+		channel.enabled = false;
+		channel.dacEnabled = false;
+		channel.lengthEnabled = false;
+		channel.frequency = 0;
+		channel.volume = 0;
+	}
+
+	sweep = {};
+	powered = false;
+
+	UpdateAllOutputs(frameTime);
+}
+
+void APU::SaveState(StateWriter& writer) const
+{
+	// Blip buffers and the output ring hold already synthesized audio, not machine state
+	writer.BeginSection(StateSection::APU);
+	writer.Write(registers);
+	writer.Write(channels);
+	writer.Write(sweep);
+	writer.Write(lfsr);
+	writer.Write(powered);
+	writer.Write(frameSequencerStep);
+	writer.Write(frameSequencerTimer);
+	writer.Write(lastCycle);
+	writer.Write(frameTime);
+	writer.EndSection();
+}
+
+void APU::LoadState(StateReader& reader)
+{
+	if (reader.BeginSection(StateSection::APU))
+	{
+		// The blip buffers keep integrating from the levels they were last given and
+		// stay on their own timeline, so those are kept and the channels step to the
+		// loaded outputs. Taking the saved levels would leave a DC offset in the output.
+		const std::array<Channel, CHANNEL_COUNT> outputs = channels;
+		const u32 blipFrameTime = frameTime;
+
+		reader.Read(registers);
+		reader.Read(channels);
+		reader.Read(sweep);
+		reader.Read(lfsr);
+		reader.Read(powered);
+		reader.Read(frameSequencerStep);
+		reader.Read(frameSequencerTimer);
+		reader.Read(lastCycle);
+		reader.Read(frameTime);
+
+		for (u8 i = 0; i < CHANNEL_COUNT; i++)
+		{
+			channels[i].left = outputs[i].left;
+			channels[i].right = outputs[i].right;
+		}
+		frameTime = blipFrameTime;
+
+		UpdateAllOutputs(frameTime);
+	}
+}
@@ -0,0 +1,89 @@
+#include "audio_buffer.h"
+
+#include <algorithm>
+#include <cstring>
+
+using namespace GB;
+
+u32 AudioRingBuffer::Push(const i16* frames, u32 frameCount)
+{
+	const u32 write = writePos.load(std::memory_order_relaxed);
+	const u32 read = readPos.load(std::memory_order_acquire);
+
+	const u32 freeFrames = AUDIO_RING_FRAMES - (write - read);
+	const u32 count = std::min(frameCount, freeFrames);
+
+	const u32 start = write & RING_MASK;
+	const u32 firstPart = std::min(count, AUDIO_RING_FRAMES - start);
+
+	std::memcpy(&samples[start * 2], frames, firstPart * 2 * sizeof(i16));
+	std::memcpy(&samples[0], frames + firstPart * 2, (count - firstPart) * 2 * sizeof(i16));
+
+	writePos.store(write + count, std::memory_order_release);
+
+	return count;
+}
+
+u32 AudioRingBuffer::Pop(i16* frames, u32 frameCount)
+{
+	const u32 read = readPos.load(std::memory_order_relaxed);
+	const u32 write = writePos.load(std::memory_order_acquire);
+
+	const u32 count = std::min(frameCount, write - read);
+
+	const u32 start = read & RING_MASK;
+	const u32 firstPart = std::min(count, AUDIO_RING_FRAMES - start);
+
+	std::memcpy(frames, &samples[start * 2], firstPart * 2 * sizeof(i16));
+	std::memcpy(frames + firstPart * 2, &samples[0], (count - firstPart) * 2 * sizeof(i16));
+
+	readPos.store(read + count, std::memory_order_release);
+	Wake();
+
+	return count;
+}
+
+u32 AudioRingBuffer::GetFramesAvailable() const
+{
+	return writePos.load(std::memory_order_acquire) - readPos.load(std::memory_order_acquire);
+}
+
+u32 AudioRingBuffer::GetFramesFree() const
+{
+	return AUDIO_RING_FRAMES - GetFramesAvailable();
+}
+
+void AudioRingBuffer::WaitForFill(u32 maxFrames) const
+{
+	const u32 write = writePos.load(std::memory_order_relaxed);
+
+	while (true)
+	{
+		const u32 signal = wakeSignal.load(std::memory_order_acquire);
+
+		if (bStopped.load(std::memory_order_acquire) || write - readPos.load(std::memory_order_acquire) <= maxFrames)
+		{
+			return;
+		}
+
+		wakeSignal.wait(signal, std::memory_order_acquire);
+	}
+}
+
+void AudioRingBuffer::Stop()
+{
+	bStopped.store(true, std::memory_order_release);
+	Wake();
+}
+
+void AudioRingBuffer::Clear()
+{
+	readPos.store(writePos.load(std::memory_order_acquire), std::memory_order_release);
+	Wake();
+}
+
+void AudioRingBuffer::Wake()
+{
+	wakeSignal.fetch_add(1, std::memory_order_release);
+	wakeSignal.notify_all();
+}
@@ -0,0 +1,132 @@
+#include "blip_buffer.h"
+
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+using namespace GB;
+
+namespace
+{
+	using BlipKernel = std::array<std::array<float, BlipBuffer::KERNEL_WIDTH>, BlipBuffer::PHASE_COUNT>;
+
+	// Blackman windowed sinc, one impulse per sub-sample phase, each normalized to sum 1
+	BlipKernel BuildKernel()
+	{
+		constexpr double pi = 3.14159265358979323846;
+		constexpr double cutoff = 0.90;
+		constexpr double halfWidth = BlipBuffer::KERNEL_WIDTH / 2;
+
+		BlipKernel kernel{};
+
+		for (u32 phase = 0; phase < BlipBuffer::PHASE_COUNT; phase++)
+		{
+			const double frac = (double)phase / BlipBuffer::PHASE_COUNT;
+			double sum = 0.0;
+
+			for (u32 tap = 0; tap < BlipBuffer::KERNEL_WIDTH; tap++)
+			{
+				const double x = (double)tap - halfWidth + 1.0 - frac;
+				const double sinc = x == 0.0 ? 1.0 : std::sin(pi * cutoff * x) / (pi * cutoff * x);
+				const double w = (x + halfWidth) / (2.0 * halfWidth);
+				const double window = 0.42 - 0.5 * std::cos(2.0 * pi * w) + 0.08 * std::cos(4.0 * pi * w);
+
+				kernel[phase][tap] = (float)(sinc * window);
+				sum += kernel[phase][tap];
+			}
+
+			for (u32 tap = 0; tap < BlipBuffer::KERNEL_WIDTH; tap++)
+			{
+				kernel[phase][tap] = (float)(kernel[phase][tap] / sum);
+			}
+		}
+
+		return kernel;
+	}
+
+	const BlipKernel& GetKernel()
+	{
+		static const BlipKernel kernel = BuildKernel();
+		return kernel;
+	}
+}
+
+void BlipBuffer::SetRates(double clockRate, double sampleRate)
+{
+	factor = (u64)(sampleRate / clockRate * (double)(1ull << FRAC_BITS));
+}
+
+void BlipBuffer::AddDelta(u32 clockTime, float delta)
+{
+	const u64 position = offset + (u64)clockTime * factor;
+	const u32 index = (u32)(position >> FRAC_BITS);
+	const u32 phase = (u32)(position >> (FRAC_BITS - PHASE_BITS)) & (PHASE_COUNT - 1);
+
+	if (index >= BUFFER_SIZE)
+	{
+		return;
+	}
+
+	const auto& impulse = GetKernel()[phase];
+	float* out = &deltas[index];
+
+	for (u32 tap = 0; tap < KERNEL_WIDTH; tap++)
+	{
+		out[tap] += impulse[tap] * delta;
+	}
+}
+
+void BlipBuffer::EndFrame(u32 clockDuration)
+{
+	offset += (u64)clockDuration * factor;
+
+	// Drop anything that no longer fits rather than writing out of bounds
+	const u64 limit = (u64)BUFFER_SIZE << FRAC_BITS;
+	if (offset > limit)
+	{
+		offset = limit;
+	}
+}
+
+u32 BlipBuffer::GetSamplesAvailable() const
+{
+	return (u32)(offset >> FRAC_BITS);
+}
+
+u32 BlipBuffer::ReadSamples(float* out, u32 count, u32 stride)
+{
+	count = std::min(count, GetSamplesAvailable());
+
+	float sum = integrator;
+	float capacitor = highPass;
+
+	for (u32 i = 0; i < count; i++)
+	{
+		sum += deltas[i];
+
+		// DC blocker, roughly the DMG output capacitor
+		const float sample = sum - capacitor;
+		capacitor += sample * 0.0005f;
+
+		out[i * stride] = sample;
+	}
+
+	integrator = sum;
+	highPass = capacitor;
+
+	const u32 remaining = (u32)deltas.size() - count;
+	std::memmove(deltas.data(), deltas.data() + count, remaining * sizeof(float));
+	std::fill(deltas.begin() + remaining, deltas.end(), 0.0f);
+
+	offset -= (u64)count << FRAC_BITS;
+
+	return count;
+}
+
+void BlipBuffer::Clear()
+{
+	offset = 0;
+	integrator = 0.0f;
+	highPass = 0.0f;
+	deltas.fill(0.0f);
+}
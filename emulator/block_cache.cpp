@@ -0,0 +1,234 @@
+#include "block_cache.h"
+#include "Instructions.h"
+#include "emu.h"
+#include "bus.h"
+#include "cart.h"
+
+using namespace GB;
+
+namespace
+{
+	// Regions code may run from, a block never spans two of them. 0 means not cacheable:
+	// IO and OAM reads can have side effects, echo RAM is left to the slow path.
+	u8 GetCodeRegion(u16 address)
+	{
+		if (address < 0x4000) return 1;
+		if (address < 0x8000) return 2;
+		if (address < 0xA000) return 3;
+		if (address < 0xC000) return 4;
+		if (address < 0xE000) return 5;
+		if (address >= 0xFF80 && address < 0xFFFF) return 6;
+		return 0;
+	}
+
+	bool IsROM_Region(u8 region)
+	{
+		return region == 1 || region == 2;
+	}
+
+	bool EndsBlock(InstrType type)
+	{
+		switch (type)
+		{
+		case InstrType::JP:
+		case InstrType::JR:
+		case InstrType::CALL:
+		case InstrType::RST:
+		case InstrType::RET:
+		case InstrType::RETI:
+		case InstrType::HALT:
+		case InstrType::STOP:
+			return true;
+		default:
+			return false;
+		}
+	}
+}
+
+void BlockCache::SetEnabled(bool bEnabled)
+{
+	bIsEnabled = bEnabled;
+	Clear();
+}
+
+const DecodedInstr* BlockCache::FetchSlow(u16 pc)
+{
+	currentBlock = GetBlock(pc);
+
+	if (!currentBlock)
+	{
+		return nullptr;
+	}
+
+	cursor = 1;
+
+	return &currentBlock->instructions[0];
+}
+
+std::shared_ptr<const CodeBlock> BlockCache::GetBlock(u16 pc)
+{
+	if (!bIsEnabled)
+	{
+		return nullptr;
+	}
+
+	const u32 key = MakeKey(pc);
+	auto it = blocks.find(key);
+
+	if (it == blocks.end())
+	{
+		std::shared_ptr<const CodeBlock> block = BuildBlock(pc);
+		if (!block)
+		{
+			return nullptr;
+		}
+
+		if (!IsROM_Region(GetCodeRegion(pc)))
+		{
+			for (u32 page = block->startPC >> 8; page <= (u32)(block->endPC - 1) >> 8; page++)
+			{
+				pageBlocks[page].push_back(key);
+				EMU::GetBUS()->MarkCodePage((u8)page);
+			}
+		}
+
+		it = blocks.emplace(key, std::move(block)).first;
+	}
+
+	return it->second;
+}
+
+std::shared_ptr<const CodeBlock> BlockCache::FindBlock(u32 key) const
+{
+	auto it = blocks.find(key);
+	return it != blocks.end() ? it->second : nullptr;
+}
+
+std::shared_ptr<const CodeBlock> BlockCache::BuildBlock(u16 pc) const
+{
+	const u8 region = GetCodeRegion(pc);
+	if (region == 0)
+	{
+		return nullptr;
+	}
+
+	MEM_BUS* bus = EMU::GetBUS();
+
+	auto block = std::make_shared<CodeBlock>();
+	block->startPC = pc;
+	block->instructions.reserve(8);
+
+	u16 address = pc;
+
+	while (block->instructions.size() < MAX_BLOCK_INSTRUCTIONS)
+	{
+		DecodedInstr decoded{};
+		decoded.pc = address;
+		decoded.opcode = bus->ReadByte(address);
+		decoded.instruction = Instruction::GetInstruction(decoded.opcode);
+
+		if (!decoded.instruction)
+		{
+			break;
+		}
+
+		const u8 operandCount = Instruction::GetOperandCount(decoded.instruction->mode);
+		decoded.length = 1 + operandCount;
+
+		// Operands must come from the same memory, and the address space must not wrap
+		if (address + operandCount > 0xFFFF || GetCodeRegion(address + operandCount) != region)
+		{
+			break;
+		}
+
+		for (u8 i = 0; i < operandCount; i++)
+		{
+			decoded.operands[i] = bus->ReadByte(address + 1 + i);
+		}
+
+		block->instructions.push_back(decoded);
+		address += decoded.length;
+
+		if (EndsBlock(decoded.instruction->type) || GetCodeRegion(address) != region)
+		{
+			break;
+		}
+	}
+
+	if (block->instructions.empty())
+	{
+		return nullptr;
+	}
+
+	block->endPC = address;
+	return block;
+}
+
+void BlockCache::InvalidatePage(u8 page)
+{
+	for (u32 key : pageBlocks[page])
+	{
+		auto it = blocks.find(key);
+		if (it == blocks.end())
+		{
+			continue;
+		}
+
+		// Drop it from the other pages it spans as well
+		const CodeBlock& block = *it->second;
+		for (u32 otherPage = block.startPC >> 8; otherPage <= (u32)(block.endPC - 1) >> 8; otherPage++)
+		{
+			if (otherPage != page)
+			{
+				std::erase(pageBlocks[otherPage], key);
+			}
+		}
+
+		if (currentBlock == it->second)
+		{
+			currentBlock.reset();
+		}
+
+		blocks.erase(it);
+	}
+
+	pageBlocks[page].clear();
+	EMU::GetBUS()->ClearCodePage(page);
+
+	generation++;
+}
+
+void BlockCache::InvalidateRAMCode()
+{
+	for (u32 page = 0; page < pageBlocks.size(); page++)
+	{
+		if (!pageBlocks[page].empty())
+		{
+			InvalidatePage((u8)page);
+		}
+	}
+}
+
+void BlockCache::Clear()
+{
+	blocks.clear();
+
+	for (u32 page = 0; page < pageBlocks.size(); page++)
+	{
+		if (!pageBlocks[page].empty())
+		{
+			pageBlocks[page].clear();
+			EMU::GetBUS()->ClearCodePage((u8)page);
+		}
+	}
+
+	currentBlock.reset();
+	generation++;
+}
+
+u32 BlockCache::MakeKey(u16 pc)
+{
+	// Only the switchable ROM region depends on banking
+	const u32 bank = (pc >= 0x4000 && pc < 0x8000) ? EMU::GetCartridge()->GetRomBank() : 0;
+	return (bank << 16) | pc;
+}
@@ -9,9 +9,18 @@
 #include "timer.h"
 #include "cpu.h"
 #include "ppu.h"
+#include "save_state.h"
 
 using namespace GB;
 
+namespace
+{
+	bool IsVolatileIO_Addr(u16 address)
+	{
+		return address == 0xFF00 || address == 0xFF04 || address == 0xFF05 || (address >= 0xFF10 && address <= 0xFF3F);
+	}
+}
+
 u8 MEM_BUS::ReadByte(u16 address) const
 {
 
@@ -37,6 +46,11 @@ u8 MEM_BUS::ReadByte(u16 address) const
 
 	if (IO::IsIO_Addr(address))
 	{
+		if (IsVolatileIO_Addr(address))
+		{
+			sideEffectCount++;
+		}
+
 		return EMU::GetIO()->ReadByte(address);
 	}
 
@@ -46,7 +60,22 @@ u8 MEM_BUS::ReadByte(u16 address) const
 
 void MEM_BUS::WriteByte(u16 address, u8 value)
 {
-	if (Cartridge::IsROM_Addr(address) || Cartridge::IsEXT_RAM_Addr(address))
+	sideEffectCount++;
+
+	if (codePages[address >> 8])
+	{
+		EMU::GetCPU()->GetBlockCache().InvalidatePage(address >> 8);
+	}
+
+	if (Cartridge::IsROM_Addr(address))
+	{
+		// Cartridge register write, the ROM bank mapping may change
+		EMU::GetCartridge()->WriteByte(address, value);
+		EMU::GetCPU()->GetBlockCache().ResetCursor();
+		return;
+	}
+
+	if (Cartridge::IsEXT_RAM_Addr(address))
 	{
 		EMU::GetCartridge()->WriteByte(address, value);
 		return;
@@ -117,3 +146,24 @@ bool MEM_BUS::DMA_TransferActive() const
 {
 	return dmaTransferActive;
 }
+
+void MEM_BUS::SaveState(StateWriter& writer) const
+{
+	writer.BeginSection(StateSection::BUS);
+	writer.Write(dmaTransferActive);
+	writer.Write(dmaCurrentByte);
+	writer.Write(dmaValue);
+	writer.Write(dmaStartDelay);
+	writer.EndSection();
+}
+
+void MEM_BUS::LoadState(StateReader& reader)
+{
+	if (reader.BeginSection(StateSection::BUS))
+	{
+		reader.Read(dmaTransferActive);
+		reader.Read(dmaCurrentByte);
+		reader.Read(dmaValue);
+		reader.Read(dmaStartDelay);
+	}
+}
@@ -0,0 +1,71 @@
+#include "call_stack.h"
+#include "block_cache.h"
+
+#include <algorithm>
+#include <cstdio>
+
+using namespace GB;
+
+void ShadowCallStack::Clear()
+{
+	depth = 0;
+	lostFrames = 0;
+	version++;
+}
+
+void ShadowCallStack::Push(const CallFrame& frame)
+{
+	// Frames at or below the new one were overwritten by this push
+	while (depth != 0 && frames[depth - 1].sp <= frame.sp)
+	{
+		depth--;
+	}
+
+	if (depth == SHADOW_STACK_CAPACITY)
+	{
+		std::copy(frames.begin() + 1, frames.end(), frames.begin());
+		depth--;
+		lostFrames++;
+	}
+
+	frames[depth] = frame;
+	frames[depth].bank = BlockCache::MakeKey(frame.target) >> 16;
+	depth++;
+	version++;
+}
+
+void ShadowCallStack::Pop(u16 sp)
+{
+	// Frames the game abandoned by moving SP past them
+	DropBelow(sp);
+
+	// Otherwise the RET pops something no call pushed, e.g. a pushed jump target
+	if (depth != 0 && frames[depth - 1].sp == sp)
+	{
+		depth--;
+		version++;
+	}
+}
+
+void ShadowCallStack::DropBelow(u16 sp)
+{
+	while (depth != 0 && frames[depth - 1].sp < sp)
+	{
+		depth--;
+		version++;
+	}
+}
+
+void ShadowCallStack::Print() const
+{
+	static const char* kindNames[] = { "CALL", "RST", "INT" };
+
+	printf("Call stack, %u frames%s\n", depth, lostFrames != 0 ? " (outermost frames lost)" : "");
+
+	for (u32 i = depth; i-- > 0;)
+	{
+		const CallFrame& frame = frames[i];
+		printf("  #%u %-4s %02X:%04X  returns to %04X  SP %04X\n", depth - 1 - i, kindNames[(u8)frame.kind],
+			   frame.bank, frame.target, frame.returnAddress, frame.sp);
+	}
+}
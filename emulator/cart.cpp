@@ -4,6 +4,7 @@
 #include <iterator>
 #include <fstream>
 #include <format>
+#include "save_state.h"
 
 using namespace GB;
 
@@ -130,14 +131,14 @@ bool Cartridge::Load(std::filesystem::path cartridgeFilePath)
 	printf(std::format("Opened: {}\n", cartridgeFilePath.string()).c_str());
 
 	const u32 romSize = fileStream.tellg();
-	romData.resize(romSize);
+	romData = std::make_shared<std::vector<char>>(romSize);
 
 	fileStream.seekg(std::ios::beg);
-	fileStream.read(romData.data(), romSize);
+	fileStream.read(romData->data(), romSize);
 
 	fileStream.close();
 
-	header = (ROM_Header*)(romData.data() + 0x100);
+	header = (ROM_Header*)(romData->data() + 0x100);
 	//header->title[15] = 0;
 
 	printf("Cartridge Loaded:\n");
@@ -159,7 +160,7 @@ bool Cartridge::ValidateChecksum() const
 	u16 x = 0;
 	for (u16 i = 0x0134; i <= 0x014C; i++)
 	{
-		x = x - romData[i] - 1;
+		x = x - (*romData)[i] - 1;
 	}
 	return x & 0xFF;
 }
@@ -175,10 +176,10 @@ u8 Cartridge::ReadByte(u16 address) const
 			return 0;
 		}
 
-		return EXT_RAM_Banks[currentExtRamBank][address - RAM_ADDR::EXT_RAM_START];
+		return EXT_RAM.Read(currentExtRamBank * RAM_ADDR::EXT_RAM_BANK_SIZE + address - RAM_ADDR::EXT_RAM_START);
     }
 
-    return romData[address];
+    return (*romData)[address];
 }
 
 void Cartridge::WriteByte(u16 address, u8 value)
@@ -192,7 +193,9 @@ void Cartridge::WriteByte(u16 address, u8 value)
 			return;
 		}
 
-		EXT_RAM_Banks[currentExtRamBank][address - RAM_ADDR::EXT_RAM_START] = value;
+		const u32 offset = currentExtRamBank * RAM_ADDR::EXT_RAM_BANK_SIZE + address - RAM_ADDR::EXT_RAM_START;
+		EXT_RAM.Write(offset, value);
+		EXT_RAM_DirtyPages.Mark(offset);
         return;
     }
 
@@ -237,3 +240,45 @@ void Cartridge::Init_ExtRam()
 {
 
 }
+
+void Cartridge::SaveState(StateWriter& writer) const
+{
+	// ROM data is reloaded from the cartridge file, only banking and EXT RAM are saved
+	writer.BeginSection(StateSection::CART);
+	writer.Write(extRamEnabled);
+	writer.Write(currentExtRamBank);
+
+	const u8 bankCount = header ? header->GetExtRamBankCount() : 0;
+	const u32 pageCount = bankCount * RAM_ADDR::EXT_RAM_BANK_SIZE / EXT_RAM.PAGE_SIZE;
+
+	for (u32 page = 0; page < pageCount; page++)
+	{
+		writer.WriteBytes(EXT_RAM.GetPage(page), EXT_RAM.PAGE_SIZE);
+	}
+
+	writer.EndSection();
+}
+
+void Cartridge::LoadState(StateReader& reader)
+{
+	if (reader.BeginSection(StateSection::CART))
+	{
+		reader.Read(extRamEnabled);
+		reader.Read(currentExtRamBank);
+
+		const u8 bankCount = header ? header->GetExtRamBankCount() : 0;
+		const u32 pageCount = bankCount * RAM_ADDR::EXT_RAM_BANK_SIZE / EXT_RAM.PAGE_SIZE;
+
+		for (u32 page = 0; page < pageCount; page++)
+		{
+			reader.ReadBytes(EXT_RAM.GetWritablePage(page), EXT_RAM.PAGE_SIZE);
+		}
+
+		EXT_RAM_DirtyPages.MarkAll();
+	}
+}
+
+u16 Cartridge::GetROMChecksum() const
+{
+	return header ? header->globalChecksum : 0;
+}
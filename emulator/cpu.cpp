@@ -3,7 +3,13 @@
 #include "Instructions.h"
 #include "emu.h"
 #include "timer.h"
+#include "save_state.h"
+#include "trace.h"
+#include "reference_log.h"
+#include "profiler.h"
+#include "cart.h"
 
+#include <bit>
 #include <thread>
 #include <chrono>
 #include <format>
@@ -24,88 +30,180 @@ CPU::CPU()
 	registers = {};
 	registers.PC = 0x100;
 	registers.SP = 0xFFFE;
-	registers.Write(RegisterType::AF, 0x01B0);
-	registers.Write(RegisterType::BC, 0x0013);
-	registers.Write(RegisterType::DE, 0x00D8);
-	registers.Write(RegisterType::HL, 0x014d);
+	registers.Set<RegisterType::AF>(0x01B0);
+	registers.Set<RegisterType::BC>(0x0013);
+	registers.Set<RegisterType::DE>(0x00D8);
+	registers.Set<RegisterType::HL>(0x014d);
 
 	//EMU::GetTimer()->WriteByte(0xFF04, 0xABCC);
 }
 
-bool CPU::Step()
+bool CPU::Step(bool bSingleInstruction)
 {
 	if (!halted)
 	{
-		u16 PC = registers.PC;
+		// Compiled blocks are entered where the interpreter's cursor would start a new block
+		if (!bSingleInstruction && !blockCache.IsNext(registers.PC))
+		{
+			u32 executed = aotCode ? aotCode->Run(*this, registers.PC) : 0;
 
-		FetchInstruction();
+			if (executed == 0 && jit.IsEnabled())
+			{
+				executed = jit.IsLockstep() ? EMU::GetEMU()->RunJitLockstep() : jit.Run(*this, registers.PC);
+			}
 
-		u16 PC_temp = registers.PC;
+			if (executed != 0)
+			{
+				return true;
+			}
+		}
 
-		FetchData();
+		const u16 PC = registers.PC;
 
-#ifdef DEBUG_PRINT
-
-		if (instruction)
+		FetchInstruction();
+		ExecuteInstruction(PC);
+	}
+	else
+	{
+		// Only the timebase moves while halted: jump to the M-cycle holding the next
+		// PPU or timer event, unless a pending flag already ends the HALT now
+		if (!IF_Flags)
 		{
-			//Instruction::PrintInfo(instruction);
+			const u32 idleCycles = EMU::GetIdleMCycles();
+			if (idleCycles != 0)
+			{
+				EMU::Advance(idleCycles);
+			}
 		}
 
-		const std::string debug = std::format("{:08X} - {:04X} {:12} ({:02X} {:02X} {:02X}) A: {:02X} F: {} BC: {:02X}{:02X} DE: {:02X}{:02X} HL: {:02X}{:02X}\n",
-											  EMU::GetEMU()->GetCycles(),
-											  PC,
-											  GetInstructionDebugString().c_str(),
-											  opcode,
-											  EMU::GetBUS()->ReadByte(PC + 1),
-											  EMU::GetBUS()->ReadByte(PC + 2),
-											  registers.A, registers.GetFlagsString().c_str(),
-											  registers.B, registers.C,
-											  registers.D, registers.E,
-											  registers.H, registers.L);
-
-		if (EMU::GetEMU()->GetCycles() % 100000 == 0)
+		EMU::GetEMU()->Cycle(1);
+
+		if (IF_Flags)
 		{
-			printf(debug.c_str());
+			halted = false;
 		}
+	}
+
+	UpdateInterrupts();
+
+	return true;
+}
+
+void CPU::StepDecoded(const DecodedInstr& decoded)
+{
+	const u16 PC = registers.PC;
+
+	LoadDecoded(decoded);
+	ExecuteInstruction(PC);
+
+	// The caller owns 'decoded', nothing may read through it later
+	fetchOperands = nullptr;
+
+	UpdateInterrupts();
+}
+
+void CPU::CompleteDecoded(const DecodedInstr& decoded, u8 mCycles)
+{
+	opcode = decoded.opcode;
+	instruction = decoded.instruction;
+
+	EMU::Cycle(mCycles);
+
+	CheckBackwardJump(decoded.pc);
+	UpdateInterrupts();
+}
+
+void CPU::ExecuteInstruction(u16 PC)
+{
+#ifdef GB_TRACE
+	if (trace || referenceLog)
+	{
+		TraceInstruction(PC);
+	}
+#endif
+
+	if (profiler)
+	{
+		ProfileInstruction(PC);
+	}
+
+	FetchData();
+
+#ifdef DEBUG_PRINT
+
+	if (instruction)
+	{
+		//Instruction::PrintInfo(instruction);
+	}
+
+	const std::string debug = std::format("{:08X} - {:04X} {:12} ({:02X} {:02X} {:02X}) A: {:02X} F: {} BC: {:02X}{:02X} DE: {:02X}{:02X} HL: {:02X}{:02X}\n",
+										  EMU::GetEMU()->GetCycles(),
+										  PC,
+										  GetInstructionDebugString().c_str(),
+										  opcode,
+										  EMU::GetBUS()->ReadByte(PC + 1),
+										  EMU::GetBUS()->ReadByte(PC + 2),
+										  registers.A, registers.GetFlagsString().c_str(),
+										  registers.B, registers.C,
+										  registers.D, registers.E,
+										  registers.H, registers.L);
+
+	if (EMU::GetEMU()->GetCycles() % 100000 == 0)
+	{
+		printf(debug.c_str());
+	}
 
 #ifdef GB_DOCTOR
 
-		const std::string gbDoctor = std::format("A:{:02X} F:{:02X} B:{:02X} C:{:02X} D:{:02X} E:{:02X} H:{:02X} L:{:02X} SP:{:04X} PC:{:04X} PCMEM:{:02X},{:02X},{:02X},{:02X}\n",
-												 registers.A,
-												 registers.F,
-												 registers.B,
-												 registers.C,
-												 registers.D,
-												 registers.E,
-												 registers.H,
-												 registers.L,
-												 registers.SP,
-												 PC,
-												 EMU::GetBUS()->ReadByte(PC),
-												 EMU::GetBUS()->ReadByte(PC + 1),
-												 EMU::GetBUS()->ReadByte(PC + 2),
-												 EMU::GetBUS()->ReadByte(PC + 3)
-		);
-		gbdFile << gbDoctor;
+	const std::string gbDoctor = std::format("A:{:02X} F:{:02X} B:{:02X} C:{:02X} D:{:02X} E:{:02X} H:{:02X} L:{:02X} SP:{:04X} PC:{:04X} PCMEM:{:02X},{:02X},{:02X},{:02X}\n",
+											 registers.A,
+											 registers.Get<RegisterType::F>(),
+											 registers.B,
+											 registers.C,
+											 registers.D,
+											 registers.E,
+											 registers.H,
+											 registers.L,
+											 registers.SP,
+											 PC,
+											 EMU::GetBUS()->ReadByte(PC),
+											 EMU::GetBUS()->ReadByte(PC + 1),
+											 EMU::GetBUS()->ReadByte(PC + 2),
+											 EMU::GetBUS()->ReadByte(PC + 3)
+	);
+	gbdFile << gbDoctor;
 #endif
 
 #endif
 
 #ifdef DEBUG_PRINT_SCREEN
-		EMU::GetEMU()->DebugUpdate();
-		EMU::GetEMU()->DebugPrint();
+	EMU::GetEMU()->DebugUpdate();
+	EMU::GetEMU()->DebugPrint();
 #endif
 
-		Execute();
-	}
-	else
+	Execute();
+
+	CheckBackwardJump(PC);
+}
+
+void CPU::CheckBackwardJump(u16 PC)
+{
+	// A taken short backward jump closes a potential busy-wait loop
+	if (idleLoop.IsEnabled() && instruction &&
+		(instruction->type == InstrType::JR || instruction->type == InstrType::JP) &&
+		registers.PC < PC && PC - registers.PC <= MAX_IDLE_LOOP_BYTES)
 	{
-		EMU::GetEMU()->Cycle(1);
+		idleLoop.OnBackwardJump(registers.PC, registers, interruptsEnabled);
+	}
+}
 
-		if (IF_Flags)
-		{
-			halted = false;
-		}
+void CPU::UpdateInterrupts()
+{
+	// The usual step: no EI in flight and nothing to dispatch. Evaluated without
+	// short circuits so it stays a single branch.
+	if (!(enableInterrupts | (interruptsEnabled & (pendingInterrupts != 0))))
+	{
+		return;
 	}
 
 	if (interruptsEnabled)
@@ -118,8 +216,6 @@ bool CPU::Step()
 	{
 		interruptsEnabled = true;
 	}
-
-	return true;
 }
 
 void CPU::Execute()
@@ -172,6 +268,12 @@ void CPU::Execute()
 
 u8 CPU::ReadBytePC()
 {
+	if (fetchOperands)
+	{
+		registers.PC++;
+		return *fetchOperands++;
+	}
+
 	const u8 value = EMU::GetBUS()->ReadByte(registers.PC);
 	registers.PC++;
 	return value;
@@ -201,6 +303,7 @@ u8 CPU::GetInterruptFlags() const
 void CPU::SetInterruptFlags(u8 newFlags)
 {
 	IF_Flags = newFlags;
+	UpdatePendingInterrupts();
 }
 
 bool CPU::IsInterruptSet(const IntType type) const
@@ -216,6 +319,7 @@ u8 CPU::GetInterruptEnabledFlags() const
 void CPU::SetInterruptEnabledFlags(u8 newFlags)
 {
 	IE_Flags = newFlags;
+	UpdatePendingInterrupts();
 }
 
 bool CPU::IsInterruptEnabled(const IntType type) const
@@ -225,59 +329,93 @@ bool CPU::IsInterruptEnabled(const IntType type) const
 
 void CPU::HandleInterrupts()
 {
-	auto executeInterrupt = [this](u16 address, IntType type)
+	if (!pendingInterrupts)
 	{
-		if (IsInterruptSet(type) && IsInterruptEnabled(type))
-		{
-			Stack_PushWord(registers.GetPC());
-			registers.SetPC(address);
+		return;
+	}
 
-			IF_Flags &= ~(u8)type;
-			halted = false;
-			interruptsEnabled = false;
+	// The lowest bit has priority: VBlank, LCD STAT, Timer, Serial, Joypad.
+	// Their vectors are 8 bytes apart starting at 0x40.
+	const u8 index = (u8)std::countr_zero(pendingInterrupts);
 
-			return true;
-		}
+	const u16 returnAddress = registers.GetPC();
+	Stack_PushWord(returnAddress);
+	registers.SetPC(0x40 + index * 8);
 
-		return false;
-	};
+	callStack.OnCall(0x40 + index * 8, returnAddress, registers.SP, CallKind::INTERRUPT);
 
-	if (executeInterrupt(0x40, IntType::IT_VBlank))
-	{
-		return;
-	}
+	IF_Flags &= ~(1 << index);
+	UpdatePendingInterrupts();
+
+	halted = false;
+	interruptsEnabled = false;
+}
+
+void CPU::RequestInterrupt(const IntType type)
+{
+	IF_Flags |= (u8)type;
+	UpdatePendingInterrupts();
+}
+
+void CPU::Sleep(u32 ms)
+{
+	std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
 
-	if (executeInterrupt(0x48, IntType::IT_LCD_Stat))
+void CPU::TraceInstruction(u16 PC)
+{
+	// Speculative frames are rolled back, as far as the trace goes they never ran
+	if (EMU::GetEMU()->IsSpeculating())
 	{
 		return;
 	}
 
-	if (executeInterrupt(0x50, IntType::IT_Timer))
+	TraceRecord record{};
+	record.cycle = EMU::GetEMU()->GetCycles();
+	record.pc = PC;
+	record.sp = registers.SP;
+	record.bank = PC >= 0x4000 && PC < 0x8000 ? EMU::GetCartridge()->GetRomBank() : 0;
+
+	for (u8 i = 0; i < 4; i++)
 	{
-		return;
+		record.bytes[i] = EMU::GetBUS()->ReadByte(PC + i);
 	}
 
-	if (executeInterrupt(0x58, IntType::IT_Serial))
+	record.a = registers.A;
+	record.f = (u8)registers.Read(RegisterType::F);
+	record.b = registers.B;
+	record.c = registers.C;
+	record.d = registers.D;
+	record.e = registers.E;
+	record.h = registers.H;
+	record.l = registers.L;
+	record.ime = interruptsEnabled;
+
+	if (trace)
 	{
-		return;
+		trace->Record(record);
 	}
 
-	if (executeInterrupt(0x60, IntType::IT_Joypad))
+	if (referenceLog && !referenceLog->Check(record))
 	{
-		return;
+		// Already reported, the rest of the run would only diverge further
+		referenceLog = nullptr;
+		EMU::GetEMU()->Shutdown();
 	}
 }
 
-void CPU::RequestInterrupt(const IntType type)
+void CPU::ProfileInstruction(u16 PC)
 {
-	const u8 currentFlags = GetInterruptFlags();
+	if (EMU::GetEMU()->IsSpeculating())
+	{
+		return;
+	}
 
-	SetInterruptFlags(currentFlags | (u8)type);
-}
+	// The CB operand is not fetched yet
+	const u8 cbOpcode = fetchOperands ? fetchOperands[0] : EMU::GetBUS()->ReadByte(PC + 1);
+	const u16 opcodeIndex = opcode == 0xCB ? 0x100 | cbOpcode : opcode;
 
-void CPU::Sleep(u32 ms)
-{
-	std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+	profiler->OnInstruction(opcodeIndex, BlockCache::MakeKey(PC), EMU::GetEMU()->GetCycles(), callStack);
 }
 
 std::string CPU::GetInstructionDebugString() const
@@ -386,3 +524,59 @@ std::string CPU::GetInstructionDebugString() const
 	debugString += paramString;
 	return debugString;
 }
+
+void CPU::SaveState(StateWriter& writer) const
+{
+	// Only state that survives between Step calls, fetch/decode scratch is rebuilt every instruction
+	writer.BeginSection(StateSection::CPU);
+
+	// A F B C D E H L SP PC, pending lazy flags are folded into F first
+	for (RegisterType pair : { RegisterType::AF, RegisterType::BC, RegisterType::DE, RegisterType::HL })
+	{
+		const u16 value = registers.Read(pair);
+		writer.Write((u8)(value >> 8));
+		writer.Write((u8)(value & 0xFF));
+	}
+	writer.Write(registers.SP);
+	writer.Write(registers.PC);
+
+	writer.Write(halted);
+	writer.Write(stepping);
+	writer.Write(interruptsEnabled);
+	writer.Write(enableInterrupts);
+	writer.Write(IF_Flags);
+	writer.Write(IE_Flags);
+	writer.EndSection();
+}
+
+void CPU::LoadState(StateReader& reader)
+{
+	if (reader.BeginSection(StateSection::CPU))
+	{
+		for (RegisterType pair : { RegisterType::AF, RegisterType::BC, RegisterType::DE, RegisterType::HL })
+		{
+			u8 high = 0;
+			u8 low = 0;
+			reader.Read(high);
+			reader.Read(low);
+			// Writing AF also drops whatever lazy flag update was pending
+			registers.Write(pair, high << 8 | low);
+		}
+		reader.Read(registers.SP);
+		reader.Read(registers.PC);
+		reader.Read(halted);
+		reader.Read(stepping);
+		reader.Read(interruptsEnabled);
+		reader.Read(enableInterrupts);
+		reader.Read(IF_Flags);
+		reader.Read(IE_Flags);
+		UpdatePendingInterrupts();
+
+		idleLoop.Reset();
+
+		// Whatever ran from RAM may be gone, ROM blocks stay valid. Compiled blocks
+		// notice through the cache generation.
+		blockCache.InvalidateRAMCode();
+		fetchOperands = nullptr;
+	}
+}
@@ -0,0 +1,156 @@
+#include "cpu.h"
+#include "bus.h"
+#include "emu.h"
+
+#include <array>
+#include <utility>
+
+namespace GB
+{
+	// Every CB opcode gets its own handler, with the operation, the operand and the
+	// bit index folded in at compile time. BIT/SET/RES on a register end up as a
+	// single bit operation on the register file.
+	struct CBInstructions
+	{
+		using Handler = void (*)(CPU&);
+
+		// Operand encoded in bits 0-2 of the opcode
+		static constexpr RegisterType OPERANDS[] =
+		{
+			RegisterType::B,
+			RegisterType::C,
+			RegisterType::D,
+			RegisterType::E,
+			RegisterType::H,
+			RegisterType::L,
+			RegisterType::HL,
+			RegisterType::A
+		};
+
+		template<RegisterType reg>
+		static u8 ReadOperand(CPU& cpu)
+		{
+			if constexpr (reg == RegisterType::HL)
+			{
+				return EMU::GetBUS()->ReadByte(cpu.registers.Get<RegisterType::HL>());
+			}
+			else
+			{
+				return (u8)cpu.registers.Get<reg>();
+			}
+		}
+
+		template<RegisterType reg>
+		static void WriteOperand(CPU& cpu, u8 value)
+		{
+			if constexpr (reg == RegisterType::HL)
+			{
+				EMU::GetBUS()->WriteByte(cpu.registers.Get<RegisterType::HL>(), value);
+				EMU::Cycle(1);
+			}
+			else
+			{
+				cpu.registers.Set<reg>(value);
+			}
+		}
+
+		// RLC RRC RL RR SLA SRA SWAP SRL, selected by bits 3-5
+		template<u8 op>
+		static u8 Shift(CPU_Registers& registers, u8 value)
+		{
+			u8 result = 0;
+			u8 shiftedBit = 0;
+
+			if constexpr (op == 0)
+			{
+				shiftedBit = value >> 7;
+				result = (value << 1) | shiftedBit;
+			}
+			else if constexpr (op == 1)
+			{
+				shiftedBit = value & 0x1;
+				result = (value >> 1) | (shiftedBit << 7);
+			}
+			else if constexpr (op == 2)
+			{
+				shiftedBit = value >> 7;
+				result = (value << 1) | registers.GetCarryFlag();
+			}
+			else if constexpr (op == 3)
+			{
+				shiftedBit = value & 0x1;
+				result = (value >> 1) | (registers.GetCarryFlag() << 7);
+			}
+			else if constexpr (op == 4)
+			{
+				shiftedBit = value >> 7;
+				result = value << 1;
+			}
+			else if constexpr (op == 5)
+			{
+				shiftedBit = value & 0x1;
+				result = (value >> 1) | (value & 0x80);
+			}
+			else if constexpr (op == 6)
+			{
+				result = ((value & 0x0F) << 4) | ((value & 0xF0) >> 4);
+			}
+			else
+			{
+				shiftedBit = value & 0x1;
+				result = value >> 1;
+			}
+
+			registers.SetFlags(result == 0, 0, 0, shiftedBit);
+			return result;
+		}
+
+		template<u8 cbOpcode>
+		static void Execute(CPU& cpu)
+		{
+			constexpr RegisterType reg = OPERANDS[cbOpcode & 0b111];
+			constexpr u8 bitIndex = (cbOpcode >> 3) & 0b111;
+			constexpr u8 bitMask = 1 << bitIndex;
+
+			if constexpr (cbOpcode < 0x40)
+			{
+				WriteOperand<reg>(cpu, Shift<bitIndex>(cpu.registers, ReadOperand<reg>(cpu)));
+			}
+			else if constexpr (cbOpcode < 0x80)
+			{
+				// BIT, never writes back
+				cpu.registers.SetFlags((ReadOperand<reg>(cpu) & bitMask) == 0, 0, 1, -1);
+			}
+			else if constexpr (cbOpcode < 0xC0)
+			{
+				// RES
+				WriteOperand<reg>(cpu, ReadOperand<reg>(cpu) & ~bitMask);
+			}
+			else
+			{
+				// SET
+				WriteOperand<reg>(cpu, ReadOperand<reg>(cpu) | bitMask);
+			}
+		}
+
+		template<size_t... cbOpcodes>
+		static constexpr std::array<Handler, 256> MakeHandlers(std::index_sequence<cbOpcodes...>)
+		{
+			return { { &Execute<(u8)cbOpcodes>... } };
+		}
+	};
+}
+
+using namespace GB;
+
+namespace
+{
+	constexpr std::array<CBInstructions::Handler, 256> CB_HANDLERS = CBInstructions::MakeHandlers(std::make_index_sequence<256>());
+}
+
+void CPU::Instruction_CB()
+{
+	EMU::Cycle(2);
+
+	CB_HANDLERS[fetched_data & 0xFF](*this);
+}
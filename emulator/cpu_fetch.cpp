@@ -7,10 +7,25 @@ using namespace GB;
 
 void CPU::FetchInstruction()
 {
+	if (const DecodedInstr* decoded = blockCache.Fetch(registers.PC))
+	{
+		LoadDecoded(*decoded);
+		return;
+	}
+
+	fetchOperands = nullptr;
 	opcode = ReadBytePC();
 	instruction = Instruction::GetInstruction(opcode);
 }
 
+void CPU::LoadDecoded(const DecodedInstr& decoded)
+{
+	opcode = decoded.opcode;
+	instruction = decoded.instruction;
+	fetchOperands = decoded.operands.data();
+	registers.PC++;
+}
+
 void CPU::FetchData()
 {
 	mem_dest = 0;
@@ -41,7 +56,7 @@ void CPU::FetchData()
 	case AddrMode::R_HLI:
 	case AddrMode::R_HLD:
 	{
-		const u16 HLValue = registers.Read(RegisterType::HL);
+		const u16 HLValue = registers.Get<RegisterType::HL>();
 		fetched_data = EMU::GetBUS()->ReadByte(HLValue);
 		EMU::Cycle(1);
 		return;
@@ -49,7 +64,7 @@ void CPU::FetchData()
 	case AddrMode::HLI_R:
 	case AddrMode::HLD_R:
 	{
-		const u16 HLValue = registers.Read(RegisterType::HL);
+		const u16 HLValue = registers.Get<RegisterType::HL>();
 		SetMemDest(HLValue);
 
 		fetched_data = registers.Read(instruction->reg_2);
@@ -7,8 +7,8 @@ using namespace GB;
 
 void CPU::Stack_PushByte(u8 value)
 {
-	registers.Decrement(RegisterType::SP);
-	const u16 SP_Value = registers.Read(RegisterType::SP);
+	registers.Decrement<RegisterType::SP>();
+	const u16 SP_Value = registers.Get<RegisterType::SP>();
 	EMU::GetBUS()->WriteByte(SP_Value, value);
 }
 
@@ -18,16 +18,14 @@ void CPU::Stack_PushWord(u16 value)
 	Stack_PushByte(hi);
 	const u8 lo = value & 0xFF;
 	Stack_PushByte(lo);
-	stackDebug.push_back(value);
-	stackCounter++;
-	//printf("-- STA: PUSH %u(0x%04X) | SP: 0x%04X C: %u\n", value, value, registers.Read(RT_SP), stackCounter);
+	//printf("-- STA: PUSH %u(0x%04X) | SP: 0x%04X\n", value, value, registers.Read(RT_SP));
 }
 
 u8 CPU::Stack_PopByte()
 {
-	const u16 SP_Value = registers.Read(RegisterType::SP);
+	const u16 SP_Value = registers.Get<RegisterType::SP>();
 	const u8 value = EMU::GetBUS()->ReadByte(SP_Value);
-	registers.Increment(RegisterType::SP);
+	registers.Increment<RegisterType::SP>();
 
 	return value;
 }
@@ -37,9 +35,7 @@ u16 CPU::Stack_PopWord()
 	const u8 low = Stack_PopByte();
 	const u8 hi = Stack_PopByte();
 	const u16 value = (hi << 8) | low;
-	stackDebug.erase(stackDebug.end() - 1);
-	stackCounter--;
-	//printf("-- STA: POP %u(0x%04X) | SP: 0x%04X C: %u\n", value, value, registers.Read(RT_SP), stackCounter);
+	//printf("-- STA: POP %u(0x%04X) | SP: 0x%04X\n", value, value, registers.Read(RT_SP));
 
 	return value;
 }
@@ -73,11 +69,11 @@ void CPU::Instruction_LD()
 
 	if (instruction->mode == AddrMode::R_HLI || instruction->mode == AddrMode::HLI_R)
 	{
-		registers.Increment(RegisterType::HL);
+		registers.Increment<RegisterType::HL>();
 	}
 	else if (instruction->mode == AddrMode::R_HLD || instruction->mode == AddrMode::HLD_R)
 	{
-		registers.Decrement(RegisterType::HL);
+		registers.Decrement<RegisterType::HL>();
 	}
 
 	if (mem_dest_isMem)
@@ -113,6 +109,11 @@ void CPU::Instruction_LD()
 	}
 
 	registers.Write(instruction->reg_1, fetched_data);
+
+	if (instruction->reg_1 == RegisterType::SP)
+	{
+		callStack.OnStackPointerSet(registers.SP);
+	}
 }
 
 void CPU::Instruction_LDH()
@@ -136,31 +137,30 @@ void CPU::Instruction_INC()
 	EMU::Cycle(1);
 
 	const bool isWordReg = registers.IsWordSize(instruction->reg_1);
-	const u16 newValue = fetched_data + 1;
 
 	if (isWordReg)
 	{
 		EMU::Cycle(1);
 	}
 
+	// INC rr leaves the flags alone
+	if (isWordReg && instruction->mode != AddrMode::MR)
+	{
+		registers.Write(instruction->reg_1, (fetched_data + 1) & 0xFFFF);
+		return;
+	}
+
+	const u8 newValue = IncByte(registers, fetched_data & 0xFF);
+
 	if (mem_dest_isMem)
 	{
-		EMU::GetBUS()->WriteByte(mem_dest, newValue & 0xFF);
+		EMU::GetBUS()->WriteByte(mem_dest, newValue);
 		EMU::Cycle(1);
 	}
 	else
 	{
-		registers.Write(instruction->reg_1, newValue & 0xFFFF);
+		registers.Write(instruction->reg_1, newValue);
 	}
-
-	if (isWordReg && instruction->mode != AddrMode::MR)
-	{
-		return;
-	}
-
-	const u8 zFlag = (newValue & 0xFF) == 0;
-	const u8 hFlag = ((fetched_data & 0xF) + 1) > 0xF;
-	registers.SetFlags(zFlag, 0, hFlag, -1);
 }
 
 void CPU::Instruction_DEC()
@@ -168,61 +168,61 @@ void CPU::Instruction_DEC()
 	EMU::Cycle(1);
 
 	const bool isWordReg = registers.IsWordSize(instruction->reg_1);
-	u16 newValue = fetched_data - 1;
 
 	if (isWordReg)
 	{
 		EMU::Cycle(1);
 	}
 
+	// DEC rr leaves the flags alone
+	if (isWordReg && instruction->mode != AddrMode::MR)
+	{
+		registers.Write(instruction->reg_1, (fetched_data - 1) & 0xFFFF);
+		return;
+	}
+
+	const u8 newValue = DecByte(registers, fetched_data & 0xFF);
+
 	if (mem_dest_isMem)
 	{
-		EMU::GetBUS()->WriteByte(mem_dest, newValue & 0xFF);
+		EMU::GetBUS()->WriteByte(mem_dest, newValue);
 		EMU::Cycle(1);
 	}
 	else
 	{
-		registers.Write(instruction->reg_1, newValue & 0xFFFF);
+		registers.Write(instruction->reg_1, newValue);
 	}
-
-	if (isWordReg && instruction->mode != AddrMode::MR)
-	{
-		return;
-	}
-
-	const u8 zFlag = (newValue & 0xFF) == 0;
-	const u8 hFlag = (((i16)fetched_data & 0xF) - 1) < 0;
-	registers.SetFlags(zFlag, 1, hFlag, -1);
 }
 
 void CPU::Instruction_ADD()
 {
 	EMU::Cycle(1);
 
+	if (!registers.IsWordSize(instruction->reg_1))
+	{
+		AluAdd(registers, fetched_data & 0xFF, 0);
+		return;
+	}
+
 	const u16 currentValue = registers.Read(instruction->reg_1);
 	u16 newValue = currentValue + fetched_data;
 
-	u8 isZero = (newValue & 0xFF) == 0;
+	EMU::Cycle(1);
+
+	i8 isZero = 0;
 	bool hFlag = ((currentValue & 0xF) + (fetched_data & 0xF)) > 0xF;
 	bool cFlag = ((i16)(currentValue & 0xFF) + (i16)(fetched_data & 0xFF)) > 0xFF;
 
-	if (registers.IsWordSize(instruction->reg_1))
+	if (instruction->reg_1 == RegisterType::SP)
 	{
 		EMU::Cycle(1);
-
-		if (instruction->reg_1 == RegisterType::SP)
-		{
-			EMU::Cycle(1);
-			newValue = currentValue + (i8)fetched_data;
-
-			isZero = 0;
-		}
-		else
-		{
-			isZero = -1;
-			hFlag = ((currentValue & 0xFFF) + (fetched_data & 0xFFF)) > 0xFFF;
-			cFlag = ((u32)currentValue + (u32)fetched_data) > 0xFFFF;
-		}
+		newValue = currentValue + (i8)fetched_data;
+	}
+	else
+	{
+		isZero = -1;
+		hFlag = ((currentValue & 0xFFF) + (fetched_data & 0xFFF)) > 0xFFF;
+		cFlag = ((u32)currentValue + (u32)fetched_data) > 0xFFFF;
 	}
 
 	registers.Write(instruction->reg_1, newValue & 0xFFFF);
@@ -233,24 +233,21 @@ void CPU::Instruction_ADC()
 {
 	EMU::Cycle(1);
 
-	const u16 currentValue = registers.Read(instruction->reg_1);
-	const u16 data = fetched_data;
-	const u16 carry = registers.GetCarryFlag();
-	const u16 newValue = currentValue + data + carry;
-
-	registers.Write(instruction->reg_1, newValue & 0xFFFF);
-
-	u8 isZero = (newValue & 0xFF) == 0;
-	u8 hFlag = ((currentValue & 0xF) + (fetched_data & 0xF) + carry) > 0xF;
-	u8 cFlag = ((i16)(currentValue & 0xFF) + (i16)(fetched_data & 0xFF) + carry) > 0xFF;
-
-	registers.SetFlags(isZero, 0, hFlag, cFlag);
+	AluAdd(registers, fetched_data & 0xFF, registers.GetCarryFlag());
 }
 
 void CPU::Instruction_SUB()
 {
 	EMU::Cycle(1);
 
+	if (!registers.IsWordSize(instruction->reg_1))
+	{
+		AluSub(registers, fetched_data & 0xFF, 0);
+		return;
+	}
+
+	EMU::Cycle(1);
+
 	const u16 currentValue = registers.Read(instruction->reg_1);
 	u32 newValue = currentValue - fetched_data;
 
@@ -261,16 +258,9 @@ void CPU::Instruction_SUB()
 
 	registers.Write(instruction->reg_1, newValue & 0xFFFF);
 
-	bool isZero = (newValue & 0xFF) == 0;
-	bool hFlag = (((i16)currentValue & 0xF) - ((i16)fetched_data & 0xF)) < 0;
-	bool cFlag = (((i16)currentValue & 0xFF) - ((i16)fetched_data & 0xFF)) < 0;
-
-	if (registers.IsWordSize(instruction->reg_1))
-	{
-		EMU::Cycle(1);
-		hFlag = ((currentValue & 0xFFF) + (fetched_data & 0xFFF)) > 0xFFF;
-		cFlag = newValue > 0xFFFF;
-	}
+	const bool isZero = (newValue & 0xFF) == 0;
+	const bool hFlag = ((currentValue & 0xFFF) + (fetched_data & 0xFFF)) > 0xFFF;
+	const bool cFlag = newValue > 0xFFFF;
 
 	registers.SetFlags(isZero, 1, hFlag, cFlag);
 }
@@ -279,29 +269,18 @@ void CPU::Instruction_SBC()
 {
 	EMU::Cycle(1);
 
-	const u16 currentValue = registers.Read(instruction->reg_1);
-	const u16 data = fetched_data;
-	const u16 carry = registers.GetCarryFlag();
-	const u16 newValue = currentValue - fetched_data - carry;
-
-	registers.Write(instruction->reg_1, newValue & 0xFFFF);
-
-	const u8 isZero = (newValue & 0xFF) == 0;
-	const u8 hFlag = (((i16)currentValue & 0xF) - ((i16)fetched_data & 0xF) - carry) < 0;
-	const u8 cFlag = (((i16)currentValue & 0xFF) - ((i16)fetched_data & 0xFF) - carry) < 0;
-
-	registers.SetFlags(isZero, 1, hFlag, cFlag);
+	AluSub(registers, fetched_data & 0xFF, registers.GetCarryFlag());
 }
 
 void CPU::Instruction_RLCA()
 {
 	EMU::Cycle(1);
 
-	const u8 currentValue = registers.Read(RegisterType::A);
+	const u8 currentValue = registers.Get<RegisterType::A>();
 	const u8 bitZero = (currentValue & 0x80) > 0;
 	const u8 newValue = (currentValue << 1) | bitZero;
 
-	registers.Write(RegisterType::A, newValue);
+	registers.Set<RegisterType::A>(newValue);
 	registers.SetFlags(0, 0, 0, bitZero);
 }
 
@@ -309,12 +288,12 @@ void CPU::Instruction_RRCA()
 {
 	EMU::Cycle(1);
 
-	const u8 currentValue = registers.Read(RegisterType::A);
+	const u8 currentValue = registers.Get<RegisterType::A>();
 	const u8 bitZero = currentValue & 0x1;
 	u8 newValue = currentValue >> 1;
 	newValue |= bitZero << 7;
 
-	registers.Write(RegisterType::A, newValue);
+	registers.Set<RegisterType::A>(newValue);
 	registers.SetFlags(0, 0, 0, bitZero);
 }
 
@@ -363,6 +342,9 @@ void CPU::Instruction_CALL_RST()
 		Stack_PushWord(nextInstruction);
 		registers.SetPC(jumpAddress);
 
+		callStack.OnCall(jumpAddress, nextInstruction, registers.SP,
+						 instruction->type == InstrType::RST ? CallKind::RST : CallKind::CALL);
+
 		EMU::Cycle(3);
 	}
 }
@@ -378,6 +360,8 @@ void CPU::Instruction_RET_RETI()
 
 	if (IsConditionMet(instruction->cond))
 	{
+		callStack.OnReturn(registers.SP);
+
 		const u16 jumpAddress = Stack_PopWord();
 		EMU::Cycle(2);
 
@@ -404,162 +388,25 @@ void CPU::Instruction_EI_DI()
 	interruptsEnabled = false;
 }
 
-void CPU::Instruction_CB()
-{
-	EMU::Cycle(2);
-
-	const u8 CB_opcode = (fetched_data >> 3);
-	const u8 bitIndex = (fetched_data >> 3) & 0b111;
-
-	RegisterType rt_lookup[] = {
-	RegisterType::B,
-	RegisterType::C,
-	RegisterType::D,
-	RegisterType::E,
-	RegisterType::H,
-	RegisterType::L,
-	RegisterType::HL,
-	RegisterType::A
-	};
-
-	const RegisterType reg = rt_lookup[fetched_data & 0b111];
-	InstrType CB_Type;
-	if (CB_opcode < 8)
-	{
-		CB_Type = (InstrType)((u16)InstrType::RLC + CB_opcode);
-	}
-	else
-	{
-		CB_Type = (InstrType)((u16)InstrType::BIT + (CB_opcode >> 3) - 1);
-	}
-
-	const u16 regValue = registers.Read(reg);
-	const u8 currentValue = reg == RegisterType::HL ? EMU::GetBUS()->ReadByte(regValue) : regValue;
-	u8 newValue = 0;
-	switch (CB_Type)
-	{
-	case InstrType::RLC:
-	{
-		const u8 shiftedBit = (currentValue & 0x80) > 0;
-		newValue = (currentValue << 1) | shiftedBit;
-
-		registers.SetFlags(newValue == 0, 0, 0, shiftedBit);
-		break;
-	}
-	case InstrType::RRC:
-	{
-		const u8 shiftedBit = (currentValue & 0x1);
-		newValue = (currentValue >> 1) | (shiftedBit << 7);
-
-		registers.SetFlags(newValue == 0, 0, 0, shiftedBit);
-		break;
-	}
-	case InstrType::RL:
-	{
-		const u8 carryFlag = registers.GetCarryFlag();
-		const u8 shiftedBit = (currentValue & 0x80) > 0;
-		newValue = (currentValue << 1) | carryFlag;
-
-		registers.SetFlags(newValue == 0, 0, 0, shiftedBit);
-		break;
-	}
-	case InstrType::RR:
-	{
-		const u8 carryFlag = registers.GetCarryFlag();
-		const u8 shiftedBit = (currentValue & 0x1);
-		newValue = (currentValue >> 1) | (carryFlag << 7);
-
-		registers.SetFlags(newValue == 0, 0, 0, shiftedBit);
-		break;
-	}
-	case InstrType::SLA:
-	{
-		const u8 shiftedBit = (currentValue & 0x80) > 0;
-		newValue = (currentValue << 1);
-
-		registers.SetFlags(newValue == 0, 0, 0, shiftedBit);
-		break;
-	}
-	case InstrType::SRA:
-	{
-		const u8 MSB = (currentValue & 0x80);
-		const u8 shiftedBit = (currentValue & 0x1);
-		newValue = (currentValue >> 1) | MSB;
-
-		registers.SetFlags(newValue == 0, 0, 0, shiftedBit);
-		break;
-	}
-	case InstrType::SWAP:
-	{
-		newValue = ((currentValue & 0x0F) << 4) | ((currentValue & 0xF0) >> 4);
-
-		registers.SetFlags(newValue == 0, 0, 0, 0);
-		break;
-	}
-	case InstrType::SRL:
-	{
-		const u8 shiftedBit = (currentValue & 0x1);
-		newValue = (currentValue >> 1);
-
-		registers.SetFlags(newValue == 0, 0, 0, shiftedBit);
-		break;
-	}
-	case InstrType::RES:
-	{
-		newValue = currentValue & ~(1 << bitIndex);
-		break;
-	}
-	case InstrType::SET:
-	{
-		newValue = currentValue | (1 << bitIndex);
-		break;
-	}
-	case InstrType::BIT:
-	{
-		const u8 bitValue = currentValue & (1 << bitIndex);
-		registers.SetFlags(bitValue == 0, 0, 1, -1);
-		return;
-	}
-	default:
-	{
-		NO_IMPL("Invalid CB opcode!");
-		break;
-	}
-	}
-
-	if (reg == RegisterType::HL)
-	{
-		EMU::GetBUS()->WriteByte(regValue, newValue);
-		EMU::Cycle(1);
-	}
-	else
-	{
-		registers.Write(reg, newValue);
-	}
-}
-
 void CPU::Instruction_AND_OR_XOR()
 {
 	EMU::Cycle(1);
 
-	const u8 reg_a_value = registers.Read(RegisterType::A);
-
-	u8 result = reg_a_value;
 	switch (instruction->type)
 	{
 	case InstrType::AND:
 	{
-		result &= (fetched_data & 0xFF);
+		AluAnd(registers, fetched_data & 0xFF);
 		break;
 	}
 	case InstrType::OR:
 	{
-		result |= (fetched_data & 0xFF);
+		AluOr(registers, fetched_data & 0xFF);
 		break;
 	}
 	case InstrType::XOR:
 	{
-		result ^= (fetched_data & 0xFF);
+		AluXor(registers, fetched_data & 0xFF);
 		break;
 	}
 	default:
@@ -568,24 +415,13 @@ void CPU::Instruction_AND_OR_XOR()
 		break;
 	}
 	}
-
-	registers.Write(RegisterType::A, result);
-	registers.SetFlags(result == 0, 0, instruction->type == InstrType::AND, 0);
 }
 
 void CPU::Instruction_CP()
 {
 	EMU::Cycle(1);
 
-	const u8 reg_a_value = registers.Read(RegisterType::A);
-
-	const i16 result = (i16)reg_a_value - (i16)fetched_data;
-	const i16 hResult = (i16)(reg_a_value & 0x0F) - (i16)(fetched_data & 0x0F);
-
-	const u8 hFlag = hResult < 0;
-	const u8 cFlag = result < 0;
-
-	registers.SetFlags(result == 0, 1, hFlag, cFlag);
+	AluCompare(registers, fetched_data & 0xFF);
 }
 
 void CPU::Instruction_PUSH_POP()
@@ -629,7 +465,7 @@ void CPU::Instruction_RLA_RRA()
 {
 	EMU::Cycle(1);
 
-	const u8 reg_a = registers.Read(RegisterType::A);
+	const u8 reg_a = registers.Get<RegisterType::A>();
 	const u8 cFlag = registers.GetCarryFlag();
 
 	u8 newReg_a;
@@ -645,7 +481,7 @@ void CPU::Instruction_RLA_RRA()
 		newReg_a = (reg_a >> 1) | (cFlag << 7);
 	}
 
-	registers.Write(RegisterType::A, newReg_a);
+	registers.Set<RegisterType::A>(newReg_a);
 	registers.SetFlags(0, 0, 0, newCFlag);
 }
 
@@ -653,8 +489,8 @@ void CPU::Instruction_CPL()
 {
 	EMU::Cycle(1);
 
-	const u8 reg_a = registers.Read(RegisterType::A);
-	registers.Write(RegisterType::A, ~reg_a);
+	const u8 reg_a = registers.Get<RegisterType::A>();
+	registers.Set<RegisterType::A>(~reg_a);
 	registers.SetFlags(-1, 1, 1, -1);
 }
 
@@ -662,7 +498,7 @@ void CPU::Instruction_DAA()
 {
 	EMU::Cycle(1);
 
-	const u8 reg_a = registers.Read(RegisterType::A);
+	const u8 reg_a = registers.Get<RegisterType::A>();
 	const u8 subFlag = registers.GetSubtractionFlag();
 	const u8 hFlag = registers.GetHalfCarryFlag();
 	u8 cFlag = 0;
@@ -682,7 +518,7 @@ void CPU::Instruction_DAA()
 
 	const u8 result = (reg_a + (subFlag ? -correction : correction)) & 0xFF;
 
-	registers.Write(RegisterType::A, result);
+	registers.Set<RegisterType::A>(result);
 	registers.SetFlags(result == 0, -1, 0, cFlag);
 }
 
@@ -11,9 +11,50 @@
 #include "ram.h"
 #include "io.h"
 #include "ppu.h"
+#include "apu.h"
+#include "joypad.h"
+#include "movie.h"
+#include "wav_writer.h"
+#include "save_state.h"
+#include "rewind.h"
+#include "jit.h"
+#include "trace.h"
+#include "reference_log.h"
+#include "profiler.h"
+
+#include <fstream>
+#include <algorithm>
+#include <charconv>
+#include <cstring>
 
 using namespace GB;
 
+namespace
+{
+	// What --wav-rate accepts, outside of it is clamped
+	constexpr u32 MIN_WAV_RATE = 8000;
+	constexpr u32 MAX_WAV_RATE = 192000;
+
+	// Largest --rewind-mb whose byte count still fits the u32 ring size
+	constexpr u32 MAX_REWIND_BUDGET_MB = 4095;
+
+	// Whole string as a decimal number, false on anything else
+	bool ParseNumber(const std::string& text, u32& value)
+	{
+		const char* end = text.data() + text.size();
+		u32 parsed = 0;
+		const auto [ptr, error] = std::from_chars(text.data(), end, parsed);
+
+		if (error != std::errc() || ptr != end)
+		{
+			return false;
+		}
+
+		value = parsed;
+		return true;
+	}
+}
+
 /*
   Emu components:
 
@@ -21,6 +62,7 @@ using namespace GB;
   |CPU|
   |Address Bus|
   |PPU|
+  |APU|
   |Timer|
 
 */
@@ -33,23 +75,30 @@ EMU::EMU()
 	timer = std::make_unique<Timer>();
 	lcd = std::make_unique<LCD>();
 	ram = std::make_unique<RAM>();
-	window = std::make_unique<Window>();
 	cartridge = std::make_unique<Cartridge>();
 	ppu = std::make_unique<PPU>();
+	apu = std::make_unique<APU>();
+	joypad = std::make_unique<Joypad>();
 }
 
+EMU::~EMU() = default;
+
 int EMU::Run(int argc, char** argv)
 {
 	if (argc < 3)
 	{
-		printf("Usage: <rom_folder> <rom_file>\n");
+		printf("Usage: <rom_folder> <rom_file> [--pacing=sleep|audio] [--headless] [--frames=N] [--wav=<file>] [--wav-rate=HZ] [--rewind=SECONDS] [--rewind-interval=K] [--rewind-mb=MB] [--runahead=N] [--record=<movie>] [--play=<movie>] [--idle-loops=on|off] [--idle-list=<file>] [--block-cache=on|off] [--jit=on|off|lockstep] [--jit-threshold=N] [--aot=<module>] [--call-stack=on|off] [--trace=<file>] [--compare=<log>] [--profile=<prefix>]\n");
 		return -1;
 	}
 
-	std::string romPath = argv[1];
+	ParseOptions(argc, argv);
+
+	startTime = std::chrono::steady_clock::now();
+
+	romPath = argv[1];
 	romPath += argv[2];
 
-	if (!cartridge->Load(romPath))
+	if (!LoadROM(romPath))
 	{
 		printf("Failed to load ROM file: %s\n", argv[1]);
 		return -2;
@@ -57,16 +106,160 @@ int EMU::Run(int argc, char** argv)
 
 	printf("Cart loaded..\n");
 
+	cpu->GetBlockCache().SetEnabled(bBlockCache);
+	cpu->GetCallStack().SetEnabled(bCallStack);
+
+	if (!aotPath.empty())
+	{
+		// Unusable modules are reported, the ROM then just runs interpreted
+		cpu->SetAotCode(AotCode::Load(aotPath));
+	}
+
+	if (bJit && !bBlockCache)
+	{
+		// Compiled code is generated from the cache's blocks
+		printf("JIT: needs the block cache, staying interpreted\n");
+	}
+	else if (bJit)
+	{
+		Jit& jit = cpu->GetJit();
+
+		if (jitThreshold != 0)
+		{
+			jit.SetHotThreshold(jitThreshold);
+		}
+
+		jit.SetLockstep(bJitLockstep);
+
+		if (jit.SetEnabled(true))
+		{
+			printf("JIT: on%s\n", bJitLockstep ? ", verifying in lockstep" : "");
+		}
+	}
+
+	IdleLoopDetector& idleLoop = cpu->GetIdleLoopDetector();
+	idleLoop.SetEnabled(bIdleLoops);
+
+	if (bIdleLoops && !idleLoopListPath.empty())
+	{
+		idleLoop.LoadConfig(idleLoopListPath, cartridge->GetROMChecksum());
+	}
+
+	if (!wavPath.empty())
+	{
+		wavWriter = std::make_unique<WavWriter>();
+
+		if (wavWriter->Open(wavPath, AUDIO_SAMPLE_RATE, wavRate))
+		{
+			apu->SetCaptureWriter(wavWriter.get());
+		}
+	}
+
+	if (bHeadless)
+	{
+		pacingMode = PacingMode::NONE;
+	}
+	else
+	{
+		window = std::make_unique<Window>();
+
+		const bool audioOpened = window->OpenAudio(apu->GetOutputBuffer());
+
+		if (pacingMode == PacingMode::AUDIO_CLOCK && !audioOpened)
+		{
+			printf("No audio device, falling back to sleep pacing\n");
+			pacingMode = PacingMode::SLEEP;
+		}
+	}
+
+	apu->SetDynamicRateControl(pacingMode == PacingMode::AUDIO_CLOCK);
+
+	if (rewindSeconds != 0)
+	{
+		// The ring is indexed with u32, keep the budget below 4 GB
+		const u32 budgetMB = std::clamp<u32>(rewindBudgetMB, 1, MAX_REWIND_BUDGET_MB);
+		if (budgetMB != rewindBudgetMB)
+		{
+			printf("Rewind: %u MB out of range, using %u MB\n", rewindBudgetMB, budgetMB);
+			rewindBudgetMB = budgetMB;
+		}
+
+		const u64 maxSnapshots = std::min<u64>((u64)rewindSeconds * 60 / rewindInterval, UINT32_MAX);
+
+		rewind = std::make_unique<RewindBuffer>();
+		rewind->Init((u32)((u64)rewindBudgetMB * 1024 * 1024), (u32)maxSnapshots);
+		printf("Rewind: %us, snapshot every %u frames, %u MB\n", rewindSeconds, rewindInterval, rewindBudgetMB);
+	}
+
+	if (!movieRecordPath.empty() || !moviePlayPath.empty())
+	{
+		movie = std::make_unique<Movie>();
+
+		const bool movieStarted = moviePlayPath.empty()
+			? movie->StartRecording(movieRecordPath, cartridge->GetROMChecksum())
+			: movie->StartPlayback(moviePlayPath, cartridge->GetROMChecksum());
+
+		if (!movieStarted)
+		{
+			return -3;
+		}
+	}
+
+	// Movies need input to only change on frame boundaries
+	if (!movie && !bHeadless)
+	{
+		joypad->SetLiveInput(&hostButtons);
+	}
+
+	// Input for the first frame
+	LatchInput();
+
+	if (!tracePath.empty())
+	{
+		StartTrace();
+	}
+
+	if (!comparePath.empty())
+	{
+#ifdef GB_TRACE
+		referenceLog = std::make_unique<ReferenceLog>();
+
+		if (!referenceLog->Open(comparePath))
+		{
+			return -4;
+		}
+
+		// Skipped loop iterations never reach the per-instruction check
+		cpu->GetIdleLoopDetector().SetEnabled(false);
+		cpu->SetReferenceLog(referenceLog.get());
+		printf("Compare: checking every instruction against %s\n", comparePath.c_str());
+#else
+		printf("Compare: not available, build with GB_TRACE\n");
+		return -4;
+#endif
+	}
+
+	if (!profilePath.empty())
+	{
+		StartProfiler();
+	}
+
+	if (runAheadFrames != 0)
+	{
+		presentedFrame.assign(XRES * YRES, 0);
+		printf("Run-ahead: %u frames\n", runAheadFrames);
+	}
+
 	bIsRunning = true;
 
 	std::thread cpuThread(&EMU::ExecuteCPU, this);
 
 	u32 previousFrame = 0;
 
-	while (bIsRunning)
+	while (bIsRunning && !bHeadless)
 	{
-		window->Delay(1000);
-		window->HandleEvents();
+		// Returns as soon as input arrives, the timeout only bounds how late a new frame is shown
+		window->HandleEvents(target_frame_time / 4);
 
 		if (previousFrame != EMU::GetPPU()->GetCurrentFrame())
 		{
@@ -77,21 +270,251 @@ int EMU::Run(int argc, char** argv)
 	}
 	cpuThread.join();
 
+	if (wavWriter)
+	{
+		apu->SetCaptureWriter(nullptr);
+		wavWriter->Close();
+	}
+
+	if (movie)
+	{
+		movie->Stop();
+	}
+
+	StopTrace();
+	StopProfiler();
+
+	if (referenceLog)
+	{
+		printf("Compare: %llu instructions matched the reference log\n", (unsigned long long)referenceLog->GetMatchedCount());
+	}
+
 	return 0;
 }
 
+bool EMU::LoadROM(const std::filesystem::path& filePath)
+{
+	if (!cartridge->Load(filePath))
+	{
+		return false;
+	}
+
+	auto state = std::make_shared<std::vector<u8>>();
+	powerOnStateSize = SaveState(*state);
+	powerOnState = std::move(state);
+
+	return true;
+}
+
+bool EMU::Reset()
+{
+	if (!powerOnState)
+	{
+		printf("No ROM loaded, nothing to reset to\n");
+		return false;
+	}
+
+	if (!LoadState(powerOnState->data(), powerOnStateSize))
+	{
+		return false;
+	}
+
+	// Input for the first frame, as on startup
+	LatchInput();
+
+	if (rewind)
+	{
+		rewind->Clear();
+	}
+
+	DebugBuffer = {};
+	DebugBufferMsgSize = 0;
+	msgUpdated = false;
+
+	return true;
+}
+
 void EMU::Delay(u32 MS)
 {
-	window->Delay(MS);
+	if (window)
+	{
+		window->Delay(MS);
+		return;
+	}
+
+	std::this_thread::sleep_for(std::chrono::milliseconds(MS));
+}
+
+u32 EMU::GetTicks() const
+{
+	if (window)
+	{
+		return window->GetTicks();
+	}
+
+	const auto elapsed = std::chrono::steady_clock::now() - startTime;
+	return (u32)std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count();
+}
+
+void EMU::ParseOptions(int argc, char** argv)
+{
+	for (int i = 3; i < argc; i++)
+	{
+		const std::string option = argv[i];
+
+		// Value after the '=' of a numeric option, reported and left alone if malformed
+		auto parseValue = [&option](u32& value)
+		{
+			if (!ParseNumber(option.substr(option.find('=') + 1), value))
+			{
+				printf("Invalid option value: %s\n", option.c_str());
+				return false;
+			}
+			return true;
+		};
+
+		if (option == "--pacing=audio")
+		{
+			pacingMode = PacingMode::AUDIO_CLOCK;
+		}
+		else if (option == "--pacing=sleep")
+		{
+			pacingMode = PacingMode::SLEEP;
+		}
+		else if (option == "--headless")
+		{
+			bHeadless = true;
+		}
+		else if (option.starts_with("--frames="))
+		{
+			parseValue(maxFrames);
+		}
+		else if (option.starts_with("--wav="))
+		{
+			wavPath = option.substr(6);
+		}
+		else if (option.starts_with("--wav-rate="))
+		{
+			u32 rate = 0;
+			if (parseValue(rate))
+			{
+				if (rate == 0)
+				{
+					printf("Invalid option value: %s\n", option.c_str());
+				}
+				else
+				{
+					wavRate = std::clamp(rate, MIN_WAV_RATE, MAX_WAV_RATE);
+
+					if (wavRate != rate)
+					{
+						printf("WAV sample rate %u Hz out of range, using %u Hz\n", rate, wavRate);
+					}
+				}
+			}
+		}
+		else if (option.starts_with("--rewind="))
+		{
+			parseValue(rewindSeconds);
+		}
+		else if (option.starts_with("--rewind-interval="))
+		{
+			if (parseValue(rewindInterval))
+			{
+				rewindInterval = std::max<u32>(1, rewindInterval);
+			}
+		}
+		else if (option.starts_with("--rewind-mb="))
+		{
+			parseValue(rewindBudgetMB);
+		}
+		else if (option.starts_with("--runahead="))
+		{
+			parseValue(runAheadFrames);
+		}
+		else if (option == "--idle-loops=on" || option == "--idle-loops=off")
+		{
+			bIdleLoops = option == "--idle-loops=on";
+		}
+		else if (option == "--block-cache=on" || option == "--block-cache=off")
+		{
+			bBlockCache = option == "--block-cache=on";
+		}
+		else if (option == "--jit=on" || option == "--jit=off" || option == "--jit=lockstep")
+		{
+			bJit = option != "--jit=off";
+			bJitLockstep = option == "--jit=lockstep";
+		}
+		else if (option.starts_with("--jit-threshold="))
+		{
+			if (parseValue(jitThreshold))
+			{
+				jitThreshold = std::max<u32>(1, jitThreshold);
+			}
+		}
+		else if (option.starts_with("--aot="))
+		{
+			aotPath = option.substr(6);
+		}
+		else if (option == "--call-stack=on" || option == "--call-stack=off")
+		{
+			bCallStack = option == "--call-stack=on";
+		}
+		else if (option.starts_with("--trace="))
+		{
+			tracePath = option.substr(8);
+		}
+		else if (option.starts_with("--compare="))
+		{
+			comparePath = option.substr(10);
+		}
+		else if (option.starts_with("--profile="))
+		{
+			profilePath = option.substr(10);
+		}
+		else if (option.starts_with("--idle-list="))
+		{
+			idleLoopListPath = option.substr(12);
+		}
+		else if (option.starts_with("--record="))
+		{
+			movieRecordPath = option.substr(9);
+		}
+		else if (option.starts_with("--play="))
+		{
+			moviePlayPath = option.substr(7);
+		}
+		else
+		{
+			printf("Unknown option: %s\n", option.c_str());
+		}
+	}
+}
+
+namespace
+{
+	thread_local EMU* threadEMU = nullptr;
 }
 
 EMU* EMU::GetEMU()
 {
+	if (threadEMU)
+	{
+		return threadEMU;
+	}
+
 	static std::unique_ptr<EMU> emu(new EMU);
 
 	return emu.get();
 }
 
+EMU* EMU::SetThreadEMU(EMU* emu)
+{
+	EMU* previous = threadEMU;
+	threadEMU = emu;
+	return previous;
+}
+
 void EMU::Cycle(u8 amount)
 {
 	if (amount == 0)
@@ -112,29 +535,94 @@ void EMU::Cycle(u8 amount)
 	}
 }
 
+u32 EMU::GetIdleMCycles()
+{
+	EMU* emu = GetEMU();
+
+	if (emu->bus->DMA_TransferActive())
+	{
+		return 0;
+	}
+
+	const u32 ticks = std::min(emu->ppu->GetTicksToNextEvent(), emu->timer->GetTicksToInterrupt());
+	return (ticks - 1) / 4;
+}
+
+void EMU::Advance(u32 amount)
+{
+	EMU* emu = GetEMU();
+	const u32 ticks = amount * 4;
+
+	emu->cycles += ticks;
+	emu->timer->Advance(ticks);
+	emu->ppu->Advance(ticks);
+}
+
 u32 EMU::GetCycles() const
 {
 	return cycles;
 }
 
+PacingMode EMU::GetPacingMode() const
+{
+	return pacingMode;
+}
+
 void EMU::Shutdown()
 {
-	bIsRunning = false;
+	{
+		std::lock_guard<std::mutex> lock(commandMutex);
+		bIsRunning = false;
+	}
+
+	commandSignal.notify_all();
+
+	// The CPU thread may be waiting for the audio device to drain
+	apu->GetOutputBuffer().Stop();
 }
 
 void* EMU::ExecuteCPU()
 {
 	while (bIsRunning)
 	{
-		if (bPaused)
+		// Plain load first, this runs before every instruction
+		if (bCommandsPending.load(std::memory_order_relaxed))
+		{
+			ProcessCommands();
+		}
+
+		if (bPaused && stepInstructionsLeft == 0 && !bStepFrame)
 		{
-			Delay(10);
+			std::unique_lock<std::mutex> lock(commandMutex);
+			commandSignal.wait(lock, [this] { return bCommandsPending || !bIsRunning; });
 			continue;
 		}
 
-		if (!cpu->Step())
+		// Stepping goes one instruction at a time, not one compiled block
+		const bool bSingleInstruction = stepInstructionsLeft != 0;
+
+		if (bSingleInstruction)
+		{
+			stepInstructionsLeft--;
+		}
+
+		if (!cpu->Step(bSingleInstruction))
 		{
 			printf("CPU Stopped\n");
+			bIsRunning = false;
+			return nullptr;
+		}
+
+		if (ppu->GetCurrentFrame() != lastFrame)
+		{
+			OnFrameBoundary();
+			bStepFrame = false;
+		}
+
+		if (maxFrames != 0 && ppu->GetCurrentFrame() >= maxFrames)
+		{
+			printf("Reached %u frames\n", maxFrames);
+			bIsRunning = false;
 			return nullptr;
 		}
 
@@ -146,6 +634,585 @@ void* EMU::ExecuteCPU()
 	return nullptr;
 }
 
+u32 EMU::SaveState(std::vector<u8>& blob) const
+{
+	StateWriter writer(blob, cartridge->GetROMChecksum());
+
+	writer.BeginSection(StateSection::EMU);
+	writer.Write(cycles);
+	writer.Write(inputFrame);
+	writer.EndSection();
+
+	cpu->SaveState(writer);
+	bus->SaveState(writer);
+	io->SaveState(writer);
+	timer->SaveState(writer);
+	ram->SaveState(writer);
+	lcd->SaveState(writer);
+	ppu->SaveState(writer);
+	apu->SaveState(writer);
+	cartridge->SaveState(writer);
+	joypad->SaveState(writer);
+
+	return writer.Finish();
+}
+
+bool EMU::LoadState(const u8* data, u32 size)
+{
+	if (!RestoreState(data, size))
+	{
+		return false;
+	}
+
+	// Restored frame counter, re-arm so the loaded frame does not look like a new
+	// boundary and the rewind interval starts over
+	lastFrame = ppu->GetCurrentFrame();
+	framesSinceSnapshot = 0;
+
+	// The calls made on the way to the loaded state are unknown
+	cpu->GetCallStack().Clear();
+
+	return true;
+}
+
+bool EMU::RestoreState(const u8* data, u32 size)
+{
+	StateReader reader(data, size);
+
+	if (!reader.IsValid(cartridge->GetROMChecksum()))
+	{
+		printf("Save state is invalid or belongs to another ROM\n");
+		return false;
+	}
+
+	// Stays invalid for states saved before the input frame was stored
+	constexpr u32 UNKNOWN_INPUT_FRAME = ~0u;
+	u32 savedInputFrame = UNKNOWN_INPUT_FRAME;
+
+	if (reader.BeginSection(StateSection::EMU))
+	{
+		reader.Read(cycles);
+		reader.Read(savedInputFrame);
+	}
+
+	cpu->LoadState(reader);
+	bus->LoadState(reader);
+	io->LoadState(reader);
+	timer->LoadState(reader);
+	ram->LoadState(reader);
+	lcd->LoadState(reader);
+	ppu->LoadState(reader);
+	apu->LoadState(reader);
+	cartridge->LoadState(reader);
+	joypad->LoadState(reader);
+
+	if (savedInputFrame != UNKNOWN_INPUT_FRAME)
+	{
+		inputFrame = savedInputFrame;
+	}
+
+	// Keep the movie on the frame the machine is now at. Run-ahead and lockstep
+	// rollbacks land on the frame they started from and skip this.
+	if (movie && (movie->IsRecording() || movie->IsPlaying()) && movie->GetFrame() != inputFrame)
+	{
+		if (savedInputFrame == UNKNOWN_INPUT_FRAME || !movie->Seek(inputFrame))
+		{
+			printf("Loaded state is not part of the movie, stopping it\n");
+			movie->Stop();
+		}
+	}
+
+	return true;
+}
+
+bool EMU::SaveStateToFile(const std::filesystem::path& filePath)
+{
+	const u32 size = SaveState(stateBuffer);
+
+	std::ofstream fileStream(filePath, std::ios::binary | std::ios::trunc);
+	if (!fileStream.good())
+	{
+		printf("Failed to write save state: %s\n", filePath.string().c_str());
+		return false;
+	}
+
+	fileStream.write((const char*)stateBuffer.data(), size);
+	printf("Saved state: %s (%u bytes)\n", filePath.string().c_str(), size);
+	return true;
+}
+
+bool EMU::LoadStateFromFile(const std::filesystem::path& filePath)
+{
+	std::ifstream fileStream(filePath, std::ios::binary | std::ios::ate);
+	if (!fileStream.good())
+	{
+		printf("Failed to open save state: %s\n", filePath.string().c_str());
+		return false;
+	}
+
+	const u32 size = (u32)fileStream.tellg();
+	stateBuffer.resize(size);
+
+	fileStream.seekg(std::ios::beg);
+	fileStream.read((char*)stateBuffer.data(), size);
+
+	if (!LoadState(stateBuffer.data(), size))
+	{
+		return false;
+	}
+
+	printf("Loaded state: %s\n", filePath.string().c_str());
+	return true;
+}
+
+void EMU::PostCommand(EmuCommand command)
+{
+	{
+		std::lock_guard<std::mutex> lock(commandMutex);
+		commands.push_back(std::move(command));
+		bCommandsPending = true;
+	}
+
+	commandSignal.notify_all();
+}
+
+void EMU::RequestQuickSave()
+{
+	PostCommand({ EmuCommandType::SAVE_STATE, 0, romPath + ".state" });
+}
+
+void EMU::RequestQuickLoad()
+{
+	PostCommand({ EmuCommandType::LOAD_STATE, 0, romPath + ".state" });
+}
+
+bool EMU::IsPaused() const
+{
+	return bPaused;
+}
+
+void EMU::ProcessCommands()
+{
+	{
+		std::lock_guard<std::mutex> lock(commandMutex);
+		processedCommands.swap(commands);
+		bCommandsPending = false;
+	}
+
+	for (const EmuCommand& command : processedCommands)
+	{
+		switch (command.type)
+		{
+		case EmuCommandType::PAUSE:
+			bPaused = true;
+			stepInstructionsLeft = 0;
+			bStepFrame = false;
+
+			if (cpu->GetCallStack().IsEnabled())
+			{
+				cpu->GetCallStack().Print();
+			}
+			break;
+		case EmuCommandType::RESUME:
+			bPaused = false;
+			break;
+		case EmuCommandType::STEP_INSTRUCTIONS:
+			bPaused = true;
+			stepInstructionsLeft += command.count;
+			break;
+		case EmuCommandType::STEP_FRAME:
+			bPaused = true;
+			bStepFrame = true;
+			break;
+		case EmuCommandType::RESET:
+			Reset();
+			break;
+		case EmuCommandType::SAVE_STATE:
+			SaveStateToFile(command.path);
+			break;
+		case EmuCommandType::LOAD_STATE:
+			LoadStateFromFile(command.path);
+			break;
+		case EmuCommandType::TOGGLE_JIT:
+		{
+			Jit& jit = cpu->GetJit();
+
+			if (!bBlockCache)
+			{
+				printf("JIT: needs the block cache\n");
+			}
+			else if (jit.SetEnabled(!jit.IsEnabled()))
+			{
+				printf("JIT: %s\n", jit.IsEnabled() ? "on" : "off");
+			}
+			break;
+		}
+		case EmuCommandType::TOGGLE_TRACE:
+		{
+			if (trace)
+			{
+				StopTrace();
+			}
+			else
+			{
+				StartTrace();
+			}
+			break;
+		}
+		case EmuCommandType::TOGGLE_PROFILER:
+		{
+			if (profiler)
+			{
+				StopProfiler();
+			}
+			else
+			{
+				StartProfiler();
+			}
+			break;
+		}
+		}
+	}
+
+	processedCommands.clear();
+}
+
+void EMU::SetRewinding(bool bEnabled)
+{
+	bRewinding = bEnabled;
+}
+
+void EMU::OnFrameBoundary()
+{
+	lastFrame = ppu->GetCurrentFrame();
+
+	LatchInput();
+
+	if (rewind)
+	{
+		UpdateRewind();
+	}
+
+	if (runAheadFrames != 0)
+	{
+		RunAhead();
+	}
+}
+
+void EMU::SetHostButtons(u8 buttons)
+{
+	hostButtons = buttons;
+}
+
+void EMU::LatchInput()
+{
+	u8 buttons = hostButtons.load(std::memory_order_relaxed);
+	inputFrame++;
+
+	if (movie)
+	{
+		buttons = movie->NextFrame(buttons);
+	}
+
+	joypad->SetButtons(buttons);
+}
+
+void EMU::UpdateRewind()
+{
+	if (bRewinding.load(std::memory_order_relaxed))
+	{
+		u32 size = 0;
+		if (rewind->Pop(rewindState, size))
+		{
+			LoadState(rewindState.data(), size);
+		}
+
+		return;
+	}
+
+	if (++framesSinceSnapshot < rewindInterval)
+	{
+		return;
+	}
+
+	framesSinceSnapshot = 0;
+
+	const u32 size = SaveState(rewindState);
+	rewind->Push(rewindState.data(), size);
+}
+
+std::unique_ptr<EMU> EMU::Fork() const
+{
+	std::unique_ptr<EMU> fork(new EMU);
+
+	fork->cycles = cycles;
+
+	*fork->cpu = *cpu;
+	fork->cpu->SetTrace(nullptr);
+	fork->cpu->SetReferenceLog(nullptr);
+	fork->cpu->SetProfiler(nullptr);
+	*fork->bus = *bus;
+	*fork->io = *io;
+	*fork->timer = *timer;
+	*fork->lcd = *lcd;
+	*fork->ppu = *ppu;
+	*fork->ram = *ram;
+	*fork->cartridge = *cartridge;
+	*fork->joypad = *joypad;
+	fork->joypad->SetLiveInput(nullptr);
+	// Held buttons carry over until the fork's driver sets its own
+	fork->hostButtons = joypad->GetButtons();
+
+	// The APU owns the host audio ring and is not copyable, go through its save state section
+	StateWriter writer(fork->stateBuffer, cartridge->GetROMChecksum());
+	apu->SaveState(writer);
+	const u32 size = writer.Finish();
+
+	StateReader reader(fork->stateBuffer.data(), size);
+	fork->apu->LoadState(reader);
+
+	fork->romPath = romPath;
+	fork->powerOnState = powerOnState;
+	fork->powerOnStateSize = powerOnStateSize;
+	fork->pacingMode = PacingMode::NONE;
+	fork->bHeadless = true;
+	fork->bIsFork = true;
+	fork->startTime = startTime;
+	fork->lastFrame = lastFrame;
+
+	return fork;
+}
+
+bool EMU::RunFrames(u32 frameCount)
+{
+	for (u32 i = 0; i < frameCount; i++)
+	{
+		// Forks have no frame loop, latch here so SetHostButtons applies per frame
+		LatchInput();
+
+		const u32 targetFrame = ppu->GetCurrentFrame() + 1;
+		while (ppu->GetCurrentFrame() != targetFrame)
+		{
+			if (!cpu->Step())
+			{
+				return false;
+			}
+		}
+
+		lastFrame = targetFrame;
+	}
+
+	return true;
+}
+
+bool EMU::IsSpeculating() const
+{
+	return bSpeculating || bIsFork;
+}
+
+const u32* EMU::GetPresentedFrame() const
+{
+	if (runAheadFrames != 0)
+	{
+		return presentedFrame.data();
+	}
+
+	return ppu->GetVideoBuffer().data();
+}
+
+void EMU::RunAhead()
+{
+	const auto start = std::chrono::steady_clock::now();
+
+	const u32 size = SaveState(runAheadState);
+
+	// Not part of the save state, the rollback restores it by hand
+	const ShadowCallStack callStack = cpu->GetCallStack();
+
+	// Serial debug output is not machine state, keep it out of the speculation
+	const auto debugBuffer = DebugBuffer;
+	const u32 debugBufferMsgSize = DebugBufferMsgSize;
+	const bool debugMsgUpdated = msgUpdated;
+
+	bSpeculating = true;
+	apu->BeginSpeculation();
+
+	const u32 targetFrame = lastFrame + runAheadFrames;
+	while (ppu->GetCurrentFrame() != targetFrame && cpu->Step())
+	{
+	}
+
+	const auto& videoBuffer = ppu->GetVideoBuffer();
+	std::copy(videoBuffer.begin(), videoBuffer.end(), presentedFrame.begin());
+
+	apu->EndSpeculation();
+	bSpeculating = false;
+
+	DebugBuffer = debugBuffer;
+	DebugBufferMsgSize = debugBufferMsgSize;
+	msgUpdated = debugMsgUpdated;
+
+	RestoreState(runAheadState.data(), size);
+	cpu->GetCallStack() = callStack;
+
+	const auto elapsed = std::chrono::steady_clock::now() - start;
+	runAheadMicros += std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
+	runAheadCount++;
+}
+
+bool EMU::StartTrace()
+{
+#ifdef GB_TRACE
+	const std::filesystem::path path = tracePath.empty() ? romPath + ".trace" : tracePath;
+
+	trace = std::make_unique<ExecutionTrace>();
+
+	if (!trace->Start(path, cartridge->GetROMChecksum()))
+	{
+		trace.reset();
+		return false;
+	}
+
+	cpu->SetTrace(trace.get());
+	printf("Trace: writing to %s\n", path.string().c_str());
+
+	return true;
+#else
+	printf("Trace: not available, build with GB_TRACE\n");
+	return false;
+#endif
+}
+
+void EMU::StopTrace()
+{
+	if (!trace)
+	{
+		return;
+	}
+
+	cpu->SetTrace(nullptr);
+	trace->Stop();
+
+	printf("Trace: %llu instructions written\n", (unsigned long long)trace->GetRecordCount());
+	trace.reset();
+}
+
+void EMU::StartProfiler()
+{
+	// Functions come from the call stack, keep its frames if it already runs
+	ShadowCallStack& callStack = cpu->GetCallStack();
+	if (!callStack.IsEnabled())
+	{
+		callStack.SetEnabled(true);
+	}
+
+	profiler = std::make_unique<Profiler>();
+	cpu->SetProfiler(profiler.get());
+
+	printf("Profiler: on\n");
+}
+
+void EMU::StopProfiler()
+{
+	if (!profiler)
+	{
+		return;
+	}
+
+	cpu->SetProfiler(nullptr);
+	profiler->Finish(cycles);
+
+	const std::string prefix = profilePath.empty() ? romPath + ".profile" : profilePath;
+
+	if (profiler->WriteReport(prefix + ".txt") && profiler->WriteFoldedStacks(prefix + ".folded"))
+	{
+		printf("Profiler: %llu instructions, report in %s.txt, flame graph stacks in %s.folded\n",
+			   (unsigned long long)profiler->GetInstructionCount(), prefix.c_str(), prefix.c_str());
+	}
+
+	profiler.reset();
+}
+
+u32 EMU::RunJitLockstep()
+{
+	Jit& jit = cpu->GetJit();
+	const u16 pc = cpu->GetPC();
+
+	// Already inside a speculation that gets rolled back, nothing to verify against
+	if (IsSpeculating())
+	{
+		return jit.Run(*cpu, pc);
+	}
+
+	const u32 size = SaveState(lockstepState);
+
+	// Not part of the save state, the rollback restores it by hand
+	const ShadowCallStack callStack = cpu->GetCallStack();
+
+	const auto debugBuffer = DebugBuffer;
+	const u32 debugBufferMsgSize = DebugBufferMsgSize;
+	const bool debugMsgUpdated = msgUpdated;
+
+	bSpeculating = true;
+	apu->BeginSpeculation();
+
+	const u32 executed = jit.Run(*cpu, pc);
+	const u32 jitSize = executed != 0 ? SaveState(lockstepJitState) : 0;
+
+	apu->EndSpeculation();
+	bSpeculating = false;
+
+	if (executed == 0)
+	{
+		return 0;
+	}
+
+	DebugBuffer = debugBuffer;
+	DebugBufferMsgSize = debugBufferMsgSize;
+	msgUpdated = debugMsgUpdated;
+
+	RestoreState(lockstepState.data(), size);
+	cpu->GetCallStack() = callStack;
+
+	for (u32 i = 0; i < executed; i++)
+	{
+		cpu->Step(true);
+	}
+
+	const u32 interpreterSize = SaveState(lockstepState);
+
+	if (jitSize != interpreterSize || std::memcmp(lockstepJitState.data(), lockstepState.data(), jitSize) != 0)
+	{
+		u32 offset = 0;
+		while (offset < std::min(jitSize, interpreterSize) && lockstepJitState[offset] == lockstepState[offset])
+		{
+			offset++;
+		}
+
+		printf("JIT: lockstep mismatch in block %04X after %u instructions, state byte %u differs. Switching to the interpreter\n",
+			   pc, executed, offset);
+
+		jit.SetEnabled(false);
+	}
+
+	return executed;
+}
+
+void EMU::PrintRunAheadStats()
+{
+	if (runAheadCount == 0)
+	{
+		return;
+	}
+
+	const double averageMS = runAheadMicros / 1000.0 / runAheadCount;
+	printf("Run-ahead: depth %u, %.2f ms per frame (%.0f%% of frame time)\n",
+		   runAheadFrames, averageMS, averageMS * 100.0 / target_frame_time);
+
+	runAheadMicros = 0;
+	runAheadCount = 0;
+}
+
 void EMU::DebugUpdate()
 {
 	if (bus->ReadByte(0xFF02) == 0x81)
@@ -169,7 +1236,7 @@ void EMU::DebugUpdate()
 
 void EMU::DebugPrint()
 {
-	if (msgUpdated)
+	if (msgUpdated && !IsSpeculating())
 	{
 		printf("DBG: %s", DebugBuffer.data());
 		msgUpdated = false;
@@ -220,3 +1287,13 @@ PPU* EMU::GetPPU()
 {
 	return GetEMU()->ppu.get();
 }
+
+APU* EMU::GetAPU()
+{
+	return GetEMU()->apu.get();
+}
+
+Joypad* EMU::GetJoypad()
+{
+	return GetEMU()->joypad.get();
+}
@@ -0,0 +1,88 @@
+#include "fork_pool.h"
+#include "emu.h"
+
+#include <algorithm>
+
+using namespace GB;
+
+ForkPool::ForkPool(u32 threadCount)
+{
+	if (threadCount == 0)
+	{
+		threadCount = std::max(1u, std::thread::hardware_concurrency());
+	}
+
+	workers.reserve(threadCount);
+
+	for (u32 i = 0; i < threadCount; i++)
+	{
+		workers.emplace_back(&ForkPool::WorkerThread, this);
+	}
+}
+
+ForkPool::~ForkPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(tasksMutex);
+		stopRequested = true;
+	}
+
+	tasksSignal.notify_all();
+
+	for (std::thread& worker : workers)
+	{
+		worker.join();
+	}
+}
+
+void ForkPool::Submit(std::unique_ptr<EMU> machine, Job job)
+{
+	{
+		std::lock_guard<std::mutex> lock(tasksMutex);
+		tasks.push_back({ std::move(machine), std::move(job) });
+	}
+
+	tasksSignal.notify_one();
+}
+
+void ForkPool::Wait()
+{
+	std::unique_lock<std::mutex> lock(tasksMutex);
+	idleSignal.wait(lock, [this] { return tasks.empty() && runningTasks == 0; });
+}
+
+void ForkPool::WorkerThread()
+{
+	while (true)
+	{
+		Task task;
+
+		{
+			std::unique_lock<std::mutex> lock(tasksMutex);
+			tasksSignal.wait(lock, [this] { return stopRequested || !tasks.empty(); });
+
+			if (tasks.empty())
+			{
+				return;
+			}
+
+			task = std::move(tasks.front());
+			tasks.pop_front();
+			runningTasks++;
+		}
+
+		EMU* previous = EMU::SetThreadEMU(task.machine.get());
+		task.job(*task.machine);
+		EMU::SetThreadEMU(previous);
+
+		// Released pages go back to being exclusively owned by the other forks
+		task.machine.reset();
+
+		{
+			std::lock_guard<std::mutex> lock(tasksMutex);
+			runningTasks--;
+		}
+
+		idleSignal.notify_all();
+	}
+}
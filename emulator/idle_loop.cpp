@@ -0,0 +1,203 @@
+#include "idle_loop.h"
+#include "emu.h"
+#include "bus.h"
+
+#include <charconv>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <cstring>
+#include <vector>
+
+using namespace GB;
+
+namespace
+{
+	// Whole token as hex, with or without 0x, no larger than 'maxValue'
+	bool ParseHex(const std::string& text, u32 maxValue, u32& value)
+	{
+		const char* begin = text.data();
+		const char* end = text.data() + text.size();
+
+		if (text.size() > 2 && text[0] == '0' && (text[1] == 'x' || text[1] == 'X'))
+		{
+			begin += 2;
+		}
+
+		u32 parsed = 0;
+		const auto [ptr, error] = std::from_chars(begin, end, parsed, 16);
+
+		if (error != std::errc() || ptr != end || parsed > maxValue)
+		{
+			return false;
+		}
+
+		value = parsed;
+		return true;
+	}
+}
+
+bool IdleLoopDetector::LoadConfig(const std::filesystem::path& filePath, u16 romChecksum)
+{
+	std::ifstream fileStream(filePath);
+	if (!fileStream.good())
+	{
+		printf("Failed to open idle loop list: %s\n", filePath.string().c_str());
+		return false;
+	}
+
+	auto romRules = std::make_shared<RomRules>();
+	bool bHasEntry = false;
+
+	std::string line;
+	u32 lineNumber = 0;
+	while (std::getline(fileStream, line))
+	{
+		lineNumber++;
+		line = line.substr(0, line.find('#'));
+
+		std::istringstream lineStream(line);
+		std::string checksum;
+		std::string action;
+
+		if (!(lineStream >> checksum >> action))
+		{
+			continue;
+		}
+
+		u32 lineChecksum = 0;
+		if (!ParseHex(checksum, 0xFFFF, lineChecksum))
+		{
+			printf("Idle loop list: skipping line %u, bad checksum '%s'\n", lineNumber, checksum.c_str());
+			continue;
+		}
+
+		if (lineChecksum != romChecksum)
+		{
+			continue;
+		}
+
+		// Collected first, a bad address drops the whole line
+		std::vector<u16> loopPCs;
+		std::string address;
+		bool bValid = true;
+
+		while (lineStream >> address)
+		{
+			u32 loopPC = 0;
+			if (!ParseHex(address, 0xFFFF, loopPC))
+			{
+				printf("Idle loop list: skipping line %u, bad address '%s'\n", lineNumber, address.c_str());
+				bValid = false;
+				break;
+			}
+
+			loopPCs.push_back((u16)loopPC);
+		}
+
+		if (!bValid)
+		{
+			continue;
+		}
+
+		bHasEntry = true;
+
+		for (const u16 loopPC : loopPCs)
+		{
+			(action == "allow" ? romRules->allowed : romRules->denied).insert(loopPC);
+		}
+
+		if (action == "deny" && loopPCs.empty())
+		{
+			romRules->bDenyAll = true;
+		}
+	}
+
+	if (bHasEntry)
+	{
+		printf("Idle loop list: %s%zu allowed, %zu denied\n", romRules->bDenyAll ? "disabled for this ROM, " : "",
+			   romRules->allowed.size(), romRules->denied.size());
+	}
+
+	rules = std::move(romRules);
+	return true;
+}
+
+bool IdleLoopDetector::IsAllowed(u16 start) const
+{
+	if (!rules)
+	{
+		return true;
+	}
+
+	if (rules->bDenyAll || rules->denied.contains(start))
+	{
+		return false;
+	}
+
+	return rules->allowed.empty() || rules->allowed.contains(start);
+}
+
+void IdleLoopDetector::OnBackwardJump(u16 target, const CPU_Registers& registers, bool interruptsEnabled)
+{
+	u32 now = EMU::GetEMU()->GetCycles();
+	const u32 effects = EMU::GetBUS()->GetSideEffectCount();
+
+	const bool bRepeated = target == loopStart
+		&& effects == sideEffectCount
+		&& interruptsEnabled == loopInterruptsEnabled
+		&& std::memcmp(&registers, &loopRegisters, sizeof(CPU_Registers)) == 0;
+
+	if (bRepeated)
+	{
+		const u32 iteration = now - iterationStartCycle;
+
+		// Second identical iteration in a row, the loop is idle
+		if (iteration == iterationCycles && IsAllowed(loopStart))
+		{
+			const u32 iterationMCycles = iteration / 4;
+			const u32 skippedIterations = EMU::GetIdleMCycles() / iterationMCycles;
+
+			if (skippedIterations != 0)
+			{
+				EMU::Advance(skippedIterations * iterationMCycles);
+				now = EMU::GetEMU()->GetCycles();
+
+				skippedLoops++;
+				skippedCycles += skippedIterations * iteration;
+			}
+		}
+
+		iterationCycles = iteration;
+	}
+	else
+	{
+		loopStart = target;
+		loopRegisters = registers;
+		loopInterruptsEnabled = interruptsEnabled;
+		iterationCycles = 0;
+	}
+
+	iterationStartCycle = now;
+	sideEffectCount = effects;
+}
+
+void IdleLoopDetector::Reset()
+{
+	loopStart = 0;
+	loopRegisters = {};
+	iterationCycles = 0;
+}
+
+void IdleLoopDetector::PrintStats()
+{
+	if (skippedLoops == 0)
+	{
+		return;
+	}
+
+	printf("Idle loops: %u skips, %llu cycles skipped\n", skippedLoops, (unsigned long long)skippedCycles);
+
+	skippedLoops = 0;
+	skippedCycles = 0;
+}
@@ -403,6 +403,28 @@ Instruction* Instruction::GetInstruction(u8 opcode)
 	return &instructions[opcode];
 }
 
+u8 Instruction::GetOperandCount(AddrMode mode)
+{
+	switch (mode)
+	{
+	case AddrMode::R_D8:
+	case AddrMode::D8:
+	case AddrMode::R_A8:
+	case AddrMode::A8_R:
+	case AddrMode::HL_SPD:
+	case AddrMode::MR_D8:
+		return 1;
+	case AddrMode::R_D16:
+	case AddrMode::D16:
+	case AddrMode::R_A16:
+	case AddrMode::A16_R:
+	case AddrMode::D16_R:
+		return 2;
+	default:
+		return 0;
+	}
+}
+
 void Instruction::PrintInfo(Instruction* instruction)
 {
 	if (!instruction)
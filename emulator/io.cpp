@@ -4,11 +4,19 @@
 #include "cpu.h"
 #include "ppu.h"
 #include "bus.h"
+#include "apu.h"
+#include "joypad.h"
+#include "save_state.h"
 
 using namespace GB;
 
 u8 IO::ReadByte(u16 address)
 {
+	if (Joypad::IsJoypad_Addr(address))
+	{
+		return EMU::GetJoypad()->ReadByte();
+	}
+
 	if (address == 0xFF01)
 	{
 		return serialData[0];
@@ -29,6 +37,11 @@ u8 IO::ReadByte(u16 address)
 		return EMU::GetTimer()->ReadByte(address);
 	}
 
+	if (APU::IsAPU_Addr(address))
+	{
+		return EMU::GetAPU()->ReadByte(address);
+	}
+
 	if (address == 0xFF0F)
 	{
 		return EMU::GetCPU()->GetInterruptFlags();
@@ -54,6 +67,12 @@ u8 IO::ReadByte(u16 address)
 
 void IO::WriteByte(u16 address, u8 value)
 {
+	if (Joypad::IsJoypad_Addr(address))
+	{
+		EMU::GetJoypad()->WriteByte(value);
+		return;
+	}
+
 	if (address == 0xFF01)
 	{
 		serialData[0] = value;
@@ -72,6 +91,12 @@ void IO::WriteByte(u16 address, u8 value)
 		return;
 	}
 
+	if (APU::IsAPU_Addr(address))
+	{
+		EMU::GetAPU()->WriteByte(address, value);
+		return;
+	}
+
 	if (address == 0xFF0F)
 	{
 		EMU::GetCPU()->SetInterruptFlags(value);
@@ -107,3 +132,18 @@ bool IO::IsIO_Addr(u16 address)
 	return (address >= 0xFF00 && address < 0xFF80) || address == 0xFFFF;
 }
 
+
+void IO::SaveState(StateWriter& writer) const
+{
+	writer.BeginSection(StateSection::IO);
+	writer.Write(*this);
+	writer.EndSection();
+}
+
+void IO::LoadState(StateReader& reader)
+{
+	if (reader.BeginSection(StateSection::IO))
+	{
+		reader.Read(*this);
+	}
+}
@@ -0,0 +1,830 @@
+#include "jit.h"
+#include "block_cache.h"
+#include "cpu.h"
+#include "emu.h"
+#include "ppu.h"
+#include "Instructions.h"
+
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <type_traits>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define GB_JIT_X64
+#endif
+
+using namespace GB;
+
+namespace
+{
+	// Register numbers as encoded in ModRM, 8 and up need a REX prefix
+	enum X64Reg : u8
+	{
+		RAX = 0,
+		RCX = 1,
+		RDX = 2,
+		RBX = 3,
+		RBP = 5,
+		RSI = 6,
+		RDI = 7,
+		R8 = 8
+	};
+
+#if defined(_WIN32)
+	constexpr X64Reg ARG_1 = RCX;
+	constexpr X64Reg ARG_2 = RDX;
+	constexpr X64Reg ARG_3 = R8;
+	// Win64 callers reserve 32 bytes of home space for the callee's register arguments
+	constexpr u8 SHADOW_SPACE = 32;
+#else
+	constexpr X64Reg ARG_1 = RDI;
+	constexpr X64Reg ARG_2 = RSI;
+	constexpr X64Reg ARG_3 = RDX;
+	constexpr u8 SHADOW_SPACE = 0;
+#endif
+
+	// Generated code keeps the Jit* in rbx and the CPU_Registers* in rbp, both callee
+	// saved. Register file fields are addressed as [rbp + disp8].
+	static_assert(std::is_standard_layout_v<CPU_Registers>, "Native code addresses CPU_Registers fields by offset");
+	static_assert(sizeof(CPU_Registers) < 128, "CPU_Registers fields must be reachable with an 8-bit displacement");
+
+	constexpr u8 OFFSET_F = offsetof(CPU_Registers, F);
+	constexpr u8 OFFSET_PC = offsetof(CPU_Registers, PC);
+	constexpr u8 OFFSET_FLAG_OP = offsetof(CPU_Registers, flagOp);
+	constexpr u8 OFFSET_FLAG_A = offsetof(CPU_Registers, flagA);
+	constexpr u8 OFFSET_FLAG_B = offsetof(CPU_Registers, flagB);
+	constexpr u8 OFFSET_FLAG_CARRY = offsetof(CPU_Registers, flagCarry);
+
+	// Where native code finds a register, the low byte for pairs. -1 for registers
+	// it leaves to the interpreter.
+	int GetRegisterOffset(RegisterType type)
+	{
+		switch (type)
+		{
+		case RegisterType::A: return offsetof(CPU_Registers, A);
+		case RegisterType::B: return offsetof(CPU_Registers, B);
+		case RegisterType::C: return offsetof(CPU_Registers, C);
+		case RegisterType::D: return offsetof(CPU_Registers, D);
+		case RegisterType::E: return offsetof(CPU_Registers, E);
+		case RegisterType::H: return offsetof(CPU_Registers, H);
+		case RegisterType::L: return offsetof(CPU_Registers, L);
+		case RegisterType::BC: return offsetof(CPU_Registers, C);
+		case RegisterType::DE: return offsetof(CPU_Registers, E);
+		case RegisterType::HL: return offsetof(CPU_Registers, L);
+		case RegisterType::SP: return offsetof(CPU_Registers, SP);
+		default: return -1;
+		}
+	}
+
+	bool IsByteRegister(RegisterType type)
+	{
+		return type >= RegisterType::A && type <= RegisterType::L && type != RegisterType::F;
+	}
+
+	void Emit(std::vector<u8>& code, std::initializer_list<u8> bytes)
+	{
+		code.insert(code.end(), bytes);
+	}
+
+	void EmitU32(std::vector<u8>& code, u32 value)
+	{
+		for (u32 i = 0; i < 4; i++)
+		{
+			code.push_back((value >> (i * 8)) & 0xFF);
+		}
+	}
+
+	// mov dst, src (64 bit)
+	void EmitMovRegReg(std::vector<u8>& code, X64Reg dst, X64Reg src)
+	{
+		Emit(code, { 0x48, 0x89, (u8)(0xC0 | (src << 3) | dst) });
+	}
+
+	// mov dst, imm64
+	void EmitMovRegImm64(std::vector<u8>& code, X64Reg dst, const void* value)
+	{
+		Emit(code, { 0x48, (u8)(0xB8 + dst) });
+
+		const u64 bits = (u64)(uintptr_t)value;
+		EmitU32(code, (u32)bits);
+		EmitU32(code, (u32)(bits >> 32));
+	}
+
+	// mov dst32, imm32
+	void EmitMovRegImm32(std::vector<u8>& code, X64Reg dst, u32 value)
+	{
+		if (dst >= R8)
+		{
+			Emit(code, { 0x41 });
+		}
+		Emit(code, { (u8)(0xB8 + (dst & 7)) });
+		EmitU32(code, value);
+	}
+
+	// ModRM for [rbp + disp8] with 'reg' in the reg field, followed by the displacement
+	void EmitRegisterOperand(std::vector<u8>& code, u8 reg, u8 offset)
+	{
+		Emit(code, { (u8)(0x45 | (reg << 3)), offset });
+	}
+
+	// movzx dst32, byte [rbp + offset]
+	void EmitLoadByte(std::vector<u8>& code, X64Reg dst, u8 offset)
+	{
+		Emit(code, { 0x0F, 0xB6 });
+		EmitRegisterOperand(code, dst, offset);
+	}
+
+	// mov byte [rbp + offset], src8 (al, cl or dl)
+	void EmitStoreByte(std::vector<u8>& code, u8 offset, X64Reg src)
+	{
+		Emit(code, { 0x88 });
+		EmitRegisterOperand(code, src, offset);
+	}
+
+	// mov byte [rbp + offset], imm8
+	void EmitStoreByteImm(std::vector<u8>& code, u8 offset, u8 value)
+	{
+		Emit(code, { 0xC6 });
+		EmitRegisterOperand(code, 0, offset);
+		Emit(code, { value });
+	}
+
+	// mov word [rbp + offset], imm16
+	void EmitStoreWordImm(std::vector<u8>& code, u8 offset, u16 value)
+	{
+		Emit(code, { 0x66, 0xC7 });
+		EmitRegisterOperand(code, 0, offset);
+		Emit(code, { (u8)(value & 0xFF), (u8)(value >> 8) });
+	}
+
+	// inc/dec word [rbp + offset]
+	void EmitStepWord(std::vector<u8>& code, u8 offset, bool bIncrement)
+	{
+		Emit(code, { 0x66, 0xFF });
+		EmitRegisterOperand(code, bIncrement ? 0 : 1, offset);
+	}
+
+	// test byte [rbp + offset], imm8
+	void EmitTestByte(std::vector<u8>& code, u8 offset, u8 mask)
+	{
+		Emit(code, { 0xF6 });
+		EmitRegisterOperand(code, 0, offset);
+		Emit(code, { mask });
+	}
+
+	// jcc rel32 (or jmp with condition 0xFF), returns where the displacement goes
+	u32 EmitJump(std::vector<u8>& code, u8 condition)
+	{
+		if (condition == 0xFF)
+		{
+			Emit(code, { 0xE9 });
+		}
+		else
+		{
+			Emit(code, { 0x0F, (u8)(0x80 | condition) });
+		}
+
+		const u32 patch = (u32)code.size();
+		EmitU32(code, 0);
+		return patch;
+	}
+
+	void PatchJump(std::vector<u8>& code, u32 patch, u32 target)
+	{
+		const u32 displacement = target - (patch + 4);
+		std::memcpy(code.data() + patch, &displacement, sizeof(u32));
+	}
+
+	constexpr u8 JUMP_ALWAYS = 0xFF;
+	constexpr u8 JUMP_IF_ZERO = 0x4;
+	constexpr u8 JUMP_IF_NOT_ZERO = 0x5;
+
+	std::mutex perfMapMutex;
+	std::FILE* perfMap = nullptr;
+
+	void WritePerfMapEntry(const void* code, u32 size, u32 key)
+	{
+#if defined(__linux__)
+		std::lock_guard<std::mutex> lock(perfMapMutex);
+
+		if (!perfMap)
+		{
+			char path[64];
+			std::snprintf(path, sizeof(path), "/tmp/perf-%d.map", (int)getpid());
+			perfMap = std::fopen(path, "w");
+
+			if (!perfMap)
+			{
+				return;
+			}
+		}
+
+		std::fprintf(perfMap, "%llx %x gb_%02X_%04X\n", (unsigned long long)(uintptr_t)code, size, key >> 16, key & 0xFFFF);
+		std::fflush(perfMap);
+#endif
+	}
+}
+
+Jit::~Jit()
+{
+	ReleaseArena();
+}
+
+Jit::Jit(const Jit& other)
+{
+	*this = other;
+}
+
+Jit& Jit::operator=(const Jit& other)
+{
+	if (this != &other)
+	{
+		Clear();
+
+		bIsEnabled = other.bIsEnabled;
+		bIsLockstep = other.bIsLockstep;
+		hotThreshold = other.hotThreshold;
+	}
+
+	return *this;
+}
+
+bool Jit::SetEnabled(bool bEnabled)
+{
+#if !defined(GB_JIT_X64)
+	if (bEnabled)
+	{
+		printf("JIT: only supported on x86-64 hosts\n");
+		return false;
+	}
+#endif
+
+	bIsEnabled = bEnabled;
+
+	if (!bIsEnabled)
+	{
+		Clear();
+	}
+
+	return true;
+}
+
+u32 Jit::Run(CPU& cpu, u16 pc)
+{
+	// Native instructions bypass the per-instruction hooks
+	if (cpu.HasInstructionHooks())
+	{
+		return 0;
+	}
+
+	BlockCache& cache = cpu.GetBlockCache();
+
+	const u32 key = BlockCache::MakeKey(pc);
+	Entry& entry = entries[key];
+
+	if (entry.code && entry.generation != cache.GetGeneration())
+	{
+		// Something was dropped or rebanked since, see if it was this block
+		if (cache.FindBlock(key) != entry.block)
+		{
+			entry = {};
+		}
+		else
+		{
+			entry.generation = cache.GetGeneration();
+		}
+	}
+
+	if (!entry.code)
+	{
+		if (++entry.executions < hotThreshold)
+		{
+			return 0;
+		}
+
+		std::shared_ptr<const CodeBlock> block = cache.GetBlock(pc);
+		if (!block)
+		{
+			return 0;
+		}
+
+		BlockCode code = Compile(*block, key);
+		if (!code)
+		{
+			return 0;
+		}
+
+		// Compiling may have reset the arena and with it 'entries'
+		Entry& compiled = entries[key];
+		compiled.block = std::move(block);
+		compiled.code = code;
+		compiled.generation = cache.GetGeneration();
+
+		return Run(cpu, pc);
+	}
+
+	runningCPU = &cpu;
+	runFrame = EMU::GetPPU()->GetCurrentFrame();
+	runGeneration = cache.GetGeneration();
+	runInstructions = 0;
+
+	entry.code(this, &cpu.GetRegisters());
+
+	runningCPU = nullptr;
+	blockRuns++;
+
+	return runInstructions;
+}
+
+bool Jit::StepInstruction(Jit* jit, const DecodedInstr* decoded)
+{
+	CPU& cpu = *jit->runningCPU;
+
+	cpu.StepDecoded(*decoded);
+	jit->runInstructions++;
+
+	return jit->IsStillInBlock(cpu, *decoded);
+}
+
+bool Jit::FinishInstruction(Jit* jit, const DecodedInstr* decoded, u32 mCycles)
+{
+	CPU& cpu = *jit->runningCPU;
+
+	cpu.CompleteDecoded(*decoded, (u8)mCycles);
+	jit->runInstructions++;
+
+	return jit->IsStillInBlock(cpu, *decoded);
+}
+
+void Jit::ResolveFlags(CPU_Registers* registers)
+{
+	registers->MaterializeFlags();
+}
+
+bool Jit::IsStillInBlock(CPU& cpu, const DecodedInstr& decoded) const
+{
+	return !cpu.IsHalted() &&
+		cpu.GetPC() == (u16)(decoded.pc + decoded.length) &&
+		EMU::GetPPU()->GetCurrentFrame() == runFrame &&
+		cpu.GetBlockCache().GetGeneration() == runGeneration;
+}
+
+bool Jit::EmitNativeInstruction(std::vector<u8>& code, const DecodedInstr& decoded)
+{
+#if defined(LAZY_FLAGS_LOCKSTEP)
+	// Native ALU code does not keep the eager shadow F
+	(void)code;
+	(void)decoded;
+	return false;
+#else
+	const Instruction* instruction = decoded.instruction;
+	if (!instruction)
+	{
+		return false;
+	}
+
+	const u16 nextPC = decoded.pc + decoded.length;
+	const u8 immediate = decoded.operands[0];
+	const u16 immediateWord = decoded.operands[0] | (decoded.operands[1] << 8);
+
+	const int offset1 = GetRegisterOffset(instruction->reg_1);
+	const int offset2 = GetRegisterOffset(instruction->reg_2);
+
+	// Pending flags are folded into F out of line before anything reads it
+	auto emitMaterializeFlags = [&code]()
+	{
+		// cmp byte [rbp + flagOp], NONE / je skip
+		Emit(code, { 0x80 });
+		EmitRegisterOperand(code, 7, OFFSET_FLAG_OP);
+		Emit(code, { (u8)FlagOp::NONE, 0x74, 0x00 });
+		const u32 skipPatch = (u32)code.size() - 1;
+
+		EmitMovRegReg(code, ARG_1, RBP);
+		EmitMovRegImm64(code, RAX, reinterpret_cast<const void*>(&Jit::ResolveFlags));
+		Emit(code, { 0xFF, 0xD0 });
+
+		code[skipPatch] = (u8)(code.size() - (skipPatch + 1));
+	};
+
+	// Same stores as CPU_Registers::SetFlagsLazy. flagA always comes from al, flagB
+	// from cl or 0, flagCarry from dl or 'carryValue'.
+	auto emitSetFlagsLazy = [&code](FlagOp op, bool bOperandInCL, bool bCarryInDL, u8 carryValue)
+	{
+		EmitStoreByte(code, OFFSET_FLAG_A, RAX);
+
+		if (bOperandInCL)
+		{
+			EmitStoreByte(code, OFFSET_FLAG_B, RCX);
+		}
+		else
+		{
+			EmitStoreByteImm(code, OFFSET_FLAG_B, 0);
+		}
+
+		if (bCarryInDL)
+		{
+			EmitStoreByte(code, OFFSET_FLAG_CARRY, RDX);
+		}
+		else
+		{
+			EmitStoreByteImm(code, OFFSET_FLAG_CARRY, carryValue);
+		}
+
+		EmitStoreByteImm(code, OFFSET_FLAG_OP, (u8)op);
+	};
+
+	// Cycles as the interpreter charges them, see cpu_fetch.cpp and cpu_proc.cpp.
+	// Branches load ARG_3 themselves and leave this at 0.
+	u8 mCycles = 0;
+
+	switch (instruction->type)
+	{
+	case InstrType::LD:
+	{
+		if (instruction->mode == AddrMode::R_R && IsByteRegister(instruction->reg_1) && IsByteRegister(instruction->reg_2))
+		{
+			EmitLoadByte(code, RAX, (u8)offset2);
+			EmitStoreByte(code, (u8)offset1, RAX);
+			mCycles = 1;
+		}
+		else if (instruction->mode == AddrMode::R_D8 && IsByteRegister(instruction->reg_1))
+		{
+			EmitStoreByteImm(code, (u8)offset1, immediate);
+			mCycles = 2;
+		}
+		else if (instruction->mode == AddrMode::R_D16 && instruction->reg_1 != RegisterType::SP && offset1 >= 0)
+		{
+			// LD SP has to tell the shadow call stack, it stays interpreted
+			EmitStoreWordImm(code, (u8)offset1, immediateWord);
+			mCycles = 3;
+		}
+		else
+		{
+			return false;
+		}
+		break;
+	}
+	case InstrType::INC:
+	case InstrType::DEC:
+	{
+		if (instruction->mode != AddrMode::R || offset1 < 0)
+		{
+			return false;
+		}
+
+		const bool bIncrement = instruction->type == InstrType::INC;
+
+		if (!IsByteRegister(instruction->reg_1))
+		{
+			EmitStepWord(code, (u8)offset1, bIncrement);
+			mCycles = 2;
+			break;
+		}
+
+		// INC/DEC keep C, which may still be pending
+		emitMaterializeFlags();
+		EmitLoadByte(code, RAX, (u8)offset1);
+		emitSetFlagsLazy(bIncrement ? FlagOp::INC : FlagOp::DEC, false, false, 0);
+		// inc al / dec al
+		Emit(code, { 0xFE, (u8)(bIncrement ? 0xC0 : 0xC8) });
+		EmitStoreByte(code, (u8)offset1, RAX);
+		mCycles = 1;
+		break;
+	}
+	case InstrType::ADD:
+	case InstrType::ADC:
+	case InstrType::SUB:
+	case InstrType::SBC:
+	case InstrType::AND:
+	case InstrType::OR:
+	case InstrType::XOR:
+	case InstrType::CP:
+	{
+		if (instruction->reg_1 != RegisterType::A)
+		{
+			return false;
+		}
+
+		const bool bRegisterOperand = instruction->mode == AddrMode::R_R && IsByteRegister(instruction->reg_2);
+		if (!bRegisterOperand && instruction->mode != AddrMode::R_D8)
+		{
+			return false;
+		}
+
+		// The carry comes first, resolving flags is a call that clobbers cl
+		const bool bWithCarry = instruction->type == InstrType::ADC || instruction->type == InstrType::SBC;
+		if (bWithCarry)
+		{
+			emitMaterializeFlags();
+			// movzx edx, byte [rbp + F] / shr edx, 4 / and edx, 1
+			EmitLoadByte(code, RDX, OFFSET_F);
+			Emit(code, { 0xC1, 0xEA, 0x04, 0x83, 0xE2, 0x01 });
+		}
+
+		if (bRegisterOperand)
+		{
+			EmitLoadByte(code, RCX, (u8)offset2);
+			mCycles = 1;
+		}
+		else
+		{
+			EmitMovRegImm32(code, RCX, immediate);
+			mCycles = 2;
+		}
+
+		EmitLoadByte(code, RAX, (u8)offsetof(CPU_Registers, A));
+
+		switch (instruction->type)
+		{
+		case InstrType::ADD:
+		case InstrType::ADC:
+			emitSetFlagsLazy(FlagOp::ADD, true, bWithCarry, 0);
+			// add al, cl (/ add al, dl)
+			Emit(code, { 0x00, 0xC8 });
+			if (bWithCarry)
+			{
+				Emit(code, { 0x00, 0xD0 });
+			}
+			break;
+		case InstrType::SUB:
+		case InstrType::SBC:
+		case InstrType::CP:
+			emitSetFlagsLazy(FlagOp::SUB, true, bWithCarry, 0);
+			// sub al, cl (/ sub al, dl)
+			Emit(code, { 0x28, 0xC8 });
+			if (bWithCarry)
+			{
+				Emit(code, { 0x28, 0xD0 });
+			}
+			break;
+		default:
+		{
+			// and / or / xor al, cl, the result is what the flags are computed from
+			const u8 aluOpcode = instruction->type == InstrType::AND ? 0x20 : instruction->type == InstrType::OR ? 0x08 : 0x30;
+			Emit(code, { aluOpcode, 0xC8 });
+			emitSetFlagsLazy(FlagOp::LOGIC, false, false, instruction->type == InstrType::AND);
+			break;
+		}
+		}
+
+		// CP only sets flags
+		if (instruction->type != InstrType::CP)
+		{
+			EmitStoreByte(code, (u8)offsetof(CPU_Registers, A), RAX);
+		}
+		break;
+	}
+	case InstrType::JP:
+	case InstrType::JR:
+	{
+		if (instruction->type == InstrType::JP && instruction->mode == AddrMode::R)
+		{
+			// movzx eax, word [rbp + HL] / mov word [rbp + PC], ax
+			Emit(code, { 0x0F, 0xB7 });
+			EmitRegisterOperand(code, RAX, (u8)offsetof(CPU_Registers, L));
+			Emit(code, { 0x66, 0x89 });
+			EmitRegisterOperand(code, RAX, OFFSET_PC);
+			EmitMovRegImm32(code, ARG_3, 1);
+			break;
+		}
+
+		u16 target = 0;
+		u8 notTakenCycles = 0;
+		if (instruction->type == InstrType::JR && instruction->mode == AddrMode::D8)
+		{
+			target = nextPC + (i8)immediate;
+			notTakenCycles = 2;
+		}
+		else if (instruction->type == InstrType::JP && instruction->mode == AddrMode::D16)
+		{
+			target = immediateWord;
+			notTakenCycles = 3;
+		}
+		else
+		{
+			return false;
+		}
+
+		if (instruction->cond == CondType::NONE)
+		{
+			EmitStoreWordImm(code, OFFSET_PC, target);
+			EmitMovRegImm32(code, ARG_3, notTakenCycles + 1);
+			break;
+		}
+
+		emitMaterializeFlags();
+
+		const bool bZeroFlag = instruction->cond == CondType::NZ || instruction->cond == CondType::Z;
+		const bool bTakenIfSet = instruction->cond == CondType::Z || instruction->cond == CondType::C;
+		EmitTestByte(code, OFFSET_F, bZeroFlag ? 0x80 : 0x10);
+		const u32 notTakenJump = EmitJump(code, bTakenIfSet ? JUMP_IF_ZERO : JUMP_IF_NOT_ZERO);
+
+		EmitStoreWordImm(code, OFFSET_PC, target);
+		EmitMovRegImm32(code, ARG_3, notTakenCycles + 1);
+		const u32 doneJump = EmitJump(code, JUMP_ALWAYS);
+
+		PatchJump(code, notTakenJump, (u32)code.size());
+		EmitStoreWordImm(code, OFFSET_PC, nextPC);
+		EmitMovRegImm32(code, ARG_3, notTakenCycles);
+
+		PatchJump(code, doneJump, (u32)code.size());
+		break;
+	}
+	default:
+		return false;
+	}
+
+	if (mCycles != 0)
+	{
+		EmitStoreWordImm(code, OFFSET_PC, nextPC);
+		EmitMovRegImm32(code, ARG_3, mCycles);
+	}
+
+	EmitMovRegReg(code, ARG_1, RBX);
+	EmitMovRegImm64(code, ARG_2, &decoded);
+	EmitMovRegImm64(code, RAX, reinterpret_cast<const void*>(&Jit::FinishInstruction));
+	Emit(code, { 0xFF, 0xD0 });
+
+	return true;
+#endif
+}
+
+Jit::BlockCode Jit::Compile(const CodeBlock& block, u32 key)
+{
+#if defined(GB_JIT_X64)
+	std::vector<u8>& code = emitBuffer;
+	code.clear();
+
+	// The Jit* lives in rbx and the CPU_Registers* in rbp across the calls. The two
+	// pushes plus 8 bytes keep the stack 16 byte aligned for them.
+	Emit(code, { 0x53, 0x55, 0x48, 0x83, 0xEC, (u8)(8 + SHADOW_SPACE) });
+	EmitMovRegReg(code, RBX, ARG_1);
+	EmitMovRegReg(code, RBP, ARG_2);
+
+	std::vector<u32> exitJumps;
+	exitJumps.reserve(block.instructions.size());
+
+	u32 blockNativeInstructions = 0;
+
+	for (size_t i = 0; i < block.instructions.size(); i++)
+	{
+		if (EmitNativeInstruction(code, block.instructions[i]))
+		{
+			blockNativeInstructions++;
+		}
+		else
+		{
+			EmitMovRegReg(code, ARG_1, RBX);
+			EmitMovRegImm64(code, ARG_2, &block.instructions[i]);
+			EmitMovRegImm64(code, RAX, reinterpret_cast<const void*>(&Jit::StepInstruction));
+			// call rax
+			Emit(code, { 0xFF, 0xD0 });
+		}
+
+		if (i + 1 < block.instructions.size())
+		{
+			// test al, al / jz exit
+			Emit(code, { 0x84, 0xC0, 0x0F, 0x84 });
+			exitJumps.push_back((u32)code.size());
+			EmitU32(code, 0);
+		}
+	}
+
+	const u32 exitOffset = (u32)code.size();
+
+	// add rsp / pop rbp / pop rbx / ret
+	Emit(code, { 0x48, 0x83, 0xC4, (u8)(8 + SHADOW_SPACE), 0x5D, 0x5B, 0xC3 });
+
+	for (u32 jump : exitJumps)
+	{
+		PatchJump(code, jump, exitOffset);
+	}
+
+	if (!ReserveArena())
+	{
+		return nullptr;
+	}
+
+	// 16 byte aligned entry points
+	const u32 codeSize = (u32)code.size();
+	const u32 start = (arenaUsed + 15) & ~15u;
+
+	if (start + codeSize > JIT_ARENA_SIZE)
+	{
+		Clear();
+		arenaResets++;
+
+		if (!ReserveArena())
+		{
+			return nullptr;
+		}
+
+		return Compile(block, key);
+	}
+
+	u8* destination = arena + start;
+
+#if defined(_WIN32)
+	DWORD oldProtection;
+	VirtualProtect(arena, JIT_ARENA_SIZE, PAGE_READWRITE, &oldProtection);
+	std::memcpy(destination, code.data(), codeSize);
+	VirtualProtect(arena, JIT_ARENA_SIZE, PAGE_EXECUTE_READ, &oldProtection);
+	FlushInstructionCache(GetCurrentProcess(), destination, codeSize);
+#else
+	// Never writable and executable at the same time
+	mprotect(arena, JIT_ARENA_SIZE, PROT_READ | PROT_WRITE);
+	std::memcpy(destination, code.data(), codeSize);
+	mprotect(arena, JIT_ARENA_SIZE, PROT_READ | PROT_EXEC);
+#endif
+
+	arenaUsed = start + codeSize;
+
+	compiledBlocks++;
+	compiledInstructions += block.instructions.size();
+	nativeInstructions += blockNativeInstructions;
+
+	WritePerfMapEntry(destination, codeSize, key);
+
+	return (BlockCode)destination;
+#else
+	(void)block;
+	(void)key;
+	return nullptr;
+#endif
+}
+
+bool Jit::ReserveArena()
+{
+	if (arena)
+	{
+		return true;
+	}
+
+#if defined(_WIN32)
+	arena = (u8*)VirtualAlloc(nullptr, JIT_ARENA_SIZE, MEM_RESERVE | MEM_COMMIT, PAGE_EXECUTE_READ);
+#else
+	void* memory = mmap(nullptr, JIT_ARENA_SIZE, PROT_READ | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	arena = memory != MAP_FAILED ? (u8*)memory : nullptr;
+#endif
+
+	if (!arena)
+	{
+		printf("JIT: failed to allocate executable memory, staying interpreted\n");
+		bIsEnabled = false;
+		return false;
+	}
+
+	arenaUsed = 0;
+	return true;
+}
+
+void Jit::ReleaseArena()
+{
+	if (!arena)
+	{
+		return;
+	}
+
+#if defined(_WIN32)
+	VirtualFree(arena, 0, MEM_RELEASE);
+#else
+	munmap(arena, JIT_ARENA_SIZE);
+#endif
+
+	arena = nullptr;
+	arenaUsed = 0;
+}
+
+void Jit::Clear()
+{
+	entries.clear();
+	ReleaseArena();
+}
+
+void Jit::PrintStats()
+{
+	if (blockRuns == 0)
+	{
+		return;
+	}
+
+	printf("JIT: %u blocks compiled (%llu instructions, %llu native), %llu block runs, %u KB code, %u arena resets\n",
+		   compiledBlocks, (unsigned long long)compiledInstructions, (unsigned long long)nativeInstructions,
+		   (unsigned long long)blockRuns, arenaUsed / 1024, arenaResets);
+
+	compiledBlocks = 0;
+	compiledInstructions = 0;
+	nativeInstructions = 0;
+	blockRuns = 0;
+	arenaResets = 0;
+}
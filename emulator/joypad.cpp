@@ -1,27 +1,83 @@
 #include "joypad.h"
-
-#include <memory>
+#include "emu.h"
+#include "cpu.h"
+#include "save_state.h"
 
 using namespace GB;
 
+namespace
+{
+	constexpr u8 SELECT_DIRECTIONS = 1 << 4;
+	constexpr u8 SELECT_BUTTONS = 1 << 5;
+}
 
-Joypad* Joypad::GetJoypad()
+u8 Joypad::ReadByte()
 {
-	static std::unique_ptr<Joypad> joypad(new Joypad);
-	return joypad.get();
+	if (liveInput)
+	{
+		SetButtons(liveInput->load(std::memory_order_relaxed));
+	}
+
+	return 0xC0 | select | GetInputLines();
 }
 
-void Joypad::WriteState(u8 newValue)
+void Joypad::WriteByte(u8 value)
 {
-	GetJoypad()->state = newValue;
+	const u8 previousLines = GetInputLines();
+	select = value & (SELECT_DIRECTIONS | SELECT_BUTTONS);
+
+	if (previousLines & ~GetInputLines())
+	{
+		EMU::GetCPU()->RequestInterrupt(IntType::IT_Joypad);
+	}
+}
+
+void Joypad::SetButtons(u8 pressed)
+{
+	const u8 previousLines = GetInputLines();
+	buttons = pressed;
+
+	if (previousLines & ~GetInputLines())
+	{
+		EMU::GetCPU()->RequestInterrupt(IntType::IT_Joypad);
+	}
 }
 
-u8 Joypad::ReadState()
+u8 Joypad::GetInputLines() const
 {
-	return GetJoypad()->state;
+	u8 pressedLines = 0;
+
+	if (!(select & SELECT_DIRECTIONS))
+	{
+		pressedLines |= buttons & 0x0F;
+	}
+
+	if (!(select & SELECT_BUTTONS))
+	{
+		pressedLines |= buttons >> 4;
+	}
+
+	return ~pressedLines & 0x0F;
 }
 
 bool Joypad::IsJoypad_Addr(u16 address)
 {
-	return false; //address == 0xFF00;
+	return address == 0xFF00;
+}
+
+void Joypad::SaveState(StateWriter& writer) const
+{
+	writer.BeginSection(StateSection::JOYPAD);
+	writer.Write(select);
+	writer.Write(buttons);
+	writer.EndSection();
+}
+
+void Joypad::LoadState(StateReader& reader)
+{
+	if (reader.BeginSection(StateSection::JOYPAD))
+	{
+		reader.Read(select);
+		reader.Read(buttons);
+	}
 }
@@ -4,6 +4,7 @@
 #include "emu.h"
 #include "bus.h"
 #include "cpu.h"
+#include "save_state.h"
 
 using namespace GB;
 
@@ -105,3 +106,18 @@ void LCD::IncrementLY()
 		lyCompare = 0;
 	}
 }
+
+void LCD::SaveState(StateWriter& writer) const
+{
+	writer.BeginSection(StateSection::LCD);
+	writer.Write(*this);
+	writer.EndSection();
+}
+
+void LCD::LoadState(StateReader& reader)
+{
+	if (reader.BeginSection(StateSection::LCD))
+	{
+		reader.Read(*this);
+	}
+}
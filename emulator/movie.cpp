@@ -0,0 +1,189 @@
+#include "movie.h"
+
+#include <fstream>
+
+using namespace GB;
+
+Movie::~Movie()
+{
+	Stop();
+}
+
+bool Movie::StartRecording(const std::filesystem::path& filePath, u16 romChecksum)
+{
+	Stop();
+
+	// Make sure the file can be written before emulating a whole session into it
+	std::ofstream fileStream(filePath, std::ios::binary | std::ios::trunc);
+	if (!fileStream.good())
+	{
+		printf("Failed to create movie: %s\n", filePath.string().c_str());
+		return false;
+	}
+
+	path = filePath;
+	checksum = romChecksum;
+	runs.clear();
+	frameCount = 0;
+	frame = 0;
+	bRecording = true;
+
+	printf("Recording movie: %s\n", filePath.string().c_str());
+	return true;
+}
+
+bool Movie::StartPlayback(const std::filesystem::path& filePath, u16 romChecksum)
+{
+	Stop();
+
+	std::ifstream fileStream(filePath, std::ios::binary);
+	if (!fileStream.good())
+	{
+		printf("Failed to open movie: %s\n", filePath.string().c_str());
+		return false;
+	}
+
+	MovieHeader header{};
+	fileStream.read((char*)&header, sizeof(header));
+
+	if (!fileStream.good() || header.magic != MOVIE_MAGIC || header.version > MOVIE_VERSION)
+	{
+		printf("Not a movie file: %s\n", filePath.string().c_str());
+		return false;
+	}
+
+	if (header.romChecksum != romChecksum)
+	{
+		printf("Movie was recorded with another ROM: %s\n", filePath.string().c_str());
+		return false;
+	}
+
+	runs.resize(header.runCount);
+	fileStream.read((char*)runs.data(), header.runCount * sizeof(MovieRun));
+
+	if (!fileStream.good())
+	{
+		printf("Movie is truncated: %s\n", filePath.string().c_str());
+		runs.clear();
+		return false;
+	}
+
+	frameCount = header.frameCount;
+	frame = 0;
+	runIndex = 0;
+	runFrame = 0;
+	bPlaying = true;
+
+	printf("Playing movie: %s (%u frames)\n", filePath.string().c_str(), frameCount);
+	return true;
+}
+
+u8 Movie::NextFrame(u8 liveButtons)
+{
+	if (bRecording)
+	{
+		if (runs.empty() || runs.back().buttons != liveButtons || runs.back().frames == 0xFFFF)
+		{
+			runs.push_back({ liveButtons, 0, 0 });
+		}
+
+		runs.back().frames++;
+		frameCount++;
+		frame++;
+
+		return liveButtons;
+	}
+
+	if (bPlaying)
+	{
+		if (runIndex >= runs.size())
+		{
+			printf("Movie finished after %u frames\n", frame);
+			bPlaying = false;
+			return 0;
+		}
+
+		const u8 buttons = runs[runIndex].buttons;
+
+		if (++runFrame >= runs[runIndex].frames)
+		{
+			runIndex++;
+			runFrame = 0;
+		}
+
+		frame++;
+		return buttons;
+	}
+
+	return liveButtons;
+}
+
+bool Movie::Seek(u32 targetFrame)
+{
+	if (!bRecording && !bPlaying)
+	{
+		return true;
+	}
+
+	if (targetFrame > frameCount)
+	{
+		return false;
+	}
+
+	u32 runStart = 0;
+	runIndex = 0;
+	while (runIndex < runs.size() && runStart + runs[runIndex].frames <= targetFrame)
+	{
+		runStart += runs[runIndex].frames;
+		runIndex++;
+	}
+	runFrame = (u16)(targetFrame - runStart);
+
+	if (bRecording)
+	{
+		// Cut the run the cursor is in short, a new one starts if the input differs
+		runs.resize(runFrame != 0 ? runIndex + 1 : runIndex);
+		if (runFrame != 0)
+		{
+			runs.back().frames = runFrame;
+		}
+
+		frameCount = targetFrame;
+		runIndex = 0;
+		runFrame = 0;
+	}
+
+	frame = targetFrame;
+	return true;
+}
+
+void Movie::Stop()
+{
+	bPlaying = false;
+
+	if (!bRecording)
+	{
+		return;
+	}
+
+	bRecording = false;
+
+	std::ofstream fileStream(path, std::ios::binary | std::ios::trunc);
+	if (!fileStream.good())
+	{
+		printf("Failed to write movie: %s\n", path.string().c_str());
+		return;
+	}
+
+	MovieHeader header{};
+	header.magic = MOVIE_MAGIC;
+	header.version = MOVIE_VERSION;
+	header.romChecksum = checksum;
+	header.frameCount = frameCount;
+	header.runCount = (u32)runs.size();
+
+	fileStream.write((const char*)&header, sizeof(header));
+	fileStream.write((const char*)runs.data(), runs.size() * sizeof(MovieRun));
+
+	printf("Saved movie: %s (%u frames, %u runs)\n", path.string().c_str(), frameCount, header.runCount);
+}
@@ -3,6 +3,10 @@
 #include "lcd.h"
 #include "cpu.h"
 #include "window.h"
+#include "apu.h"
+#include "save_state.h"
+
+#include <limits>
 
 using namespace GB;
 
@@ -40,6 +44,23 @@ void PPU::Tick()
 	}
 }
 
+u32 PPU::GetTicksToNextEvent() const
+{
+	// Thresholds of the Tick_ functions, which compare after incrementing
+	u32 threshold = 0;
+
+	switch (EMU::GetLCD()->Get_PPU_Mode())
+	{
+	case LCD_Mode::OAM: threshold = 80; break;
+	case LCD_Mode::XFER: threshold = 80 + 172; break;
+	case LCD_Mode::HBLANK:
+	case LCD_Mode::VBLANK: threshold = TICKS_PER_LINE; break;
+	default: return std::numeric_limits<u32>::max();
+	}
+
+	return line_ticks < threshold ? threshold - line_ticks : 1;
+}
+
 u8 PPU::ReadOAM_Byte(u16 address) const
 {
 	if (address >= TOTAL_OAM_SIZE)
@@ -116,27 +137,45 @@ void PPU::TICK_HBLANK()
 
 			current_frame++;
 
-			//calc FPS...
-			u32 end = EMU::GetWindow()->GetTicks();
-			u32 frame_time = end - prev_frame_time;
-
-			if (frame_time < target_frame_time)
-			{
-				EMU::GetCPU()->Sleep((target_frame_time - frame_time));
-			}
+			EMU::GetAPU()->EndFrame();
 
-			if (end - start_timer >= 1000)
+			// Run-ahead frames are rolled back, they are neither paced nor counted
+			if (!EMU::GetEMU()->IsSpeculating())
 			{
-				u32 fps = frame_count;
-				start_timer = end;
-				frame_count = 0;
-
-				printf("FPS: %d\n", fps);
+				//calc FPS...
+				u32 end = EMU::GetEMU()->GetTicks();
+				u32 frame_time = end - prev_frame_time;
+
+				// With audio clock pacing the APU blocks on the output ring instead
+				if (EMU::GetEMU()->GetPacingMode() == PacingMode::SLEEP && frame_time < target_frame_time)
+				{
+					EMU::GetCPU()->Sleep((target_frame_time - frame_time));
+				}
+
+				if (end - start_timer >= 1000)
+				{
+					u32 fps = frame_count;
+					start_timer = end;
+					frame_count = 0;
+
+					if (EMU::GetEMU()->GetPacingMode() == PacingMode::AUDIO_CLOCK)
+					{
+						printf("FPS: %d (audio rate %.4f)\n", fps, EMU::GetAPU()->GetRateRatio());
+					}
+					else
+					{
+						printf("FPS: %d\n", fps);
+					}
+
+					EMU::GetEMU()->PrintRunAheadStats();
+					EMU::GetCPU()->GetIdleLoopDetector().PrintStats();
+					EMU::GetCPU()->GetJit().PrintStats();
+				}
+
+				frame_count++;
+				prev_frame_time = EMU::GetEMU()->GetTicks();
 			}
 
-			frame_count++;
-			prev_frame_time = EMU::GetWindow()->GetTicks();
-
 		}
 		else
 		{
@@ -146,3 +185,23 @@ void PPU::TICK_HBLANK()
 		line_ticks = 0;
 	}
 }
+
+void PPU::SaveState(StateWriter& writer) const
+{
+	// Host frame pacing and the output video buffer are not machine state
+	writer.BeginSection(StateSection::PPU);
+	writer.Write(current_frame);
+	writer.Write(line_ticks);
+	writer.Write(oam);
+	writer.EndSection();
+}
+
+void PPU::LoadState(StateReader& reader)
+{
+	if (reader.BeginSection(StateSection::PPU))
+	{
+		reader.Read(current_frame);
+		reader.Read(line_ticks);
+		reader.Read(oam);
+	}
+}
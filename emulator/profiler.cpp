@@ -0,0 +1,286 @@
+#include "profiler.h"
+#include "call_stack.h"
+#include "Instructions.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <format>
+#include <fstream>
+
+using namespace GB;
+
+namespace
+{
+	// Lines of the hottest PCs and functions in the report
+	constexpr size_t REPORT_TOP_ENTRIES = 50;
+
+	double Percent(u64 part, u64 total)
+	{
+		return total != 0 ? 100.0 * part / total : 0.0;
+	}
+}
+
+Profiler::Profiler()
+{
+	nodes.emplace_back();
+	nodes[0].key = ~0u;
+
+	// Always differs from the first version seen
+	callStackVersion = ~0u;
+}
+
+void Profiler::OnInstruction(u16 opcodeIndex, u32 key, u32 cycles, const ShadowCallStack& callStack)
+{
+	Finish(cycles);
+
+	if (callStack.GetVersion() != callStackVersion)
+	{
+		callStackVersion = callStack.GetVersion();
+		currentNode = FindNode(callStack);
+	}
+
+	bHasPending = true;
+	pendingOpcode = opcodeIndex;
+	pendingKey = key;
+	pendingCycles = cycles;
+	pendingNode = currentNode;
+}
+
+void Profiler::Finish(u32 cycles)
+{
+	if (!bHasPending)
+	{
+		return;
+	}
+
+	bHasPending = false;
+
+	// A state load can move the cycle counter backwards, charge nothing then
+	const u32 elapsed = cycles - pendingCycles;
+	const u64 charged = elapsed < 0x80000000u ? elapsed : 0;
+
+	Counter& opcode = opcodes[pendingOpcode];
+	opcode.executions++;
+	opcode.cycles += charged;
+
+	Counter& address = addresses[pendingKey];
+	address.executions++;
+	address.cycles += charged;
+
+	Counter& self = nodes[pendingNode].self;
+	self.executions++;
+	self.cycles += charged;
+
+	totalExecutions++;
+	totalCycles += charged;
+}
+
+u32 Profiler::FindNode(const ShadowCallStack& callStack)
+{
+	u32 node = 0;
+
+	for (u32 i = 0; i < callStack.GetDepth(); i++)
+	{
+		const CallFrame& frame = callStack.GetFrame(i);
+		const u32 key = (frame.bank << 16) | frame.target;
+
+		auto it = nodes[node].children.find(key);
+		if (it != nodes[node].children.end())
+		{
+			node = it->second;
+			continue;
+		}
+
+		const u32 child = (u32)nodes.size();
+
+		CallNode newNode;
+		newNode.parent = node;
+		newNode.key = key;
+		newNode.bInterrupt = frame.kind == CallKind::INTERRUPT;
+		nodes.push_back(std::move(newNode));
+
+		nodes[node].children.emplace(key, child);
+		node = child;
+	}
+
+	return node;
+}
+
+std::string Profiler::GetNodeName(const CallNode& node) const
+{
+	if (&node == &nodes[0])
+	{
+		return "main";
+	}
+
+	return std::format("{}{:02X}:{:04X}", node.bInterrupt ? "int_" : "", node.key >> 16, node.key & 0xFFFF);
+}
+
+std::string Profiler::GetOpcodeName(u16 opcodeIndex)
+{
+	if (opcodeIndex >= 256)
+	{
+		static const char* shiftNames[] = { "RLC", "RRC", "RL", "RR", "SLA", "SRA", "SWAP", "SRL" };
+		static const char* operandNames[] = { "B", "C", "D", "E", "H", "L", "(HL)", "A" };
+
+		const u8 cbOpcode = opcodeIndex & 0xFF;
+		const u8 bitIndex = (cbOpcode >> 3) & 0b111;
+		const char* operand = operandNames[cbOpcode & 0b111];
+
+		if (cbOpcode < 0x40)
+		{
+			return std::format("{} {}", shiftNames[bitIndex], operand);
+		}
+
+		static const char* bitNames[] = { "BIT", "RES", "SET" };
+		return std::format("{} {},{}", bitNames[(cbOpcode >> 6) - 1], bitIndex, operand);
+	}
+
+	const Instruction* instruction = Instruction::GetInstruction((u8)opcodeIndex);
+	std::string name = instruction->GetInstructionName();
+
+	if (instruction->reg_1 != RegisterType::NONE)
+	{
+		name += " " + instruction->GetReg1Name();
+	}
+
+	if (instruction->reg_2 != RegisterType::NONE)
+	{
+		name += "," + instruction->GetReg2Name();
+	}
+
+	return name;
+}
+
+bool Profiler::WriteReport(const std::filesystem::path& filePath) const
+{
+	std::ofstream out(filePath, std::ios::trunc);
+	if (!out.good())
+	{
+		printf("Profiler: failed to write %s\n", filePath.string().c_str());
+		return false;
+	}
+
+	out << std::format("{} instructions, {} T-cycles\n\n", totalExecutions, totalCycles);
+
+	// Opcodes, all that ran
+	std::vector<u16> opcodeOrder;
+	for (u16 i = 0; i < PROFILER_OPCODES; i++)
+	{
+		if (opcodes[i].executions != 0)
+		{
+			opcodeOrder.push_back(i);
+		}
+	}
+
+	std::sort(opcodeOrder.begin(), opcodeOrder.end(), [this](u16 a, u16 b) { return opcodes[a].cycles > opcodes[b].cycles; });
+
+	out << "Opcodes by cycles\n";
+	out << std::format("{:>8}  {:<16} {:>14} {:>16} {:>7}\n", "opcode", "instruction", "executions", "cycles", "%");
+
+	for (u16 i : opcodeOrder)
+	{
+		const std::string opcode = i >= 256 ? std::format("CB {:02X}", i & 0xFF) : std::format("{:02X}", i);
+		out << std::format("{:>8}  {:<16} {:>14} {:>16} {:>6.2f}%\n", opcode, GetOpcodeName(i),
+						   opcodes[i].executions, opcodes[i].cycles, Percent(opcodes[i].cycles, totalCycles));
+	}
+
+	// Hottest addresses
+	std::vector<std::pair<u32, Counter>> addressOrder(addresses.begin(), addresses.end());
+	std::sort(addressOrder.begin(), addressOrder.end(), [](const auto& a, const auto& b) { return a.second.cycles > b.second.cycles; });
+	addressOrder.resize(std::min(addressOrder.size(), REPORT_TOP_ENTRIES));
+
+	out << "\nAddresses by cycles\n";
+	out << std::format("{:>8}  {:>14} {:>16} {:>7}\n", "bank:pc", "executions", "cycles", "%");
+
+	for (const auto& [key, counter] : addressOrder)
+	{
+		out << std::format("{:02X}:{:04X}  {:>14} {:>16} {:>6.2f}%\n", key >> 16, key & 0xFFFF,
+						   counter.executions, counter.cycles, Percent(counter.cycles, totalCycles));
+	}
+
+	// Functions: self is what ran in them directly, total includes their callees.
+	// Nodes are created after their parents, so walking backwards sums callees first.
+	std::vector<u64> nodeTotal(nodes.size());
+	for (size_t i = nodes.size(); i-- > 0;)
+	{
+		nodeTotal[i] += nodes[i].self.cycles;
+		if (i != 0)
+		{
+			nodeTotal[nodes[i].parent] += nodeTotal[i];
+		}
+	}
+
+	struct FunctionCounter
+	{
+		u64 self = 0;
+		u64 total = 0;
+		std::string name;
+	};
+
+	std::unordered_map<u32, FunctionCounter> functions;
+
+	for (size_t i = 0; i < nodes.size(); i++)
+	{
+		FunctionCounter& function = functions[nodes[i].key];
+		function.name = GetNodeName(nodes[i]);
+		function.self += nodes[i].self.cycles;
+
+		// Recursive paths count only the outermost call towards the total
+		bool bNested = false;
+		for (u32 parent = nodes[i].parent; i != 0 && parent != 0 && !bNested; parent = nodes[parent].parent)
+		{
+			bNested = nodes[parent].key == nodes[i].key;
+		}
+
+		if (!bNested)
+		{
+			function.total += nodeTotal[i];
+		}
+	}
+
+	std::vector<FunctionCounter> functionOrder;
+	for (const auto& [key, function] : functions)
+	{
+		functionOrder.push_back(function);
+	}
+
+	std::sort(functionOrder.begin(), functionOrder.end(), [](const auto& a, const auto& b) { return a.total > b.total; });
+	functionOrder.resize(std::min(functionOrder.size(), REPORT_TOP_ENTRIES));
+
+	out << "\nFunctions by total cycles (needs the call stack)\n";
+	out << std::format("{:>12}  {:>16} {:>7}  {:>16} {:>7}\n", "function", "total", "%", "self", "%");
+
+	for (const FunctionCounter& function : functionOrder)
+	{
+		out << std::format("{:>12}  {:>16} {:>6.2f}%  {:>16} {:>6.2f}%\n", function.name,
+						   function.total, Percent(function.total, totalCycles), function.self, Percent(function.self, totalCycles));
+	}
+
+	return true;
+}
+
+bool Profiler::WriteFoldedStacks(const std::filesystem::path& filePath) const
+{
+	std::ofstream out(filePath, std::ios::trunc);
+	if (!out.good())
+	{
+		printf("Profiler: failed to write %s\n", filePath.string().c_str());
+		return false;
+	}
+
+	// Parents always come first, so their paths are known by the time a child needs one
+	std::vector<std::string> paths(nodes.size());
+
+	for (size_t i = 0; i < nodes.size(); i++)
+	{
+		paths[i] = i == 0 ? GetNodeName(nodes[i]) : paths[nodes[i].parent] + ";" + GetNodeName(nodes[i]);
+
+		if (nodes[i].self.cycles != 0)
+		{
+			out << paths[i] << " " << nodes[i].self.cycles << "\n";
+		}
+	}
+
+	return true;
+}
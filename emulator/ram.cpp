@@ -1,20 +1,19 @@
 
 #include "ram.h"
+#include "save_state.h"
 
 using namespace GB;
 
 void RAM::WriteWRAM_Byte(u16 address, u8 value)
 {
 	u16 translatedAddress = address - RAM_ADDR::WRAM_START;
-	if (translatedAddress < RAM_ADDR::WRAM_BANK_SIZE)
-	{
-		WRAM_Bank_0[translatedAddress] = value;
-	}
-	else
+	if (translatedAddress >= RAM_ADDR::WRAM_BANK_SIZE)
 	{
-		translatedAddress -= RAM_ADDR::WRAM_BANK_SIZE;
-		WRAM_Banks_1_7[currentWRAMBank][translatedAddress] = value;
+		translatedAddress += currentWRAMBank * RAM_ADDR::WRAM_BANK_SIZE;
 	}
+
+	WRAM.Write(translatedAddress, value);
+	WRAM_DirtyPages.Mark(translatedAddress);
 }
 
 u8 RAM::ReadWRAM_Byte(u16 address)
@@ -22,23 +21,23 @@ u8 RAM::ReadWRAM_Byte(u16 address)
 	u16 translatedAddress = address - RAM_ADDR::WRAM_START;
 	if (translatedAddress < RAM_ADDR::WRAM_BANK_SIZE)
 	{
-		return WRAM_Bank_0[translatedAddress];
+		return WRAM.Read(translatedAddress);
 	}
 
-	translatedAddress -= RAM_ADDR::WRAM_BANK_SIZE;
-	return WRAM_Banks_1_7[currentWRAMBank][translatedAddress];
+	return WRAM.Read(translatedAddress + currentWRAMBank * RAM_ADDR::WRAM_BANK_SIZE);
 }
 
 void RAM::WriteVRAM_Byte(u16 address, u8 value)
 {
-	const u16 translatedAddress = address - RAM_ADDR::VRAM_START;
-	VRAM_Banks[currentVRAMBank][translatedAddress] = value;
+	const u16 translatedAddress = address - RAM_ADDR::VRAM_START + currentVRAMBank * RAM_ADDR::VRAM_BANK_SIZE;
+	VRAM.Write(translatedAddress, value);
+	VRAM_DirtyPages.Mark(translatedAddress);
 }
 
 u8 RAM::ReadVRAM_Byte(u16 address)
 {
 	const u16 translatedAddress = address - RAM_ADDR::VRAM_START;
-	return VRAM_Banks[currentVRAMBank][translatedAddress];
+	return VRAM.Read(translatedAddress + currentVRAMBank * RAM_ADDR::VRAM_BANK_SIZE);
 }
 
 void RAM::WriteEXT_RAM_Byte(u16 address, u8 value)
@@ -55,6 +54,7 @@ void RAM::WriteHRAM_Byte(u16 address, u8 value)
 {
 	const u16 translatedAddress = address - RAM_ADDR::HRAM_START;
 	HRAM_Mem[translatedAddress] = value;
+	HRAM_DirtyPages.Mark(translatedAddress);
 }
 
 u8 RAM::ReadHRAM_Byte(u16 address)
@@ -63,6 +63,13 @@ u8 RAM::ReadHRAM_Byte(u16 address)
 	return HRAM_Mem[translatedAddress];
 }
 
+void RAM::ClearDirtyPages()
+{
+	WRAM_DirtyPages.Clear();
+	VRAM_DirtyPages.Clear();
+	HRAM_DirtyPages.Clear();
+}
+
 bool RAM::IsWRAM_Addr(u16 address)
 {
 	return address >= RAM_ADDR::WRAM_START && address <= RAM_ADDR::WRAM_END;
@@ -77,3 +84,50 @@ bool RAM::IsHRAM_Addr(u16 address)
 {
 	return address >= RAM_ADDR::HRAM_START && address <= RAM_ADDR::HRAM_END;
 }
+
+void RAM::SaveState(StateWriter& writer) const
+{
+	// Same byte layout as the flat banks this used to be
+	writer.BeginSection(StateSection::RAM);
+
+	for (u32 page = 0; page < WRAM.PAGE_COUNT; page++)
+	{
+		writer.WriteBytes(WRAM.GetPage(page), WRAM.PAGE_SIZE);
+	}
+
+	writer.Write(currentWRAMBank);
+
+	for (u32 page = 0; page < VRAM.PAGE_COUNT; page++)
+	{
+		writer.WriteBytes(VRAM.GetPage(page), VRAM.PAGE_SIZE);
+	}
+
+	writer.Write(currentVRAMBank);
+	writer.Write(HRAM_Mem);
+	writer.EndSection();
+}
+
+void RAM::LoadState(StateReader& reader)
+{
+	if (reader.BeginSection(StateSection::RAM))
+	{
+		for (u32 page = 0; page < WRAM.PAGE_COUNT; page++)
+		{
+			reader.ReadBytes(WRAM.GetWritablePage(page), WRAM.PAGE_SIZE);
+		}
+
+		reader.Read(currentWRAMBank);
+
+		for (u32 page = 0; page < VRAM.PAGE_COUNT; page++)
+		{
+			reader.ReadBytes(VRAM.GetWritablePage(page), VRAM.PAGE_SIZE);
+		}
+
+		reader.Read(currentVRAMBank);
+		reader.Read(HRAM_Mem);
+
+		WRAM_DirtyPages.MarkAll();
+		VRAM_DirtyPages.MarkAll();
+		HRAM_DirtyPages.MarkAll();
+	}
+}
@@ -0,0 +1,193 @@
+#include "reference_log.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace GB;
+
+namespace
+{
+	// Length without the line break, CRLF logs work as well
+	u32 GetLineLength(const char* line, size_t available, size_t& next)
+	{
+		const char* end = (const char*)std::memchr(line, '\n', available);
+		size_t length = end ? end - line : available;
+
+		next = end ? length + 1 : length;
+
+		if (length != 0 && line[length - 1] == '\r')
+		{
+			length--;
+		}
+
+		return (u32)length;
+	}
+}
+
+ReferenceLog::~ReferenceLog()
+{
+	Close();
+}
+
+bool ReferenceLog::Open(const std::filesystem::path& filePath)
+{
+	Close();
+
+#if defined(_WIN32)
+	HANDLE file = CreateFileW(filePath.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	LARGE_INTEGER fileSize{};
+
+	if (file == INVALID_HANDLE_VALUE || !GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+	{
+		if (file != INVALID_HANDLE_VALUE)
+		{
+			CloseHandle(file);
+		}
+
+		printf("Compare: failed to open %s\n", filePath.string().c_str());
+		return false;
+	}
+
+	fileHandle = file;
+	mappingHandle = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	data = mappingHandle ? (const char*)MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0) : nullptr;
+	size = (size_t)fileSize.QuadPart;
+#else
+	const int file = open(filePath.string().c_str(), O_RDONLY);
+	struct stat fileStat{};
+
+	if (file < 0 || fstat(file, &fileStat) != 0 || fileStat.st_size == 0)
+	{
+		if (file >= 0)
+		{
+			close(file);
+		}
+
+		printf("Compare: failed to open %s\n", filePath.string().c_str());
+		return false;
+	}
+
+	void* mapping = mmap(nullptr, fileStat.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+	close(file);
+
+	if (mapping != MAP_FAILED)
+	{
+		data = (const char*)mapping;
+		size = fileStat.st_size;
+
+		// Read once front to back
+		madvise(mapping, size, MADV_SEQUENTIAL);
+	}
+#endif
+
+	if (!data)
+	{
+		printf("Compare: failed to map %s\n", filePath.string().c_str());
+		Close();
+		return false;
+	}
+
+	offset = 0;
+	matchedLines = 0;
+
+	return true;
+}
+
+void ReferenceLog::Close()
+{
+#if defined(_WIN32)
+	if (data)
+	{
+		UnmapViewOfFile(data);
+	}
+
+	if (mappingHandle)
+	{
+		CloseHandle(mappingHandle);
+	}
+
+	if (fileHandle)
+	{
+		CloseHandle(fileHandle);
+	}
+
+	fileHandle = nullptr;
+	mappingHandle = nullptr;
+#else
+	if (data)
+	{
+		munmap((void*)data, size);
+	}
+#endif
+
+	data = nullptr;
+	size = 0;
+}
+
+bool ReferenceLog::Check(const TraceRecord& record)
+{
+	if (offset >= size)
+	{
+		printf("Compare: reference log ended, all %llu instructions matched\n", (unsigned long long)matchedLines);
+		return false;
+	}
+
+	const char* expected = data + offset;
+	size_t next = 0;
+	const u32 expectedLength = GetLineLength(expected, size - offset, next);
+
+	char actual[DOCTOR_LINE_LENGTH];
+	const u32 actualLength = FormatDoctorLine(record, actual);
+
+	if (expectedLength != actualLength || std::memcmp(expected, actual, actualLength) != 0)
+	{
+		ReportDivergence(expected, expectedLength, actual, actualLength);
+		return false;
+	}
+
+	recentLines[matchedLines % REFERENCE_CONTEXT_LINES] = offset;
+	matchedLines++;
+	offset += next;
+
+	return true;
+}
+
+void ReferenceLog::ReportDivergence(const char* expected, u32 expectedLength, const char* actual, u32 actualLength) const
+{
+	printf("Compare: diverged at instruction %llu (line %llu of the reference log)\n",
+		   (unsigned long long)matchedLines, (unsigned long long)matchedLines + 1);
+
+	const u64 contextLines = std::min<u64>(matchedLines, REFERENCE_CONTEXT_LINES);
+
+	for (u64 line = matchedLines - contextLines; line < matchedLines; line++)
+	{
+		const size_t lineOffset = recentLines[line % REFERENCE_CONTEXT_LINES];
+		size_t next = 0;
+		const u32 length = GetLineLength(data + lineOffset, size - lineOffset, next);
+
+		printf("           %.*s\n", (int)length, data + lineOffset);
+	}
+
+	printf("expected:  %.*s\n", (int)expectedLength, expected);
+	printf("actual:    %.*s\n", (int)actualLength, actual);
+
+	u32 column = 0;
+	while (column < expectedLength && column < actualLength && expected[column] == actual[column])
+	{
+		column++;
+	}
+
+	printf("           %*s^\n", (int)column, "");
+}
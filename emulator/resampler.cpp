@@ -0,0 +1,103 @@
+#include "resampler.h"
+
+#include <cmath>
+#include <numeric>
+#include <algorithm>
+
+using namespace GB;
+
+void PolyphaseResampler::Init(u32 newInputRate, u32 newOutputRate)
+{
+	inputRate = newInputRate;
+	outputRate = newOutputRate;
+
+	const u32 divisor = std::gcd(inputRate, outputRate);
+	interpolation = outputRate / divisor;
+	decimation = inputRate / divisor;
+
+	inputIndex = 0;
+	phase = 0;
+	historyStart = 0;
+
+	// Leading silence so the first output sample has a full window
+	historyLeft.assign(TAPS_PER_PHASE - 1, 0.0f);
+	historyRight.assign(TAPS_PER_PHASE - 1, 0.0f);
+
+	// Blackman windowed sinc prototype at the interpolated rate, cut off below the lower Nyquist
+	constexpr double pi = 3.14159265358979323846;
+	const u32 length = interpolation * TAPS_PER_PHASE;
+	const double center = (length - 1) / 2.0;
+	const double cutoff = 0.45 / std::max(interpolation, decimation);
+
+	std::vector<double> prototype(length);
+	for (u32 t = 0; t < length; t++)
+	{
+		const double x = t - center;
+		const double sinc = x == 0.0 ? 1.0 : std::sin(2.0 * pi * cutoff * x) / (2.0 * pi * cutoff * x);
+		const double window = 0.42 - 0.5 * std::cos(2.0 * pi * t / (length - 1)) + 0.08 * std::cos(4.0 * pi * t / (length - 1));
+		prototype[t] = 2.0 * cutoff * sinc * window * interpolation;
+	}
+
+	// Phase p uses prototype[p + k * L] on the k-th newest input, stored oldest first
+	coefficients.resize(length);
+	for (u32 p = 0; p < interpolation; p++)
+	{
+		for (u32 w = 0; w < TAPS_PER_PHASE; w++)
+		{
+			coefficients[p * TAPS_PER_PHASE + w] = (float)prototype[p + (TAPS_PER_PHASE - 1 - w) * interpolation];
+		}
+	}
+}
+
+void PolyphaseResampler::Process(const i16* frames, u32 frameCount, std::vector<i16>& output)
+{
+	if (inputRate == outputRate)
+	{
+		output.insert(output.end(), frames, frames + frameCount * 2);
+		return;
+	}
+
+	for (u32 i = 0; i < frameCount; i++)
+	{
+		historyLeft.push_back(frames[i * 2] / 32768.0f);
+		historyRight.push_back(frames[i * 2 + 1] / 32768.0f);
+	}
+
+	const u64 historyEnd = historyStart + historyLeft.size();
+
+	while (inputIndex + TAPS_PER_PHASE <= historyEnd)
+	{
+		const float* taps = &coefficients[phase * TAPS_PER_PHASE];
+		const float* left = &historyLeft[inputIndex - historyStart];
+		const float* right = &historyRight[inputIndex - historyStart];
+
+		// Four independent lanes so the reduction vectorizes without fast-math
+		float laneLeft[4] = {};
+		float laneRight[4] = {};
+
+		for (u32 k = 0; k < TAPS_PER_PHASE; k += 4)
+		{
+			for (u32 lane = 0; lane < 4; lane++)
+			{
+				laneLeft[lane] += taps[k + lane] * left[k + lane];
+				laneRight[lane] += taps[k + lane] * right[k + lane];
+			}
+		}
+
+		const float sumLeft = (laneLeft[0] + laneLeft[1]) + (laneLeft[2] + laneLeft[3]);
+		const float sumRight = (laneRight[0] + laneRight[1]) + (laneRight[2] + laneRight[3]);
+
+		output.push_back((i16)(std::clamp(sumLeft, -1.0f, 1.0f) * 32767.0f));
+		output.push_back((i16)(std::clamp(sumRight, -1.0f, 1.0f) * 32767.0f));
+
+		phase += decimation;
+		inputIndex += phase / interpolation;
+		phase %= interpolation;
+	}
+
+	// Drop history no future output can reach
+	const u64 consumed = std::min<u64>(inputIndex, historyEnd) - historyStart;
+	historyLeft.erase(historyLeft.begin(), historyLeft.begin() + consumed);
+	historyRight.erase(historyRight.begin(), historyRight.begin() + consumed);
+	historyStart += consumed;
+}
@@ -0,0 +1,223 @@
+#include "rewind.h"
+
+#include <cstring>
+#include <algorithm>
+
+using namespace GB;
+
+namespace
+{
+	constexpr u32 MAX_RUN = 0xFFFF;
+
+	u64 LoadXor64(const u8* a, const u8* b)
+	{
+		u64 wordA;
+		u64 wordB;
+		std::memcpy(&wordA, a, sizeof(u64));
+		std::memcpy(&wordB, b, sizeof(u64));
+		return wordA ^ wordB;
+	}
+
+	void AppendU16(std::vector<u8>& out, u16 value)
+	{
+		out.push_back(value & 0xFF);
+		out.push_back(value >> 8);
+	}
+}
+
+void RewindBuffer::Init(u32 memoryBudget, u32 maxSnapshots)
+{
+	ring.assign(memoryBudget, 0);
+	maxRecords = maxSnapshots;
+	Clear();
+}
+
+void RewindBuffer::Clear()
+{
+	head = 0;
+	used = 0;
+	recordCount = 0;
+	latestSize = 0;
+}
+
+void RewindBuffer::Push(const u8* state, u32 size)
+{
+	if (ring.empty())
+	{
+		return;
+	}
+
+	if (latestSize != 0 && latestSize == size)
+	{
+		// Delta that turns the new state back into the previous one
+		EncodeDelta(latest.data(), state, size, scratch);
+
+		const u32 payloadSize = (u32)scratch.size();
+		const u32 recordSize = payloadSize + RECORD_OVERHEAD;
+
+		if (recordSize <= ring.size())
+		{
+			while (used + recordSize > ring.size() || (maxRecords && recordCount >= maxRecords))
+			{
+				EvictOldest();
+			}
+
+			RingWrite(head, &payloadSize, sizeof(u32));
+			RingWrite(head + sizeof(u32), &size, sizeof(u32));
+			RingWrite(head + 2 * sizeof(u32), scratch.data(), payloadSize);
+			RingWrite(head + 2 * sizeof(u32) + payloadSize, &payloadSize, sizeof(u32));
+
+			head = (head + recordSize) % ring.size();
+			used += recordSize;
+			recordCount++;
+		}
+		else
+		{
+			// A single delta larger than the whole budget breaks the chain
+			Clear();
+		}
+	}
+	else if (latestSize != 0)
+	{
+		// State layout changed, older deltas can no longer be applied
+		Clear();
+	}
+
+	if (latest.size() < size)
+	{
+		latest.resize(size);
+	}
+
+	std::memcpy(latest.data(), state, size);
+	latestSize = size;
+}
+
+bool RewindBuffer::Pop(std::vector<u8>& state, u32& size)
+{
+	if (recordCount == 0)
+	{
+		return false;
+	}
+
+	const u32 capacity = (u32)ring.size();
+
+	u32 payloadSize = 0;
+	RingRead((head + capacity - sizeof(u32)) % capacity, &payloadSize, sizeof(u32));
+
+	const u32 recordSize = payloadSize + RECORD_OVERHEAD;
+	const u32 recordStart = (head + capacity - recordSize) % capacity;
+
+	u32 stateSize = 0;
+	RingRead(recordStart + sizeof(u32), &stateSize, sizeof(u32));
+
+	scratch.resize(payloadSize);
+	RingRead(recordStart + 2 * sizeof(u32), scratch.data(), payloadSize);
+
+	ApplyDelta(scratch.data(), payloadSize, latest.data());
+
+	head = recordStart;
+	used -= recordSize;
+	recordCount--;
+
+	if (state.size() < stateSize)
+	{
+		state.resize(stateSize);
+	}
+
+	std::memcpy(state.data(), latest.data(), stateSize);
+	size = stateSize;
+
+	return true;
+}
+
+void RewindBuffer::EncodeDelta(const u8* older, const u8* newer, u32 size, std::vector<u8>& out)
+{
+	// Tokens of [u16 unchanged bytes][u16 changed bytes][changed bytes XOR'd]
+	out.clear();
+
+	u32 i = 0;
+	while (i < size)
+	{
+		const u32 zeroStart = i;
+
+		while (i + sizeof(u64) <= size && i - zeroStart + sizeof(u64) <= MAX_RUN && LoadXor64(older + i, newer + i) == 0)
+		{
+			i += sizeof(u64);
+		}
+
+		while (i < size && i - zeroStart < MAX_RUN && older[i] == newer[i])
+		{
+			i++;
+		}
+
+		const u32 literalStart = i;
+
+		while (i < size && i - literalStart < MAX_RUN && older[i] != newer[i])
+		{
+			i++;
+		}
+
+		AppendU16(out, (u16)(literalStart - zeroStart));
+		AppendU16(out, (u16)(i - literalStart));
+
+		for (u32 n = literalStart; n < i; n++)
+		{
+			out.push_back(older[n] ^ newer[n]);
+		}
+	}
+}
+
+void RewindBuffer::ApplyDelta(const u8* delta, u32 deltaSize, u8* state)
+{
+	u32 position = 0;
+	u32 read = 0;
+
+	while (read + 4 <= deltaSize)
+	{
+		const u16 zeros = delta[read] | (delta[read + 1] << 8);
+		const u16 literals = delta[read + 2] | (delta[read + 3] << 8);
+		read += 4;
+
+		position += zeros;
+
+		for (u16 n = 0; n < literals; n++)
+		{
+			state[position + n] ^= delta[read + n];
+		}
+
+		position += literals;
+		read += literals;
+	}
+}
+
+void RewindBuffer::EvictOldest()
+{
+	const u32 capacity = (u32)ring.size();
+	const u32 tail = (head + capacity - used) % capacity;
+
+	u32 payloadSize = 0;
+	RingRead(tail, &payloadSize, sizeof(u32));
+
+	used -= payloadSize + RECORD_OVERHEAD;
+	recordCount--;
+}
+
+void RewindBuffer::RingWrite(u32 position, const void* data, u32 size)
+{
+	const u32 capacity = (u32)ring.size();
+	position %= capacity;
+
+	const u32 firstPart = std::min(size, capacity - position);
+	std::memcpy(ring.data() + position, data, firstPart);
+	std::memcpy(ring.data(), (const u8*)data + firstPart, size - firstPart);
+}
+
+void RewindBuffer::RingRead(u32 position, void* data, u32 size) const
+{
+	const u32 capacity = (u32)ring.size();
+	position %= capacity;
+
+	const u32 firstPart = std::min(size, capacity - position);
+	std::memcpy(data, ring.data() + position, firstPart);
+	std::memcpy((u8*)data + firstPart, ring.data(), size - firstPart);
+}
@@ -0,0 +1,126 @@
+#include "save_state.h"
+
+using namespace GB;
+
+StateWriter::StateWriter(std::vector<u8>& blob, u16 romChecksum) : blob(blob), romChecksum(romChecksum)
+{
+	position = sizeof(SaveStateHeader);
+	Reserve(position);
+}
+
+void StateWriter::BeginSection(StateSection id)
+{
+	sections[sectionCount++] = { id, position, 0 };
+}
+
+void StateWriter::EndSection()
+{
+	SaveStateSection& section = sections[sectionCount - 1];
+	section.size = position - section.offset;
+}
+
+void StateWriter::WriteBytes(const void* data, u32 size)
+{
+	Reserve(position + size);
+	std::memcpy(blob.data() + position, data, size);
+	position += size;
+}
+
+u32 StateWriter::Finish()
+{
+	const u32 tableOffset = position;
+	WriteBytes(sections.data(), (u32)(sectionCount * sizeof(SaveStateSection)));
+
+	SaveStateHeader header{};
+	header.magic = SAVE_STATE_MAGIC;
+	header.version = SAVE_STATE_VERSION;
+	header.sectionCount = sectionCount;
+	header.tableOffset = tableOffset;
+	header.totalSize = position;
+	header.romChecksum = romChecksum;
+
+	std::memcpy(blob.data(), &header, sizeof(header));
+
+	return position;
+}
+
+void StateWriter::Reserve(u32 size)
+{
+	if (blob.size() < size)
+	{
+		blob.resize(size + size / 2);
+	}
+}
+
+StateReader::StateReader(const u8* data, u32 size) : data(data), size(size)
+{
+}
+
+bool StateReader::IsValid(u16 romChecksum) const
+{
+	if (size < sizeof(SaveStateHeader))
+	{
+		return false;
+	}
+
+	SaveStateHeader header;
+	std::memcpy(&header, data, sizeof(header));
+
+	if (header.magic != SAVE_STATE_MAGIC || header.version > SAVE_STATE_VERSION)
+	{
+		return false;
+	}
+
+	// Subtract instead of add so corrupt offsets cannot wrap around
+	const u32 tableSize = header.sectionCount * (u32)sizeof(SaveStateSection);
+	if (header.totalSize > size || header.tableOffset > header.totalSize || tableSize > header.totalSize - header.tableOffset)
+	{
+		return false;
+	}
+
+	for (u16 i = 0; i < header.sectionCount; i++)
+	{
+		SaveStateSection section;
+		std::memcpy(&section, data + header.tableOffset + i * sizeof(SaveStateSection), sizeof(section));
+
+		if (section.offset > header.totalSize || section.size > header.totalSize - section.offset)
+		{
+			return false;
+		}
+	}
+
+	return header.romChecksum == romChecksum;
+}
+
+bool StateReader::BeginSection(StateSection id)
+{
+	SaveStateHeader header;
+	std::memcpy(&header, data, sizeof(header));
+
+	for (u16 i = 0; i < header.sectionCount; i++)
+	{
+		SaveStateSection section;
+		std::memcpy(&section, data + header.tableOffset + i * sizeof(SaveStateSection), sizeof(section));
+
+		if (section.id == id)
+		{
+			position = section.offset;
+			sectionEnd = section.offset + section.size;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void StateReader::ReadBytes(void* destination, u32 byteCount)
+{
+	if (position + byteCount > sectionEnd)
+	{
+		// Section shorter than expected (older version), leave the rest untouched
+		byteCount = position < sectionEnd ? sectionEnd - position : 0;
+	}
+
+	std::memcpy(destination, data + position, byteCount);
+	position += byteCount;
+}
@@ -1,6 +1,10 @@
 #include <timer.h>
 #include "emu.h"
 #include "cpu.h"
+#include "save_state.h"
+
+#include <algorithm>
+#include <limits>
 
 using namespace GB;
 
@@ -38,6 +42,42 @@ void Timer::Tick(const u32 cycleAmount)
 	}
 }
 
+void Timer::Advance(u32 ticks)
+{
+	const u32 divTicks = divCounter + ticks;
+	div += divTicks / 255;
+	divCounter = divTicks % 255;
+
+	if (tac & (1 << 2))
+	{
+		// Tick(1) increments TIMA on the tick 'counter' reaches 0, then reloads the period
+		const u32 firstIncrement = std::max(counter, 1);
+
+		if (ticks < firstIncrement)
+		{
+			counter -= ticks;
+			return;
+		}
+
+		const u32 period = GetClockPeriod();
+		const u32 afterFirst = ticks - firstIncrement;
+
+		tima += 1 + afterFirst / period;
+		counter = period - afterFirst % period;
+	}
+}
+
+u32 Timer::GetTicksToInterrupt() const
+{
+	if (!(tac & (1 << 2)))
+	{
+		return std::numeric_limits<u32>::max();
+	}
+
+	// The increment that finds TIMA at 0xFF overflows
+	return std::max(counter, 1) + (0xFF - tima) * GetClockPeriod();
+}
+
 void Timer::WriteByte(u16 address, u8 value)
 {
 	switch (address)
@@ -93,13 +133,33 @@ u8 Timer::GetClockFrequency() const
 }
 
 void Timer::UpdateClockFrequency()
+{
+	counter = GetClockPeriod();
+}
+
+i32 Timer::GetClockPeriod() const
 {
 	u8 freq = GetClockFrequency();
 	switch (freq)
 	{
-	case 0: counter = 1024; break;	// freq 4096
-	case 1: counter = 16; break;	// freq 262144
-	case 2: counter = 64; break;	// freq 65536
-	case 3: counter = 256; break;	// freq 16382
+	case 0: return 1024;	// freq 4096
+	case 1: return 16;		// freq 262144
+	case 2: return 64;		// freq 65536
+	default: return 256;	// freq 16382
+	}
+}
+
+void Timer::SaveState(StateWriter& writer) const
+{
+	writer.BeginSection(StateSection::TIMER);
+	writer.Write(*this);
+	writer.EndSection();
+}
+
+void Timer::LoadState(StateReader& reader)
+{
+	if (reader.BeginSection(StateSection::TIMER))
+	{
+		reader.Read(*this);
 	}
 }
@@ -0,0 +1,142 @@
+#include "trace.h"
+
+#include <algorithm>
+
+using namespace GB;
+
+ExecutionTrace::~ExecutionTrace()
+{
+	Stop();
+}
+
+bool ExecutionTrace::Start(const std::filesystem::path& filePath, u16 romChecksum)
+{
+	Stop();
+
+	file = std::fopen(filePath.string().c_str(), "wb");
+	if (!file)
+	{
+		printf("Trace: failed to open %s\n", filePath.string().c_str());
+		return false;
+	}
+
+	const TraceFileHeader header = { TRACE_MAGIC, TRACE_VERSION, (u16)sizeof(TraceRecord), romChecksum, 0 };
+	std::fwrite(&header, sizeof(header), 1, file);
+
+	records.resize(TRACE_RING_RECORDS);
+	head = 0;
+	committed = 0;
+	spilled = 0;
+	bStopRequested = false;
+	bWriteFailed = false;
+
+	writer = std::thread(&ExecutionTrace::WriterThread, this);
+
+	return true;
+}
+
+void ExecutionTrace::Stop()
+{
+	if (!file)
+	{
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		committed = head;
+		bStopRequested = true;
+	}
+
+	signal.notify_all();
+	writer.join();
+
+	std::fclose(file);
+	file = nullptr;
+
+	records.clear();
+	records.shrink_to_fit();
+}
+
+void ExecutionTrace::CommitChunk()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+
+	committed = head;
+	signal.notify_all();
+
+	// The next chunk reuses the slots of the oldest one, which has to be on disk first
+	signal.wait(lock, [this] { return head + TRACE_CHUNK_RECORDS - spilled <= TRACE_RING_RECORDS; });
+}
+
+void ExecutionTrace::WriterThread()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+
+	while (true)
+	{
+		signal.wait(lock, [this] { return committed != spilled || bStopRequested; });
+
+		if (committed == spilled)
+		{
+			break;
+		}
+
+		// Up to the end of the ring, the rest follows on the next iteration
+		const u64 begin = spilled;
+		const u32 slot = begin % TRACE_RING_RECORDS;
+		const u32 count = (u32)std::min<u64>(committed - begin, TRACE_RING_RECORDS - slot);
+
+		// The CPU never writes to slots between 'spilled' and 'committed'
+		lock.unlock();
+		const size_t written = bWriteFailed ? count : std::fwrite(&records[slot], sizeof(TraceRecord), count, file);
+		lock.lock();
+
+		if (written != count)
+		{
+			// Keep draining so the CPU does not block, the file is incomplete anyway
+			printf("Trace: write failed, the trace file is truncated\n");
+			bWriteFailed = true;
+		}
+
+		spilled = begin + count;
+		signal.notify_all();
+	}
+}
+
+u32 GB::FormatDoctorLine(const TraceRecord& record, char* line)
+{
+	static const char hexDigits[] = "0123456789ABCDEF";
+
+	char* out = line;
+
+	auto write = [&out](const char* label, u32 value, u32 digits)
+	{
+		while (*label)
+		{
+			*out++ = *label++;
+		}
+
+		for (u32 i = digits; i-- > 0;)
+		{
+			*out++ = hexDigits[(value >> (i * 4)) & 0xF];
+		}
+	};
+
+	write("A:", record.a, 2);
+	write(" F:", record.f, 2);
+	write(" B:", record.b, 2);
+	write(" C:", record.c, 2);
+	write(" D:", record.d, 2);
+	write(" E:", record.e, 2);
+	write(" H:", record.h, 2);
+	write(" L:", record.l, 2);
+	write(" SP:", record.sp, 4);
+	write(" PC:", record.pc, 4);
+	write(" PCMEM:", record.bytes[0], 2);
+	write(",", record.bytes[1], 2);
+	write(",", record.bytes[2], 2);
+	write(",", record.bytes[3], 2);
+
+	return (u32)(out - line);
+}
@@ -0,0 +1,138 @@
+#include "wav_writer.h"
+
+#include <format>
+
+using namespace GB;
+
+namespace
+{
+	constexpr u16 WAV_CHANNELS = 2;
+	constexpr u16 WAV_BITS_PER_SAMPLE = 16;
+	constexpr u32 WAV_HEADER_SIZE = 44;
+
+	template<typename T>
+	void WriteValue(std::ofstream& file, T value)
+	{
+		file.write((const char*)&value, sizeof(T));
+	}
+}
+
+WavWriter::~WavWriter()
+{
+	Close();
+}
+
+bool WavWriter::Open(const std::filesystem::path& filePath, u32 inputRate, u32 outputRate)
+{
+	// The resampler divides by both
+	if (inputRate == 0 || outputRate == 0)
+	{
+		printf("Invalid WAV sample rate: %u Hz -> %u Hz\n", inputRate, outputRate);
+		return false;
+	}
+
+	file.open(filePath, std::ios::binary | std::ios::trunc);
+
+	if (!file.good())
+	{
+		printf(std::format("Failed to open: {}\n", filePath.string()).c_str());
+		return false;
+	}
+
+	resampler.Init(inputRate, outputRate);
+
+	dataSize = 0;
+	stopRequested = false;
+	WriteHeader(0);
+
+	writerThread = std::thread(&WavWriter::WriterThread, this);
+
+	printf("WAV capture: %s (%u Hz -> %u Hz)\n", filePath.string().c_str(), inputRate, outputRate);
+	return true;
+}
+
+void WavWriter::Push(const i16* frames, u32 frameCount)
+{
+	{
+		std::lock_guard<std::mutex> lock(pendingMutex);
+		pending.insert(pending.end(), frames, frames + frameCount * WAV_CHANNELS);
+	}
+
+	pendingSignal.notify_one();
+}
+
+void WavWriter::Close()
+{
+	if (!writerThread.joinable())
+	{
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(pendingMutex);
+		stopRequested = true;
+	}
+
+	pendingSignal.notify_one();
+	writerThread.join();
+
+	WriteHeader(dataSize);
+	file.close();
+}
+
+void WavWriter::WriterThread()
+{
+	std::vector<i16> block;
+	std::vector<i16> resampled;
+
+	while (true)
+	{
+		bool stopping = false;
+
+		{
+			std::unique_lock<std::mutex> lock(pendingMutex);
+			pendingSignal.wait(lock, [this] { return stopRequested || !pending.empty(); });
+
+			block.swap(pending);
+			stopping = stopRequested;
+		}
+
+		resampled.clear();
+		resampler.Process(block.data(), (u32)block.size() / WAV_CHANNELS, resampled);
+		block.clear();
+
+		file.write((const char*)resampled.data(), resampled.size() * sizeof(i16));
+		dataSize += (u32)(resampled.size() * sizeof(i16));
+
+		if (stopping)
+		{
+			return;
+		}
+	}
+}
+
+void WavWriter::WriteHeader(u32 newDataSize)
+{
+	const u32 sampleRate = resampler.GetOutputRate();
+	const u16 blockAlign = WAV_CHANNELS * WAV_BITS_PER_SAMPLE / 8;
+
+	file.seekp(0);
+
+	file.write("RIFF", 4);
+	WriteValue<u32>(file, WAV_HEADER_SIZE - 8 + newDataSize);
+	file.write("WAVE", 4);
+
+	file.write("fmt ", 4);
+	WriteValue<u32>(file, 16);
+	WriteValue<u16>(file, 1);	// PCM
+	WriteValue<u16>(file, WAV_CHANNELS);
+	WriteValue<u32>(file, sampleRate);
+	WriteValue<u32>(file, sampleRate * blockAlign);
+	WriteValue<u16>(file, blockAlign);
+	WriteValue<u16>(file, WAV_BITS_PER_SAMPLE);
+
+	file.write("data", 4);
+	WriteValue<u32>(file, newDataSize);
+
+	file.seekp(0, std::ios::end);
+}
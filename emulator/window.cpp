@@ -8,12 +8,51 @@
 #include <SDL_ttf.h>
 #include "ram.h"
 #include "bus.h"
+#include "apu.h"
+#include "joypad.h"
+
+#include <algorithm>
 
 using namespace GB;
 
+namespace
+{
+	u8 GetKeyButton(SDL_Keycode key)
+	{
+		switch (key)
+		{
+		case SDLK_RIGHT: return JOYPAD_BUTTON::RIGHT;
+		case SDLK_LEFT: return JOYPAD_BUTTON::LEFT;
+		case SDLK_UP: return JOYPAD_BUTTON::UP;
+		case SDLK_DOWN: return JOYPAD_BUTTON::DOWN;
+		case SDLK_x: return JOYPAD_BUTTON::A;
+		case SDLK_z: return JOYPAD_BUTTON::B;
+		case SDLK_RSHIFT: return JOYPAD_BUTTON::SELECT;
+		case SDLK_RETURN: return JOYPAD_BUTTON::START;
+		default: return 0;
+		}
+	}
+
+	u8 GetControllerButton(u8 button)
+	{
+		switch (button)
+		{
+		case SDL_CONTROLLER_BUTTON_DPAD_RIGHT: return JOYPAD_BUTTON::RIGHT;
+		case SDL_CONTROLLER_BUTTON_DPAD_LEFT: return JOYPAD_BUTTON::LEFT;
+		case SDL_CONTROLLER_BUTTON_DPAD_UP: return JOYPAD_BUTTON::UP;
+		case SDL_CONTROLLER_BUTTON_DPAD_DOWN: return JOYPAD_BUTTON::DOWN;
+		case SDL_CONTROLLER_BUTTON_A: return JOYPAD_BUTTON::A;
+		case SDL_CONTROLLER_BUTTON_B: return JOYPAD_BUTTON::B;
+		case SDL_CONTROLLER_BUTTON_BACK: return JOYPAD_BUTTON::SELECT;
+		case SDL_CONTROLLER_BUTTON_START: return JOYPAD_BUTTON::START;
+		default: return 0;
+		}
+	}
+}
+
 Window::Window()
 {
-	SDL_Init(SDL_INIT_VIDEO);
+	SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO | SDL_INIT_GAMECONTROLLER);
 	printf("SDL INIT\n");
 	TTF_Init();
 	printf("TTF INIT\n");
@@ -47,16 +86,100 @@ Window::Window()
 	SDL_SetWindowPosition(debug_sdlWindow, windowX + mainWindowWidth + 10, windowY);
 }
 
-void Window::HandleEvents()
+void Window::HandleEvents(u32 timeoutMS)
 {
 	SDL_Event sdlEvent;
-	while (SDL_PollEvent(&sdlEvent) > 0)
+	if (SDL_WaitEventTimeout(&sdlEvent, timeoutMS) == 0)
+	{
+		return;
+	}
+
+	do
+	{
+		HandleEvent(sdlEvent);
+	}
+	while (SDL_PollEvent(&sdlEvent) > 0);
+}
+
+void Window::HandleEvent(const SDL_Event& sdlEvent)
+{
+	if (sdlEvent.type == SDL_WINDOWEVENT && sdlEvent.window.event == SDL_WINDOWEVENT_CLOSE)
+	{
+		EMU::GetEMU()->Shutdown();
+	}
+
+	// Command keys act once per press, holding them must not repeat the command
+	const bool bCommandKey = sdlEvent.type == SDL_KEYDOWN && !sdlEvent.key.repeat;
+
+	if (bCommandKey && sdlEvent.key.keysym.sym == SDLK_F5)
 	{
-		if (sdlEvent.type == SDL_WINDOWEVENT && sdlEvent.window.event == SDL_WINDOWEVENT_CLOSE)
+		EMU::GetEMU()->RequestQuickSave();
+	}
+
+	if (bCommandKey && sdlEvent.key.keysym.sym == SDLK_F7)
+	{
+		EMU::GetEMU()->RequestQuickLoad();
+	}
+
+	if (bCommandKey && sdlEvent.key.keysym.sym == SDLK_p)
+	{
+		EMU::GetEMU()->PostCommand({ EMU::GetEMU()->IsPaused() ? EmuCommandType::RESUME : EmuCommandType::PAUSE });
+	}
+
+	if (bCommandKey && sdlEvent.key.keysym.sym == SDLK_n)
+	{
+		EMU::GetEMU()->PostCommand({ EmuCommandType::STEP_FRAME });
+	}
+
+	if (bCommandKey && sdlEvent.key.keysym.sym == SDLK_j)
+	{
+		EMU::GetEMU()->PostCommand({ EmuCommandType::TOGGLE_JIT });
+	}
+
+	if (bCommandKey && sdlEvent.key.keysym.sym == SDLK_t)
+	{
+		EMU::GetEMU()->PostCommand({ EmuCommandType::TOGGLE_TRACE });
+	}
+
+	if (bCommandKey && sdlEvent.key.keysym.sym == SDLK_o)
+	{
+		EMU::GetEMU()->PostCommand({ EmuCommandType::TOGGLE_PROFILER });
+	}
+
+	if ((sdlEvent.type == SDL_KEYDOWN || sdlEvent.type == SDL_KEYUP) && sdlEvent.key.keysym.sym == SDLK_BACKSPACE)
+	{
+		EMU::GetEMU()->SetRewinding(sdlEvent.type == SDL_KEYDOWN);
+	}
+
+	if ((sdlEvent.type == SDL_KEYDOWN || sdlEvent.type == SDL_KEYUP) && !sdlEvent.key.repeat)
+	{
+		const u8 button = GetKeyButton(sdlEvent.key.keysym.sym);
+		if (button != 0)
 		{
-			EMU::GetEMU()->Shutdown();
+			keyboardButtons = sdlEvent.type == SDL_KEYDOWN ? keyboardButtons | button : keyboardButtons & ~button;
+			PublishButtons();
 		}
 	}
+
+	if (sdlEvent.type == SDL_CONTROLLERBUTTONDOWN || sdlEvent.type == SDL_CONTROLLERBUTTONUP)
+	{
+		const u8 button = GetControllerButton(sdlEvent.cbutton.button);
+		if (button != 0)
+		{
+			controllerButtons = sdlEvent.type == SDL_CONTROLLERBUTTONDOWN ? controllerButtons | button : controllerButtons & ~button;
+			PublishButtons();
+		}
+	}
+
+	if (sdlEvent.type == SDL_CONTROLLERDEVICEADDED)
+	{
+		SDL_GameControllerOpen(sdlEvent.cdevice.which);
+	}
+}
+
+void Window::PublishButtons()
+{
+	EMU::GetEMU()->SetHostButtons(keyboardButtons | controllerButtons);
 }
 
 void Window::Delay(u32 MS)
@@ -140,3 +263,41 @@ u32 Window::GetTicks() const
 {
 	return SDL_GetTicks();
 }
+
+bool Window::OpenAudio(AudioRingBuffer& buffer)
+{
+	SDL_AudioSpec desired{};
+	desired.freq = AUDIO_SAMPLE_RATE;
+	desired.format = AUDIO_S16SYS;
+	desired.channels = 2;
+	desired.samples = 512;
+	desired.callback = &Window::AudioCallback;
+	desired.userdata = &buffer;
+
+	SDL_AudioSpec obtained{};
+	audioDevice = SDL_OpenAudioDevice(nullptr, 0, &desired, &obtained, 0);
+
+	if (audioDevice == 0)
+	{
+		printf("Failed to open audio device: %s\n", SDL_GetError());
+		return false;
+	}
+
+	SDL_PauseAudioDevice(audioDevice, 0);
+	printf("AUDIO INIT\n");
+
+	return true;
+}
+
+void Window::AudioCallback(void* userData, u8* stream, int length)
+{
+	AudioRingBuffer* buffer = (AudioRingBuffer*)userData;
+
+	i16* frames = (i16*)stream;
+	const u32 frameCount = length / (2 * sizeof(i16));
+
+	const u32 read = buffer->Pop(frames, frameCount);
+
+	// Underrun, pad with silence
+	std::fill(frames + read * 2, frames + frameCount * 2, 0);
+}
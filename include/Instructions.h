@@ -16,6 +16,9 @@ namespace GB
 
 		static Instruction* GetInstruction(u8 opcode);
 
+		// Immediate bytes following the opcode
+		static u8 GetOperandCount(AddrMode mode);
+
 		std::string GetInstructionName() const;
 
 		std::string GetAddrModeName() const;
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "common.h"
+#include "aot_abi.h"
+
+#include <filesystem>
+#include <memory>
+#include <unordered_map>
+
+namespace GB
+{
+	class CPU;
+
+	// ROM code recompiled ahead of time (see aot/), loaded from a shared library.
+	// Blocks are looked up by (bank, PC) wherever the interpreter would start a new
+	// block, so they run from the very first frame without any warm-up. Code the
+	// generator did not reach keeps being interpreted. While a trace, reference log or
+	// profiler is attached everything is interpreted, as with the JIT.
+	class AotCode
+	{
+
+	public:
+
+		AotCode() = default;
+		~AotCode();
+
+		AotCode(const AotCode&) = delete;
+		AotCode& operator=(const AotCode&) = delete;
+
+	public:
+
+		// Loads the module for the ROM currently in the cartridge. Blocks whose bytes
+		// differ from the loaded ROM are skipped.
+		static std::shared_ptr<const AotCode> Load(const std::filesystem::path& filePath);
+
+		// Runs the block at 'pc' if the module has one. Returns the number of
+		// instructions executed, 0 if the caller should interpret instead.
+		u32 Run(CPU& cpu, u16 pc) const;
+
+		u32 GetBlockCount() const
+		{
+			return (u32)blocks.size();
+		}
+
+	private:
+
+		static bool Step(void* context, u16 pc, u8 opcode, u8 length, u8 operand0, u8 operand1);
+		static bool Complete(void* context, u16 pc, u8 opcode, u8 length, u8 mCycles);
+
+	private:
+
+		void* library = nullptr;
+
+		std::unordered_map<u32, AotBlockFunc> blocks;
+	};
+}
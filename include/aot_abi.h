@@ -0,0 +1,125 @@
+#pragma once
+
+// Interface between the emulator and ROM code recompiled ahead of time by gb_aot.
+// Generated sources include only this header and cpu_ops.h, the module never links
+// against the emulator: everything it needs is called through AotHost.
+
+#include "cpu_ops.h"
+
+#include <cstdint>
+
+#if defined(_WIN32)
+#define GB_AOT_EXPORT extern "C" __declspec(dllexport)
+#else
+#define GB_AOT_EXPORT extern "C" __attribute__((visibility("default")))
+#endif
+
+namespace GB
+{
+	// Bumped whenever a struct below changes, modules built for another version are refused
+	constexpr uint32_t AOT_ABI_VERSION = 2;
+
+	// The CPU's register file, laid out exactly like CPU_Registers (checked in aot.cpp).
+	// Generated code works on it directly for the instructions it emits inline.
+	struct AotRegisters
+	{
+		union
+		{
+			struct
+			{
+				uint8_t F;
+				uint8_t A;
+				uint8_t C, B;
+				uint8_t E, D;
+				uint8_t L, H;
+
+				uint16_t SP;
+				uint16_t PC;
+			};
+
+			// AF BC DE HL SP PC
+			uint16_t words[6];
+		};
+
+		FlagOp flagOp;
+		uint8_t flagA;
+		uint8_t flagB;
+		uint8_t flagCarry;
+
+		// Same as CPU_Registers::SetFlagsLazy
+		void SetFlagsLazy(FlagOp op, uint8_t a, uint8_t b, uint8_t carry)
+		{
+			// INC/DEC keep C, which may itself still be pending
+			if (op == FlagOp::INC || op == FlagOp::DEC)
+			{
+				MaterializeFlags();
+			}
+
+			flagOp = op;
+			flagA = a;
+			flagB = b;
+			flagCarry = carry;
+		}
+
+		void MaterializeFlags()
+		{
+			if (flagOp != FlagOp::NONE)
+			{
+				F = ComputeLazyFlags(F, flagOp, flagA, flagB, flagCarry);
+				flagOp = FlagOp::NONE;
+			}
+		}
+
+		uint8_t GetZeroFlag()
+		{
+			MaterializeFlags();
+			return (F >> 7) & 1;
+		}
+
+		uint8_t GetCarryFlag()
+		{
+			MaterializeFlags();
+			return (F >> 4) & 1;
+		}
+	};
+
+	struct AotHost
+	{
+		// Executes the instruction at 'pc' with its already decoded opcode and
+		// immediates. True if execution continues with the next instruction in the
+		// same block, false if the block has to return to the scheduler.
+		bool (*Step)(void* context, uint16_t pc, uint8_t opcode, uint8_t length, uint8_t operand0, uint8_t operand1);
+
+		// Follows an instruction the generated code carried out itself on AotRegisters,
+		// PC included: charges its M-cycles and handles interrupts as the interpreter
+		// would. Returns the same as Step.
+		bool (*Complete)(void* context, uint16_t pc, uint8_t opcode, uint8_t length, uint8_t mCycles);
+	};
+
+	// Returns the number of instructions executed
+	using AotBlockFunc = uint32_t (*)(const AotHost* host, void* context, AotRegisters* registers);
+
+	struct AotBlock
+	{
+		// (ROM bank << 16) | PC, see BlockCache::MakeKey
+		uint32_t key;
+		// ROM bytes the block was generated from, compared against the loaded ROM
+		uint16_t byteCount;
+		const uint8_t* bytes;
+		AotBlockFunc run;
+	};
+
+	struct AotModule
+	{
+		uint32_t abiVersion;
+		// Cartridge::GetROMChecksum of the source ROM
+		uint16_t romChecksum;
+		uint32_t blockCount;
+		const AotBlock* blocks;
+	};
+
+	// Name of the function every module exports, returning its AotModule
+	constexpr const char* AOT_MODULE_SYMBOL = "GB_GetAotModule";
+
+	using AotGetModuleFunc = const AotModule* (*)();
+}
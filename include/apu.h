@@ -0,0 +1,208 @@
+#pragma once
+
+#include "common.h"
+#include "blip_buffer.h"
+#include "audio_buffer.h"
+
+#include <array>
+
+namespace GB
+{
+	class StateWriter;
+	class StateReader;
+
+	namespace APU_ADDR
+	{
+		constexpr u16 APU_START = 0xFF10;
+		constexpr u16 APU_END = 0xFF3F;
+
+		constexpr u16 NR10 = 0xFF10;
+		constexpr u16 NR14 = 0xFF14;
+		constexpr u16 NR21 = 0xFF16;
+		constexpr u16 NR24 = 0xFF19;
+		constexpr u16 NR30 = 0xFF1A;
+		constexpr u16 NR34 = 0xFF1E;
+		constexpr u16 NR41 = 0xFF20;
+		constexpr u16 NR44 = 0xFF23;
+		constexpr u16 NR50 = 0xFF24;
+		constexpr u16 NR51 = 0xFF25;
+		constexpr u16 NR52 = 0xFF26;
+
+		constexpr u16 WAVE_RAM_START = 0xFF30;
+		constexpr u16 WAVE_RAM_END = 0xFF3F;
+	}
+
+	constexpr u32 AUDIO_SAMPLE_RATE = 48000;
+
+	// 512 Hz frame sequencer
+	constexpr u32 FRAME_SEQUENCER_PERIOD = 8192;
+
+	// Samples are flushed at least this often even if VBlank never comes (LCD off)
+	constexpr u32 APU_MAX_FRAME_CLOCKS = 70224;
+
+	// Dynamic rate control: queued audio the pacing aims for, and the largest
+	// resampling ratio deviation used to steer towards it (0.5%, inaudible)
+	constexpr u32 AUDIO_TARGET_FILL = AUDIO_RING_FRAMES / 2;
+	constexpr double AUDIO_MAX_RATE_DEVIATION = 0.005;
+
+	class WavWriter;
+
+	class APU
+	{
+
+	public:
+
+		APU();
+
+	public:
+
+		u8 ReadByte(u16 address);
+
+		void WriteByte(u16 address, u8 value);
+
+		static bool IsAPU_Addr(u16 address);
+
+		void SaveState(StateWriter& writer) const;
+		void LoadState(StateReader& reader);
+
+		// Synthesizes everything up to the current CPU cycle and hands it to the output ring
+		void EndFrame();
+
+		AudioRingBuffer& GetOutputBuffer()
+		{
+			return outputBuffer;
+		}
+
+		// When enabled the APU paces emulation: each flush blocks until the host has
+		// drained the ring to the target fill, and the resampling ratio is adjusted
+		// so the fill level stays there without waiting most of the time.
+		void SetDynamicRateControl(bool enabled);
+
+		double GetRateRatio() const
+		{
+			return rateRatio;
+		}
+
+		// Every flushed block is also handed to 'writer' (nullptr to stop capturing)
+		void SetCaptureWriter(WavWriter* writer)
+		{
+			captureWriter = writer;
+		}
+
+		// Between these calls flushed samples are discarded instead of output and the
+		// APU does not pace. The blip buffers are not part of a save state, so they are
+		// put back as they were, together with the channel levels and frame position
+		// they were fed, to leave the real output untouched after a rollback.
+		void BeginSpeculation();
+		void EndSpeculation();
+
+	private:
+
+		enum ChannelIndex : u8
+		{
+			SQUARE_1 = 0,
+			SQUARE_2,
+			WAVE,
+			NOISE,
+			CHANNEL_COUNT
+		};
+
+		struct Channel
+		{
+			bool enabled = false;
+			bool dacEnabled = false;
+			bool lengthEnabled = false;
+
+			u16 lengthCounter = 0;
+			u16 frequency = 0;
+
+			// Clocks until the next waveform step
+			u32 timer = 0;
+			// Duty step, wave sample index or unused for noise
+			u8 position = 0;
+
+			u8 volume = 0;
+			u8 envelopeInitial = 0;
+			u8 envelopePace = 0;
+			u8 envelopeTimer = 0;
+			bool envelopeUp = false;
+
+			// Last amplitude handed to the blip buffers
+			float left = 0.0f;
+			float right = 0.0f;
+		};
+
+		struct Sweep
+		{
+			bool enabled = false;
+			u16 shadowFrequency = 0;
+			u8 timer = 0;
+		};
+
+	private:
+
+		// Lazily catches the channels up to 'cycle' (absolute CPU T-cycles)
+		void RunUntil(u32 cycle);
+
+		void RunChannel(u8 index, u32 start, u32 end);
+
+		void ClockFrameSequencer(u32 time);
+
+		void ClockLength();
+		void ClockEnvelope();
+		void ClockSweep();
+
+		u16 CalculateSweepFrequency();
+
+		void Trigger(u8 index, u32 time);
+
+		u32 GetPeriod(u8 index) const;
+
+		u8 GetDigitalOutput(u8 index) const;
+
+		void UpdateOutput(u8 index, u32 time);
+
+		void UpdateAllOutputs(u32 time);
+
+		void FlushSamples();
+
+		void UpdateRateControl();
+
+		void PowerOff();
+
+	private:
+
+		std::array<u8, APU_ADDR::APU_END - APU_ADDR::APU_START + 1> registers{};
+
+		std::array<Channel, CHANNEL_COUNT> channels{};
+		Sweep sweep{};
+
+		u16 lfsr = 0x7FFF;
+
+		bool powered = true;
+
+		u8 frameSequencerStep = 0;
+		u32 frameSequencerTimer = FRAME_SEQUENCER_PERIOD;
+
+		// CPU cycle the channels were last synthesized up to
+		u32 lastCycle = 0;
+		// Clocks elapsed in the current blip frame
+		u32 frameTime = 0;
+
+		bool dynamicRateControl = false;
+		double rateRatio = 1.0;
+
+		WavWriter* captureWriter = nullptr;
+
+		BlipBuffer blipLeft;
+		BlipBuffer blipRight;
+
+		bool speculating = false;
+		BlipBuffer speculationLeft;
+		BlipBuffer speculationRight;
+		std::array<Channel, CHANNEL_COUNT> speculationChannels{};
+		u32 speculationFrameTime = 0;
+
+		AudioRingBuffer outputBuffer;
+	};
+}
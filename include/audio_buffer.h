@@ -0,0 +1,70 @@
+#pragma once
+
+#include "common.h"
+
+#include <array>
+#include <atomic>
+
+namespace GB
+{
+	// Stereo frames held between the APU and the host audio device (~85 ms at 48 kHz)
+	constexpr u32 AUDIO_RING_FRAMES = 4096;
+
+	// Single producer (emulation thread) / single consumer (SDL audio callback)
+	// ring of interleaved stereo i16 frames. Neither side ever blocks or locks.
+	class AudioRingBuffer
+	{
+
+	public:
+
+		AudioRingBuffer() = default;
+
+	public:
+
+		// Producer side. Returns the number of frames actually written.
+		u32 Push(const i16* frames, u32 frameCount);
+
+		// Consumer side. Returns the number of frames actually read.
+		u32 Pop(i16* frames, u32 frameCount);
+
+		u32 GetFramesAvailable() const;
+
+		u32 GetFramesFree() const;
+
+		// Producer side. Sleeps (no spinning) until at most 'maxFrames' are queued
+		// or the ring has been stopped.
+		void WaitForFill(u32 maxFrames) const;
+
+		// Wakes a producer blocked in WaitForFill and keeps it from waiting again, so
+		// the emulation thread can be joined once the consumer is gone
+		void Stop();
+
+		static constexpr u32 GetCapacity()
+		{
+			return AUDIO_RING_FRAMES;
+		}
+
+		// Drops everything queued and wakes a waiting producer. Only safe while the consumer is paused.
+		void Clear();
+
+	private:
+
+		void Wake();
+
+	private:
+
+		static constexpr u32 RING_MASK = AUDIO_RING_FRAMES - 1;
+		static_assert((AUDIO_RING_FRAMES & RING_MASK) == 0, "Ring size must be a power of two");
+
+		std::array<i16, AUDIO_RING_FRAMES * 2> samples{};
+
+		// Free running frame counters, wrapped with RING_MASK on access
+		alignas(64) std::atomic<u32> writePos = 0;
+		alignas(64) std::atomic<u32> readPos = 0;
+
+		// Bumped whenever the producer may stop waiting. WaitForFill sleeps on this instead
+		// of readPos so a Stop between its checks and the wait cannot be missed.
+		std::atomic<u32> wakeSignal = 0;
+		std::atomic<bool> bStopped = false;
+	};
+}
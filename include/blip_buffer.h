@@ -0,0 +1,59 @@
+#pragma once
+
+#include "common.h"
+
+#include <array>
+
+namespace GB
+{
+	// Band-limited step synthesis: amplitude changes are added as deltas at exact
+	// clock timestamps and smeared with a windowed-sinc kernel, so square/noise
+	// edges do not alias no matter how far apart the clock and sample rates are.
+	class BlipBuffer
+	{
+
+	public:
+
+		BlipBuffer() = default;
+
+	public:
+
+		void SetRates(double clockRate, double sampleRate);
+
+		// Adds an amplitude step of 'delta' at 'clockTime' clocks into the current frame
+		void AddDelta(u32 clockTime, float delta);
+
+		// Closes the current frame after 'clockDuration' clocks, making its samples readable
+		void EndFrame(u32 clockDuration);
+
+		u32 GetSamplesAvailable() const;
+
+		// Integrates and removes up to 'count' samples, writing every 'stride'-th float of 'out'
+		u32 ReadSamples(float* out, u32 count, u32 stride);
+
+		void Clear();
+
+	public:
+
+		static constexpr u32 KERNEL_WIDTH = 16;
+		static constexpr u32 PHASE_BITS = 5;
+		static constexpr u32 PHASE_COUNT = 1 << PHASE_BITS;
+
+		// Enough for two full video frames at 48 kHz plus the kernel tail
+		static constexpr u32 BUFFER_SIZE = 4096;
+
+	private:
+
+		static constexpr u32 FRAC_BITS = 32;
+
+		// 32.32 fixed point samples per clock
+		u64 factor = 0;
+		// 32.32 fixed point sample position of clock 0 in the current frame
+		u64 offset = 0;
+
+		float integrator = 0.0f;
+		float highPass = 0.0f;
+
+		std::array<float, BUFFER_SIZE + KERNEL_WIDTH> deltas{};
+	};
+}
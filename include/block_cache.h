@@ -0,0 +1,120 @@
+#pragma once
+
+#include "common.h"
+
+#include <array>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+namespace GB
+{
+	struct Instruction;
+
+	constexpr u32 MAX_BLOCK_INSTRUCTIONS = 32;
+
+	struct DecodedInstr
+	{
+		Instruction* instruction;
+		u16 pc;
+		u8 opcode;
+		u8 length;
+		// Immediate bytes following the opcode, as FetchData reads them through ReadBytePC
+		std::array<u8, 2> operands;
+	};
+
+	// Straight-line run of decoded instructions, ending after the first control flow
+	// instruction. Immutable once built, so copies of the cache (forks) share blocks.
+	struct CodeBlock
+	{
+		u16 startPC;
+		u16 endPC;
+		std::vector<DecodedInstr> instructions;
+	};
+
+	// Decoded basic blocks keyed by (ROM bank, PC). Executing straight-line code only
+	// advances a cursor through the current block, without going through the bus or
+	// the instruction table. Blocks built from RAM mark their pages on the bus, whose
+	// writes then invalidate them.
+	class BlockCache
+	{
+
+	public:
+
+		BlockCache() = default;
+
+	public:
+
+		void SetEnabled(bool bEnabled);
+
+		// The decoded instruction at 'pc', building its block on a miss.
+		// Null if disabled or 'pc' does not point at cacheable memory.
+		const DecodedInstr* Fetch(u16 pc)
+		{
+			if (currentBlock && cursor < currentBlock->instructions.size() && currentBlock->instructions[cursor].pc == pc)
+			{
+				return &currentBlock->instructions[cursor++];
+			}
+
+			return FetchSlow(pc);
+		}
+
+		// True if 'pc' continues the block the cursor is in
+		bool IsNext(u16 pc) const
+		{
+			return currentBlock && cursor < currentBlock->instructions.size() && currentBlock->instructions[cursor].pc == pc;
+		}
+
+		// The block starting at 'pc', building it on a miss. Null if disabled or
+		// 'pc' does not point at cacheable memory. Does not move the cursor.
+		std::shared_ptr<const CodeBlock> GetBlock(u16 pc);
+
+		// The cached block for 'key' without building it, null if there is none
+		std::shared_ptr<const CodeBlock> FindBlock(u32 key) const;
+
+		// Bumped whenever blocks are dropped or the ROM bank mapping may have changed.
+		// Anything holding on to blocks revalidates them when it moves.
+		u32 GetGeneration() const
+		{
+			return generation;
+		}
+
+		// Memory in 'page' (address >> 8) was written
+		void InvalidatePage(u8 page);
+
+		// RAM changed wholesale, e.g. after loading a state. ROM blocks stay valid.
+		void InvalidateRAMCode();
+
+		// The ROM bank mapping may have changed, look the next block up again
+		void ResetCursor()
+		{
+			currentBlock.reset();
+			generation++;
+		}
+
+		void Clear();
+
+		// (bank, PC) of the code at 'pc' under the current mapping
+		static u32 MakeKey(u16 pc);
+
+	private:
+
+		const DecodedInstr* FetchSlow(u16 pc);
+
+		std::shared_ptr<const CodeBlock> BuildBlock(u16 pc) const;
+
+	private:
+
+		bool bIsEnabled = true;
+
+		std::unordered_map<u32, std::shared_ptr<const CodeBlock>> blocks;
+
+		// Keys of the RAM blocks overlapping each page
+		std::array<std::vector<u32>, 256> pageBlocks;
+
+		std::shared_ptr<const CodeBlock> currentBlock;
+		u32 cursor = 0;
+
+		u32 generation = 0;
+	};
+}
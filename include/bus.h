@@ -3,9 +3,13 @@
 #include "common.h"
 
 #include <memory>
+#include <array>
 
 namespace GB
 {
+	class StateWriter;
+	class StateReader;
+
 	class MEM_BUS
 	{
 	public:
@@ -26,11 +30,37 @@ namespace GB
 
 		bool DMA_TransferActive() const;
 
+		// Bumped by every write and by reads of registers that change between
+		// scheduled PPU/timer events (P1, DIV, TIMA, APU). Not machine state.
+		u32 GetSideEffectCount() const
+		{
+			return sideEffectCount;
+		}
+
+		// Pages (address >> 8) holding cached code, writes to them invalidate the
+		// CPU's block cache. Not machine state.
+		void MarkCodePage(u8 page)
+		{
+			codePages[page] = 1;
+		}
+
+		void ClearCodePage(u8 page)
+		{
+			codePages[page] = 0;
+		}
+
+		void SaveState(StateWriter& writer) const;
+		void LoadState(StateReader& reader);
+
 	private:
 
 		bool dmaTransferActive = false;
 		u8 dmaCurrentByte = 0;
 		u8 dmaValue = 0;
 		u8 dmaStartDelay = 0;
+
+		mutable u32 sideEffectCount = 0;
+
+		std::array<u8, 256> codePages{};
 	};
 }
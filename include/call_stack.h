@@ -0,0 +1,121 @@
+#pragma once
+
+#include "common.h"
+
+#include <array>
+
+namespace GB
+{
+	// Deepest nesting tracked, deeper calls push the outermost frames out
+	constexpr u32 SHADOW_STACK_CAPACITY = 64;
+
+	enum class CallKind : u8
+	{
+		CALL,
+		RST,
+		INTERRUPT
+	};
+
+	struct CallFrame
+	{
+		// Called address or interrupt vector
+		u16 target;
+		u16 returnAddress;
+		// SP after the return address was pushed, the RET that pops it sees the same SP
+		u16 sp;
+		CallKind kind;
+		// ROM bank of 'target', filled in by the stack
+		u8 bank;
+	};
+
+	// The calls the CPU is currently inside of, for the debugger and the profiler.
+	// Fixed size and off by default, a disabled stack costs one branch per
+	// CALL/RST/RET and interrupt. Games that move SP themselves (LD SP, tail calls
+	// through JP, RET used as a jump) are followed by dropping every frame whose
+	// return address lies below the current SP.
+	class ShadowCallStack
+	{
+
+	public:
+
+		ShadowCallStack() = default;
+
+	public:
+
+		void SetEnabled(bool bEnabled)
+		{
+			bIsEnabled = bEnabled;
+			Clear();
+		}
+
+		bool IsEnabled() const
+		{
+			return bIsEnabled;
+		}
+
+		void OnCall(u16 target, u16 returnAddress, u16 sp, CallKind kind)
+		{
+			if (bIsEnabled)
+			{
+				Push({ target, returnAddress, sp, kind, 0 });
+			}
+		}
+
+		// 'sp' as seen by RET/RETI, before popping
+		void OnReturn(u16 sp)
+		{
+			if (bIsEnabled)
+			{
+				Pop(sp);
+			}
+		}
+
+		// After an instruction loaded SP directly
+		void OnStackPointerSet(u16 sp)
+		{
+			if (bIsEnabled)
+			{
+				DropBelow(sp);
+			}
+		}
+
+		void Clear();
+
+		u32 GetDepth() const
+		{
+			return depth;
+		}
+
+		// 0 is the outermost frame
+		const CallFrame& GetFrame(u32 index) const
+		{
+			return frames[index];
+		}
+
+		// Changes whenever frames are pushed or dropped, cheap to compare against
+		u32 GetVersion() const
+		{
+			return version;
+		}
+
+		// Innermost frame first
+		void Print() const;
+
+	private:
+
+		void Push(const CallFrame& frame);
+		void Pop(u16 sp);
+		void DropBelow(u16 sp);
+
+	private:
+
+		bool bIsEnabled = false;
+
+		std::array<CallFrame, SHADOW_STACK_CAPACITY> frames{};
+		u32 depth = 0;
+		u32 version = 0;
+
+		// Frames pushed out at the bottom since the last Clear
+		u32 lostFrames = 0;
+	};
+}
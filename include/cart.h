@@ -1,13 +1,19 @@
 #pragma once
 
 #include "common.h"
+#include "cow_memory.h"
+#include "dirty_pages.h"
 
 #include <string>
 #include <array>
 #include <filesystem>
+#include <memory>
 
 namespace GB
 {
+	class StateWriter;
+	class StateReader;
+
 	namespace RAM_ADDR
 	{
 		// EXT RAM
@@ -54,6 +60,8 @@ namespace GB
 	{
 	public:
 
+		static constexpr u8 MAX_EXT_RAM_BANKS = 16;
+
 		Cartridge() = default;
 
 	public:
@@ -68,6 +76,30 @@ namespace GB
 
 		static bool IsEXT_RAM_Addr(u16 address);
 
+		u16 GetROMChecksum() const;
+
+		// Bank mapped at 0x4000-0x7FFF. Always 1 until an MBC is emulated.
+		u8 GetRomBank() const
+		{
+			return 1;
+		}
+
+		void SaveState(StateWriter& writer) const;
+		void LoadState(StateReader& reader);
+
+		// Offsets cover all EXT RAM banks
+		using EXT_RAM_Dirty = DirtyPages<MAX_EXT_RAM_BANKS * RAM_ADDR::EXT_RAM_BANK_SIZE>;
+
+		const EXT_RAM_Dirty& GetEXT_RAM_DirtyPages() const
+		{
+			return EXT_RAM_DirtyPages;
+		}
+
+		void ClearDirtyPages()
+		{
+			EXT_RAM_DirtyPages.Clear();
+		}
+
 	private:
 
 		bool ValidateChecksum() const;
@@ -76,14 +108,16 @@ namespace GB
 
 	private:
 
-		std::vector<char> romData;
+		// Never written after Load, forked machines share the image
+		std::shared_ptr<std::vector<char>> romData;
 		ROM_Header* header = nullptr;
 
-		using EXT_RAM_BANK = std::array<u8, RAM_ADDR::EXT_RAM_BANK_SIZE>;
-
 		bool extRamEnabled = false;
 		u8 currentExtRamBank = 0;
-		std::array<EXT_RAM_BANK, 16> EXT_RAM_Banks;
+
+		// Shared copy-on-write with forked machines
+		CowMemory<COW_PAGE_SIZE, MAX_EXT_RAM_BANKS * RAM_ADDR::EXT_RAM_BANK_SIZE / COW_PAGE_SIZE> EXT_RAM;
+		EXT_RAM_Dirty EXT_RAM_DirtyPages;
 
 	};
 }
@@ -16,7 +16,7 @@ using i16 = int16_t;
 using i32 = int32_t;
 using i64 = int64_t;
 
-#define BIT(a, n) ((a & (1 << n)) ? 1 : 0)
+#define BIT(a, n) (((a) & (1 << (n))) ? 1 : 0)
 
 #define BIT_SET(a, n, on) (on ? (a) |= (1 << n) : (a) &= ~(1 << n))
 
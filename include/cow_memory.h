@@ -0,0 +1,77 @@
+#pragma once
+
+#include "common.h"
+
+#include <array>
+#include <atomic>
+#include <memory>
+
+namespace GB
+{
+	constexpr u32 COW_PAGE_SIZE = 0x1000;
+
+	// Fixed-size memory split into pages that copies of it share. A page is only
+	// duplicated when a copy writes to it while someone else still holds it, so
+	// copying the whole memory costs one pointer per page.
+	template<u32 PageSize, u32 PageCount>
+	class CowMemory
+	{
+
+	public:
+
+		static constexpr u32 PAGE_SIZE = PageSize;
+		static constexpr u32 PAGE_COUNT = PageCount;
+
+		CowMemory()
+		{
+			for (auto& page : pages)
+			{
+				page = std::make_shared<Page>();
+			}
+		}
+
+	public:
+
+		u8 Read(u32 offset) const
+		{
+			return (*pages[offset / PageSize])[offset % PageSize];
+		}
+
+		void Write(u32 offset, u8 value)
+		{
+			GetWritablePage(offset / PageSize)[offset % PageSize] = value;
+		}
+
+		const u8* GetPage(u32 index) const
+		{
+			return pages[index]->data();
+		}
+
+		// Unshares the page first if another copy still references it
+		u8* GetWritablePage(u32 index)
+		{
+			std::shared_ptr<Page>& page = pages[index];
+
+			// Other owners can only let go concurrently, at worst the page is copied once too often
+			if (page.use_count() != 1)
+			{
+				page = std::make_shared<Page>(*page);
+				return page->data();
+			}
+
+			// Sole owner, but use_count() is a relaxed load: the last reads of a fork
+			// on another thread that just dropped the page are not ordered before our
+			// write. Releasing a shared_ptr decrements with release semantics, the
+			// acquire fence pairs with it.
+			std::atomic_thread_fence(std::memory_order_acquire);
+
+			return page->data();
+		}
+
+	private:
+
+		using Page = std::array<u8, PageSize>;
+
+		std::array<std::shared_ptr<Page>, PageCount> pages;
+	};
+}
@@ -3,11 +3,21 @@
 #include <common.h>
 #include "Instructions.h"
 #include <functional>
-#include <vector>
 #include "cpu_registers.h"
+#include "call_stack.h"
+#include "idle_loop.h"
+#include "block_cache.h"
+#include "jit.h"
+#include "aot.h"
 
 namespace GB
 {
+	class StateWriter;
+	class StateReader;
+	class ExecutionTrace;
+	class ReferenceLog;
+	class Profiler;
+
 	class CPU;
 
 	class CPU
@@ -17,16 +27,45 @@ namespace GB
 
 		CPU();
 
-		bool Step();
+		// Runs one instruction, or a whole compiled block when the JIT has one for
+		// the current PC. 'bSingleInstruction' keeps it to one instruction.
+		bool Step(bool bSingleInstruction = false);
+
+		// Step for an instruction the caller already decoded, see Jit
+		void StepDecoded(const DecodedInstr& decoded);
+
+		// For compiled code that carried out 'decoded' itself on GetRegisters(), PC
+		// included: charges its M-cycles and does what the interpreter does after
+		// every instruction (idle loop detection, interrupts)
+		void CompleteDecoded(const DecodedInstr& decoded, u8 mCycles);
 
 		void Sleep(u32 ms);
 
 	private:
 
 		void FetchInstruction();
+		void LoadDecoded(const DecodedInstr& decoded);
 		void FetchData();
 		void Execute();
 
+		// Everything after the fetch: operands, execution, debug hooks.
+		// 'PC' is the address the instruction was fetched from.
+		void ExecuteInstruction(u16 PC);
+
+		void UpdateInterrupts();
+
+		// Idle loop detection after a taken short backward JR/JP
+		void CheckBackwardJump(u16 PC);
+
+		void TraceInstruction(u16 PC);
+
+		void ProfileInstruction(u16 PC);
+
+		void UpdatePendingInterrupts()
+		{
+			pendingInterrupts = IF_Flags & IE_Flags & 0x1F;
+		}
+
 	private:
 
 		void Instruction_NOP();
@@ -99,6 +138,75 @@ namespace GB
 		void HandleInterrupts();
 		void RequestInterrupt(const IntType type);
 
+		void SaveState(StateWriter& writer) const;
+		void LoadState(StateReader& reader);
+
+		IdleLoopDetector& GetIdleLoopDetector()
+		{
+			return idleLoop;
+		}
+
+		BlockCache& GetBlockCache()
+		{
+			return blockCache;
+		}
+
+		Jit& GetJit()
+		{
+			return jit;
+		}
+
+		ShadowCallStack& GetCallStack()
+		{
+			return callStack;
+		}
+
+		// Owned by the EMU, null while not tracing
+		void SetTrace(ExecutionTrace* newTrace)
+		{
+			trace = newTrace;
+		}
+
+		// Owned by the EMU, null while not comparing
+		void SetReferenceLog(ReferenceLog* newReferenceLog)
+		{
+			referenceLog = newReferenceLog;
+		}
+
+		// Owned by the EMU, null while not profiling
+		void SetProfiler(Profiler* newProfiler)
+		{
+			profiler = newProfiler;
+		}
+
+		// Shared with forks, null to interpret everything
+		void SetAotCode(std::shared_ptr<const AotCode> code)
+		{
+			aotCode = std::move(code);
+		}
+
+		u16 GetPC() const
+		{
+			return registers.PC;
+		}
+
+		CPU_Registers& GetRegisters()
+		{
+			return registers;
+		}
+
+		// Trace, reference log or profiler attached. They look at every instruction
+		// before it runs, so compiled code that skips the interpreter steps aside.
+		bool HasInstructionHooks() const
+		{
+			return trace || referenceLog || profiler;
+		}
+
+		bool IsHalted() const
+		{
+			return halted;
+		}
+
 	private:
 
 		std::string GetInstructionDebugString() const;
@@ -117,16 +225,32 @@ namespace GB
 
 		u8 IF_Flags = 0;
 		u8 IE_Flags = 0;
+		// IF & IE, only recomputed when either changes
+		u8 pendingInterrupts = 0;
 
 		CPU_Registers registers;
 
-		u16 stackCounter = 0;
+		ShadowCallStack callStack;
+
+		ExecutionTrace* trace = nullptr;
+		ReferenceLog* referenceLog = nullptr;
+		Profiler* profiler = nullptr;
 
-		std::vector<u16> stackDebug;
+		IdleLoopDetector idleLoop;
+
+		BlockCache blockCache;
+		// Operands of a cached instruction, ReadBytePC serves them instead of the bus
+		const u8* fetchOperands = nullptr;
+
+		Jit jit;
+		std::shared_ptr<const AotCode> aotCode;
 
 	private:
 
 		bool enableInterrupts = false;
+
+		// Compile time CB handlers, see cpu_cb.cpp
+		friend struct CBInstructions;
 	};
 
 }
\ No newline at end of file
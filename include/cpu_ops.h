@@ -0,0 +1,124 @@
+#pragma once
+
+// Register level semantics of the 8-bit ALU instructions, shared by the interpreter
+// (cpu_proc.cpp) and ROM code recompiled by gb_aot. Generated modules include this
+// next to aot_abi.h, so it depends on nothing but <cstdint>.
+//
+// The templates take any register file with an 'A' member plus SetFlagsLazy and
+// GetCarryFlag, i.e. CPU_Registers or AotRegisters. 8-bit ALU ops always target A.
+
+#include <cstdint>
+
+namespace GB
+{
+	// ALU operation whose Z/N/H/C have not been computed yet
+	enum class FlagOp : uint8_t
+	{
+		NONE,
+		// flagA + flagB + flagCarry
+		ADD,
+		// flagA - flagB - flagCarry, also CP
+		SUB,
+		// AND/OR/XOR: flagA is the result, flagCarry the H flag
+		LOGIC,
+		// flagA is the value before the increment/decrement, C is kept
+		INC,
+		DEC
+	};
+
+	// F after 'op', given the F it was recorded on
+	inline uint8_t ComputeLazyFlags(uint8_t F, FlagOp op, uint8_t a, uint8_t b, uint8_t carry)
+	{
+		auto pack = [](bool zero, bool subtraction, bool halfCarry, bool carryFlag)
+		{
+			return (uint8_t)((zero << 7) | (subtraction << 6) | (halfCarry << 5) | (carryFlag << 4));
+		};
+
+		// Bits 0-3 are never touched
+		const uint8_t lowBits = F & 0x0F;
+		const bool carryFlag = F & 0x10;
+
+		switch (op)
+		{
+		case FlagOp::ADD:
+		{
+			const int sum = a + b + carry;
+			return pack((sum & 0xFF) == 0, false, (a & 0xF) + (b & 0xF) + carry > 0xF, sum > 0xFF) | lowBits;
+		}
+		case FlagOp::SUB:
+		{
+			const int difference = a - b - carry;
+			return pack((difference & 0xFF) == 0, true, (a & 0xF) - (b & 0xF) - carry < 0, difference < 0) | lowBits;
+		}
+		case FlagOp::LOGIC:
+			return pack(a == 0, false, carry != 0, false) | lowBits;
+		case FlagOp::INC:
+			return pack(((a + 1) & 0xFF) == 0, false, (a & 0xF) == 0xF, carryFlag) | lowBits;
+		case FlagOp::DEC:
+			return pack(((a - 1) & 0xFF) == 0, true, (a & 0xF) == 0, carryFlag) | lowBits;
+		default:
+			return F;
+		}
+	}
+
+	// ADD/ADC A, 'carry' is 0 for ADD
+	template <typename Registers>
+	inline void AluAdd(Registers& registers, uint8_t value, uint8_t carry)
+	{
+		const uint8_t a = registers.A;
+		registers.A = (uint8_t)(a + value + carry);
+		registers.SetFlagsLazy(FlagOp::ADD, a, value, carry);
+	}
+
+	// SUB/SBC A, 'carry' is 0 for SUB
+	template <typename Registers>
+	inline void AluSub(Registers& registers, uint8_t value, uint8_t carry)
+	{
+		const uint8_t a = registers.A;
+		registers.A = (uint8_t)(a - value - carry);
+		registers.SetFlagsLazy(FlagOp::SUB, a, value, carry);
+	}
+
+	// Same flags as SUB, without storing the result
+	template <typename Registers>
+	inline void AluCompare(Registers& registers, uint8_t value)
+	{
+		registers.SetFlagsLazy(FlagOp::SUB, registers.A, value, 0);
+	}
+
+	template <typename Registers>
+	inline void AluAnd(Registers& registers, uint8_t value)
+	{
+		registers.A &= value;
+		registers.SetFlagsLazy(FlagOp::LOGIC, registers.A, 0, 1);
+	}
+
+	template <typename Registers>
+	inline void AluOr(Registers& registers, uint8_t value)
+	{
+		registers.A |= value;
+		registers.SetFlagsLazy(FlagOp::LOGIC, registers.A, 0, 0);
+	}
+
+	template <typename Registers>
+	inline void AluXor(Registers& registers, uint8_t value)
+	{
+		registers.A ^= value;
+		registers.SetFlagsLazy(FlagOp::LOGIC, registers.A, 0, 0);
+	}
+
+	// 8-bit INC/DEC of a register or (HL), returns the new value
+	template <typename Registers>
+	inline uint8_t IncByte(Registers& registers, uint8_t value)
+	{
+		registers.SetFlagsLazy(FlagOp::INC, value, 0, 0);
+		return (uint8_t)(value + 1);
+	}
+
+	template <typename Registers>
+	inline uint8_t DecByte(Registers& registers, uint8_t value)
+	{
+		registers.SetFlagsLazy(FlagOp::DEC, value, 0, 0);
+		return (uint8_t)(value - 1);
+	}
+}
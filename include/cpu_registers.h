@@ -1,29 +1,203 @@
 #pragma once
 
 #include "common.h"
+#include "cpu_ops.h"
 #include "Instructions.h"
 
+#include <bit>
+#include <cstring>
+
+// Computes every lazy flag update eagerly as well and reports the first read
+// where both disagree. Debugging only.
+//#define LAZY_FLAGS_LOCKSTEP
+
 namespace GB
 {
+	// Pairs alias their halves through the 16-bit view, which needs the low byte first
+	static_assert(std::endian::native == std::endian::little, "CPU_Registers assumes a little endian host");
+
 	struct CPU_Registers
 	{
-		u8 A, F;
-		u8 B, C;
-		u8 D, E;
-		u8 H, L;
-
-		u16 SP;
-		u16 PC;
-
-	public:
+		// The register file as an indexable array. Each pair is stored low byte first,
+		// so words[0] is AF and bytes[1] is A. F may be stale while a lazy flag update
+		// is pending, read it through Read(RegisterType::F) or the flag getters.
+		union
+		{
+			struct
+			{
+				mutable u8 F;
+				u8 A;
+				u8 C, B;
+				u8 E, D;
+				u8 L, H;
+
+				u16 SP;
+				u16 PC;
+			};
+
+			u8 bytes[12];
+			u16 words[6];
+		};
+
+		mutable FlagOp flagOp;
+		u8 flagA;
+		u8 flagB;
+		u8 flagCarry;
+
+#ifdef LAZY_FLAGS_LOCKSTEP
+		u8 eagerF;
+#endif
 
-		u16 Read(RegisterType type);
+	private:
 
-		void Write(RegisterType type, u16 newValue);
+		// Where a RegisterType lives in 'bytes'. 8-bit registers are read and written
+		// as the 16-bit word starting at them with the upper byte masked off, so both
+		// sizes go through the same load and store.
+		struct RegisterSlot
+		{
+			u8 offset;
+			u16 mask;
+		};
+
+		// Indexed by RegisterType. Only F and AF sit at offset 0, NONE reads as 0 and
+		// ignores writes.
+		static constexpr RegisterSlot REGISTER_SLOTS[] =
+		{
+			{ 8, 0x0000 },	// NONE
+			{ 1, 0x00FF },	// A
+			{ 0, 0x00FF },	// F
+			{ 3, 0x00FF },	// B
+			{ 2, 0x00FF },	// C
+			{ 5, 0x00FF },	// D
+			{ 4, 0x00FF },	// E
+			{ 7, 0x00FF },	// H
+			{ 6, 0x00FF },	// L
+			{ 0, 0xFFFF },	// AF
+			{ 2, 0xFFFF },	// BC
+			{ 4, 0xFFFF },	// DE
+			{ 6, 0xFFFF },	// HL
+			{ 8, 0xFFFF },	// SP
+			{ 10, 0xFFFF }	// PC
+		};
+
+		static constexpr RegisterSlot GetSlot(RegisterType type)
+		{
+			return REGISTER_SLOTS[(u8)type];
+		}
+
+		u16 LoadWord(u8 offset) const
+		{
+			u16 value;
+			std::memcpy(&value, bytes + offset, sizeof(u16));
+			return value;
+		}
+
+		void StoreWord(u8 offset, u16 value)
+		{
+			std::memcpy(bytes + offset, &value, sizeof(u16));
+		}
+
+		void OnFlagsWritten()
+		{
+			flagOp = FlagOp::NONE;
+#ifdef LAZY_FLAGS_LOCKSTEP
+			eagerF = F;
+#endif
+		}
 
-		void Increment(RegisterType type);
+	public:
 
-		void Decrement(RegisterType type);
+		u16 Read(RegisterType type) const
+		{
+			const RegisterSlot slot = GetSlot(type);
+
+			if (slot.offset == 0)
+			{
+				MaterializeFlags();
+			}
+
+			return LoadWord(slot.offset) & slot.mask;
+		}
+
+		void Write(RegisterType type, u16 newValue)
+		{
+			const RegisterSlot slot = GetSlot(type);
+
+			StoreWord(slot.offset, (LoadWord(slot.offset) & ~slot.mask) | (newValue & slot.mask));
+
+			if (slot.offset == 0)
+			{
+				OnFlagsWritten();
+			}
+		}
+
+		void Increment(RegisterType type)
+		{
+			Write(type, Read(type) + 1);
+		}
+
+		void Decrement(RegisterType type)
+		{
+			Write(type, Read(type) - 1);
+		}
+
+		// Compile time variants for handlers that always use the same register,
+		// a single byte or word access
+		template<RegisterType type>
+		u16 Get() const
+		{
+			constexpr RegisterSlot slot = GetSlot(type);
+
+			if constexpr (slot.offset == 0)
+			{
+				MaterializeFlags();
+			}
+
+			if constexpr (slot.mask == 0x00FF)
+			{
+				return bytes[slot.offset];
+			}
+			else if constexpr (slot.mask == 0xFFFF)
+			{
+				return words[slot.offset / 2];
+			}
+			else
+			{
+				return 0;
+			}
+		}
+
+		template<RegisterType type>
+		void Set(u16 newValue)
+		{
+			constexpr RegisterSlot slot = GetSlot(type);
+
+			if constexpr (slot.mask == 0x00FF)
+			{
+				bytes[slot.offset] = newValue & 0xFF;
+			}
+			else if constexpr (slot.mask == 0xFFFF)
+			{
+				words[slot.offset / 2] = newValue;
+			}
+
+			if constexpr (slot.offset == 0 && slot.mask != 0)
+			{
+				OnFlagsWritten();
+			}
+		}
+
+		template<RegisterType type>
+		void Increment()
+		{
+			Set<type>(Get<type>() + 1);
+		}
+
+		template<RegisterType type>
+		void Decrement()
+		{
+			Set<type>(Get<type>() - 1);
+		}
 
 	public:
 
@@ -47,12 +221,28 @@ namespace GB
 
 		u8 GetCarryFlag() const;
 
+		// -1 leaves a flag unchanged
 		void SetFlags(i8 zeroFlag, i8 subtractionFlag, i8 halfCarryFlag, i8 carryFlag);
 
+		// Records the operation instead of its flags, they are computed on the next
+		// read. Most ALU results have their flags overwritten before anything looks.
+		void SetFlagsLazy(FlagOp op, u8 a, u8 b = 0, u8 carry = 0);
+
+		// Folds a pending lazy update into F
+		void MaterializeFlags() const
+		{
+			if (flagOp != FlagOp::NONE)
+			{
+				ResolveFlags();
+			}
+		}
+
 		std::string GetFlagsString() const;
 
 	private:
 
-		void SetFlag(u8 value, u8 bitOffset);
+		void ResolveFlags() const;
+
+		void SetFlag(i8 value, u8 bitOffset);
 	};
 }
\ No newline at end of file
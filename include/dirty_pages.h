@@ -0,0 +1,94 @@
+#pragma once
+
+#include "common.h"
+
+#include <array>
+#include <bit>
+
+namespace GB
+{
+	// One dirty bit per 256-byte page of a memory of 'ByteCount' bytes. Marking is a
+	// single OR so it can sit in the write path. Clearing starts a new epoch, which
+	// lets a consumer tell whether the bits it looked at are still the current ones.
+	template<u32 ByteCount>
+	class DirtyPages
+	{
+
+	public:
+
+		static constexpr u32 PAGE_SIZE = 256;
+		static constexpr u32 PAGE_COUNT = (ByteCount + PAGE_SIZE - 1) / PAGE_SIZE;
+
+	public:
+
+		void Mark(u32 offset)
+		{
+			words[offset / (PAGE_SIZE * 64)] |= u64(1) << (offset / PAGE_SIZE % 64);
+		}
+
+		void MarkAll()
+		{
+			words.fill(~u64(0));
+		}
+
+		bool IsDirty(u32 page) const
+		{
+			return (words[page / 64] >> (page % 64)) & 1;
+		}
+
+		u32 GetDirtyCount() const
+		{
+			u32 count = 0;
+
+			for (u32 i = 0; i < WORD_COUNT; i++)
+			{
+				count += std::popcount(words[i] & GetWordMask(i));
+			}
+
+			return count;
+		}
+
+		// Calls 'function' with the index of every dirty page in ascending order
+		template<typename F>
+		void ForEachDirty(F&& function) const
+		{
+			for (u32 i = 0; i < WORD_COUNT; i++)
+			{
+				u64 word = words[i] & GetWordMask(i);
+
+				while (word != 0)
+				{
+					function(i * 64 + std::countr_zero(word));
+					word &= word - 1;
+				}
+			}
+		}
+
+		u32 GetEpoch() const
+		{
+			return epoch;
+		}
+
+		void Clear()
+		{
+			words.fill(0);
+			epoch++;
+		}
+
+	private:
+
+		static constexpr u32 WORD_COUNT = (PAGE_COUNT + 63) / 64;
+
+		// MarkAll sets bits past the last page, keep them out of queries
+		static constexpr u64 GetWordMask(u32 index)
+		{
+			const u32 pagesInWord = PAGE_COUNT - index * 64;
+			return pagesInWord >= 64 ? ~u64(0) : (u64(1) << pagesInWord) - 1;
+		}
+
+	private:
+
+		std::array<u64, WORD_COUNT> words{};
+		u32 epoch = 0;
+	};
+}
@@ -5,6 +5,13 @@
 #include <memory>
 #include <array>
 #include <thread>
+#include <string>
+#include <chrono>
+#include <vector>
+#include <atomic>
+#include <filesystem>
+#include <mutex>
+#include <condition_variable>
 
 namespace GB
 {
@@ -17,24 +24,145 @@ namespace GB
     class MEM_BUS;
     class LCD;
     class PPU;
+    class APU;
+    class Joypad;
+    class Movie;
+    class WavWriter;
+    class RewindBuffer;
+    class ExecutionTrace;
+    class ReferenceLog;
+    class Profiler;
+
+    enum class EmuCommandType : u8
+    {
+        PAUSE,
+        RESUME,
+        // Runs 'count' instructions, then stays paused
+        STEP_INSTRUCTIONS,
+        // Runs until the next frame boundary, then stays paused
+        STEP_FRAME,
+        RESET,
+        SAVE_STATE,
+        LOAD_STATE,
+        // Switches between the JIT and the interpreter
+        TOGGLE_JIT,
+        // Starts or stops the binary execution trace
+        TOGGLE_TRACE,
+        // Starts or stops the profiler, stopping writes its report
+        TOGGLE_PROFILER
+    };
+
+    struct EmuCommand
+    {
+        EmuCommandType type;
+        u32 count = 0;
+        std::filesystem::path path;
+    };
 
     class EMU
     {
         EMU();
     public:
 
+        // Out of line, the components are only forward declared here
+        ~EMU();
+
+        // The machine active on the calling thread, see SetThreadEMU
         static EMU* GetEMU();
 
+        // Makes GetEMU() and the component accessors return 'emu' on the calling
+        // thread (nullptr for the main machine). Returns the previous one.
+        static EMU* SetThreadEMU(EMU* emu);
+
     public:
 
         int Run(int argc, char** argv);
 
+        // Loads the cartridge and caches the power-on state Reset() restores
+        bool LoadROM(const std::filesystem::path& filePath);
+
+        // Puts the machine back into its post-boot state by loading the cached
+        // snapshot into the existing components: no allocation, no ROM reload.
+        // Same threading rules as LoadState.
+        bool Reset();
+
         void Shutdown();
 
         static void Cycle(u8 amount);
 
+        // Whole M-cycles that can pass before the one in which the PPU or timer
+        // next changes mode, line or raises an interrupt. 0 while DMA is running.
+        static u32 GetIdleMCycles();
+
+        // Same as Cycle(amount) for at most GetIdleMCycles() M-cycles, in O(1)
+        static void Advance(u32 amount);
+
         u32 GetCycles() const;
 
+        PacingMode GetPacingMode() const;
+
+        // Host milliseconds, from SDL when there is a window
+        u32 GetTicks() const;
+
+    public:
+
+        // Serializes the whole machine into 'blob', which is only grown, never shrunk.
+        // Returns the state size in bytes. Must run on the CPU thread between instructions.
+        u32 SaveState(std::vector<u8>& blob) const;
+
+        // Loads a state the machine jumps to (file, rewind, reset). The next frame
+        // boundary is counted from the loaded frame.
+        bool LoadState(const u8* data, u32 size);
+
+        bool SaveStateToFile(const std::filesystem::path& filePath);
+
+        bool LoadStateFromFile(const std::filesystem::path& filePath);
+
+        // Thread safe, performed by the CPU thread before its next instruction.
+        // Wakes the CPU thread up if it is paused.
+        void PostCommand(EmuCommand command);
+
+        void RequestQuickSave();
+        void RequestQuickLoad();
+
+        bool IsPaused() const;
+
+        // Thread safe, while set the CPU thread steps back one snapshot per frame
+        void SetRewinding(bool bEnabled);
+
+        // Thread safe, JOYPAD_BUTTON mask of what the host holds. Latched into the
+        // joypad on the next frame boundary, or replaced by movie playback. Without a
+        // movie P1 reads also sample it directly.
+        void SetHostButtons(u8 buttons);
+
+        // Clones the machine to explore another branch from here. RAM and cartridge
+        // RAM pages are shared copy-on-write and the ROM image is shared, the rest of
+        // the component state is copied. The fork is headless and unpaced. Must be
+        // called on the thread running this machine, between instructions.
+        std::unique_ptr<EMU> Fork() const;
+
+        // Emulates 'frameCount' frames on the calling thread, which must have this
+        // machine active. The host buttons are latched at the start of every frame,
+        // so a fork can be driven with SetHostButtons between calls. False if the
+        // CPU stopped.
+        bool RunFrames(u32 frameCount);
+
+        // True while emulating frames that are never presented: run-ahead frames,
+        // which get rolled back afterwards, and everything a fork runs
+        bool IsSpeculating() const;
+
+        // XRES * YRES pixels of the frame to show. With run-ahead this is the last
+        // speculative frame, otherwise the PPU buffer itself.
+        const u32* GetPresentedFrame() const;
+
+        void PrintRunAheadStats();
+
+        // Runs the compiled block at the current PC, then rewinds and runs the same
+        // instructions in the interpreter. A differing machine state is reported and
+        // the JIT switched off, the interpreter's result is kept either way. Returns
+        // the instructions executed, 0 if there was no compiled block.
+        u32 RunJitLockstep();
+
         static CPU*     GetCPU();
         static MEM_BUS* GetBUS();
         static IO*      GetIO();
@@ -44,6 +172,8 @@ namespace GB
         static LCD*     GetLCD();
         static Cartridge* GetCartridge();
         static PPU*     GetPPU();
+        static APU*     GetAPU();
+        static Joypad*  GetJoypad();
 
     private:
 
@@ -51,6 +181,30 @@ namespace GB
 
         void Delay(u32 MS);
 
+        void ParseOptions(int argc, char** argv);
+
+        void ProcessCommands();
+
+        // LoadState without re-arming the frame loop, for run-ahead and lockstep
+        // rolling back to a state they saved themselves earlier in the same frame
+        bool RestoreState(const u8* data, u32 size);
+
+        void OnFrameBoundary();
+
+        void UpdateRewind();
+
+        void LatchInput();
+
+        void RunAhead();
+
+        bool StartTrace();
+
+        void StopTrace();
+
+        void StartProfiler();
+
+        void StopProfiler();
+
     public:
 
 		void DebugUpdate();
@@ -70,6 +224,15 @@ namespace GB
         std::unique_ptr<LCD> lcd;
         std::unique_ptr<Cartridge> cartridge;
         std::unique_ptr<PPU> ppu;
+        std::unique_ptr<APU> apu;
+        std::unique_ptr<Joypad> joypad;
+
+        std::unique_ptr<WavWriter> wavWriter;
+        std::unique_ptr<RewindBuffer> rewind;
+        std::unique_ptr<Movie> movie;
+        std::unique_ptr<ExecutionTrace> trace;
+        std::unique_ptr<ReferenceLog> referenceLog;
+        std::unique_ptr<Profiler> profiler;
 
         std::array<char, 1024> DebugBuffer{};
         u32 DebugBufferMsgSize = 0;
@@ -77,8 +240,70 @@ namespace GB
 
     private:
 
-		bool bPaused = false;
-		bool bIsRunning = false;
+		PacingMode pacingMode = PacingMode::SLEEP;
+
+		std::string romPath;
+
+		std::vector<u8> stateBuffer;
+
+		// Shared with forks, never modified once captured
+		std::shared_ptr<const std::vector<u8>> powerOnState;
+		u32 powerOnStateSize = 0;
+		std::mutex commandMutex;
+		std::condition_variable commandSignal;
+		std::vector<EmuCommand> commands;
+		std::vector<EmuCommand> processedCommands;
+		std::atomic<bool> bCommandsPending = false;
+
+		u32 stepInstructionsLeft = 0;
+		bool bStepFrame = false;
+
+		u32 rewindSeconds = 0;
+		u32 rewindInterval = 2;
+		u32 rewindBudgetMB = 16;
+		std::vector<u8> rewindState;
+		std::atomic<bool> bRewinding = false;
+		u32 lastFrame = 0;
+		u32 framesSinceSnapshot = 0;
+
+		std::atomic<u8> hostButtons = 0;
+		// Frames latched since power-on, part of the save state so the movie can follow
+		u32 inputFrame = 0;
+		std::string movieRecordPath;
+		std::string moviePlayPath;
+
+		bool bIdleLoops = true;
+		bool bBlockCache = true;
+		bool bJit = false;
+		bool bJitLockstep = false;
+		u32 jitThreshold = 0;
+		std::string aotPath;
+		bool bCallStack = false;
+		std::string tracePath;
+		std::string comparePath;
+		std::string profilePath;
+		std::vector<u8> lockstepState;
+		std::vector<u8> lockstepJitState;
+		std::string idleLoopListPath;
+
+		u32 runAheadFrames = 0;
+		std::vector<u8> runAheadState;
+		std::vector<u32> presentedFrame;
+		bool bSpeculating = false;
+		bool bIsFork = false;
+		u64 runAheadMicros = 0;
+		u32 runAheadCount = 0;
+
+		bool bHeadless = false;
+		u32 maxFrames = 0;
+
+		std::string wavPath;
+		u32 wavRate = 22050;
+
+		std::chrono::steady_clock::time_point startTime;
+
+		std::atomic<bool> bPaused = false;
+		std::atomic<bool> bIsRunning = false;
 		u64 Ticks = 0;
     };
 
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "common.h"
+
+#include <memory>
+#include <functional>
+#include <deque>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+namespace GB
+{
+	class EMU;
+
+	// Runs jobs on forked machines across a fixed set of threads. Each job gets its
+	// machine made active on the worker thread, so it can drive it with RunFrames
+	// and fork it further.
+	class ForkPool
+	{
+
+	public:
+
+		using Job = std::function<void(EMU&)>;
+
+		// 0 threads uses one per hardware thread
+		explicit ForkPool(u32 threadCount = 0);
+		~ForkPool();
+
+	public:
+
+		// Queues 'job' for 'machine', which is destroyed once the job returns
+		void Submit(std::unique_ptr<EMU> machine, Job job);
+
+		// Blocks until every submitted job has finished
+		void Wait();
+
+		u32 GetThreadCount() const
+		{
+			return (u32)workers.size();
+		}
+
+	private:
+
+		void WorkerThread();
+
+	private:
+
+		struct Task
+		{
+			std::unique_ptr<EMU> machine;
+			Job job;
+		};
+
+		std::vector<std::thread> workers;
+
+		std::mutex tasksMutex;
+		std::condition_variable tasksSignal;
+		std::condition_variable idleSignal;
+
+		std::deque<Task> tasks;
+		u32 runningTasks = 0;
+		bool stopRequested = false;
+	};
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include "common.h"
+#include "cpu_registers.h"
+
+#include <filesystem>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace GB
+{
+	// Longest loop body, in bytes from loop head to the jump, that is considered
+	constexpr u16 MAX_IDLE_LOOP_BYTES = 16;
+
+	// Recognizes busy-wait loops and skips their iterations in bulk. A loop qualifies
+	// once two consecutive iterations start from the same loop head with identical
+	// registers and interrupt enable state, took the same number of cycles, and did
+	// no bus write and no read of a register that changes between scheduled events
+	// (see MEM_BUS::GetSideEffectCount). Every further iteration would then repeat
+	// exactly until the next PPU or timer event, so as many whole iterations as fit
+	// before it are skipped with EMU::Advance.
+	class IdleLoopDetector
+	{
+
+	public:
+
+		IdleLoopDetector() = default;
+
+	public:
+
+		// Reads the per-ROM allow/deny list. Lines are
+		//   <ROM checksum hex> deny               never skip for this ROM
+		//   <ROM checksum hex> deny <PC hex>...   never skip these loop heads
+		//   <ROM checksum hex> allow <PC hex>...  only skip these loop heads
+		// '#' starts a comment. ROMs without an entry skip every detected loop.
+		bool LoadConfig(const std::filesystem::path& filePath, u16 romChecksum);
+
+		void SetEnabled(bool bEnabled)
+		{
+			bIsEnabled = bEnabled;
+		}
+
+		bool IsEnabled() const
+		{
+			return bIsEnabled;
+		}
+
+		// Called after a taken jump from 'jumpPC' back to 'target'
+		void OnBackwardJump(u16 target, const CPU_Registers& registers, bool interruptsEnabled);
+
+		// Forget the current candidate, e.g. after loading a state
+		void Reset();
+
+		// Prints and clears the skip statistics, if anything was skipped
+		void PrintStats();
+
+	private:
+
+		bool IsAllowed(u16 loopStart) const;
+
+	private:
+
+		struct RomRules
+		{
+			bool bDenyAll = false;
+			std::unordered_set<u16> allowed;
+			std::unordered_set<u16> denied;
+		};
+
+		bool bIsEnabled = true;
+
+		// Shared by forked CPUs, never modified after LoadConfig
+		std::shared_ptr<const RomRules> rules;
+
+		u16 loopStart = 0;
+		CPU_Registers loopRegisters{};
+		bool loopInterruptsEnabled = false;
+		u32 iterationStartCycle = 0;
+		u32 iterationCycles = 0;
+		u32 sideEffectCount = 0;
+
+		u32 skippedLoops = 0;
+		u64 skippedCycles = 0;
+	};
+}
@@ -7,6 +7,9 @@
 
 namespace GB
 {
+	class StateWriter;
+	class StateReader;
+
 	class IO
 	{
 
@@ -22,6 +25,9 @@ namespace GB
 
 		static bool IsIO_Addr(u16 address);
 
+		void SaveState(StateWriter& writer) const;
+		void LoadState(StateReader& reader);
+
 	private:
 
 		std::array<u8, 2> serialData{};
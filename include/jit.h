@@ -0,0 +1,146 @@
+#pragma once
+
+#include "common.h"
+
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+namespace GB
+{
+	class CPU;
+	struct CPU_Registers;
+	struct CodeBlock;
+	struct DecodedInstr;
+
+	// Executions of a block before it is compiled
+	constexpr u32 JIT_DEFAULT_HOT_THRESHOLD = 32;
+
+	// Executable memory per CPU, everything is dropped once it is full
+	constexpr u32 JIT_ARENA_SIZE = 4 * 1024 * 1024;
+
+	// Translates hot blocks from the BlockCache into x86-64. Register loads, 8-bit
+	// ALU ops (flags stay lazy, see FlagOp), INC/DEC and JR/JP are emitted as native
+	// code working on CPU_Registers directly. Everything else, including all memory
+	// accesses, is a call into the same handlers the interpreter runs. After every
+	// instruction a call charges its cycles and handles interrupts exactly as the
+	// interpreter does.
+	//
+	// Blocks are interpreted while a trace, reference log or profiler is attached,
+	// since those hook every instruction.
+	//
+	// A block runs to its end unless an instruction leaves the straight line (taken
+	// branch, interrupt, HALT), the frame ends, or the code or bank mapping changes
+	// underneath it. Control then returns to the scheduler.
+	//
+	// On Linux every compiled block is listed in /tmp/perf-<pid>.map, so perf can
+	// attribute samples in generated code to the Game Boy address it came from.
+	class Jit
+	{
+
+	public:
+
+		Jit() = default;
+		~Jit();
+
+		// Copies the settings, not the code: every CPU compiles into its own memory
+		Jit(const Jit& other);
+		Jit& operator=(const Jit& other);
+
+	public:
+
+		// Dropping back to the interpreter frees all compiled code.
+		// False if the host is not x86-64.
+		bool SetEnabled(bool bEnabled);
+
+		bool IsEnabled() const
+		{
+			return bIsEnabled;
+		}
+
+		void SetHotThreshold(u32 threshold)
+		{
+			hotThreshold = threshold;
+		}
+
+		// Run every block twice, compiled and interpreted, and compare the results,
+		// see EMU::RunJitLockstep
+		void SetLockstep(bool bEnabled)
+		{
+			bIsLockstep = bEnabled;
+		}
+
+		bool IsLockstep() const
+		{
+			return bIsLockstep;
+		}
+
+		// Runs the compiled block at 'pc' once it is hot. Returns the number of
+		// instructions executed, 0 if the caller should interpret instead.
+		u32 Run(CPU& cpu, u16 pc);
+
+		void Clear();
+
+		// Prints and clears the statistics, if anything ran compiled
+		void PrintStats();
+
+	private:
+
+		// Generated entry point, takes the Jit running it and the CPU's registers
+		using BlockCode = void (*)(Jit*, CPU_Registers*);
+
+		struct Entry
+		{
+			std::shared_ptr<const CodeBlock> block;
+			BlockCode code = nullptr;
+			u32 generation = 0;
+			u32 executions = 0;
+		};
+
+		BlockCode Compile(const CodeBlock& block, u32 key);
+
+		bool ReserveArena();
+
+		void ReleaseArena();
+
+		// Emits 'decoded' as native code followed by a FinishInstruction call. False
+		// if it has to go through StepInstruction instead.
+		static bool EmitNativeInstruction(std::vector<u8>& code, const DecodedInstr& decoded);
+
+		// Called from the generated code after every instruction, false ends the block.
+		// StepInstruction runs the instruction in the interpreter, FinishInstruction
+		// follows one that ran natively.
+		static bool StepInstruction(Jit* jit, const DecodedInstr* decoded);
+		static bool FinishInstruction(Jit* jit, const DecodedInstr* decoded, u32 mCycles);
+
+		// Called from native code before it reads F or needs C
+		static void ResolveFlags(CPU_Registers* registers);
+
+		bool IsStillInBlock(CPU& cpu, const DecodedInstr& decoded) const;
+
+	private:
+
+		bool bIsEnabled = false;
+		bool bIsLockstep = false;
+		u32 hotThreshold = JIT_DEFAULT_HOT_THRESHOLD;
+
+		std::unordered_map<u32, Entry> entries;
+
+		u8* arena = nullptr;
+		u32 arenaUsed = 0;
+
+		std::vector<u8> emitBuffer;
+
+		// State of the block being run, checked after each instruction
+		CPU* runningCPU = nullptr;
+		u32 runFrame = 0;
+		u32 runGeneration = 0;
+		u32 runInstructions = 0;
+
+		u32 compiledBlocks = 0;
+		u64 compiledInstructions = 0;
+		u64 nativeInstructions = 0;
+		u64 blockRuns = 0;
+		u32 arenaResets = 0;
+	};
+}
@@ -2,24 +2,71 @@
 
 #include "common.h"
 
+#include <atomic>
+
 namespace GB
 {
+	class StateWriter;
+	class StateReader;
+
+	// Pressed-button bitmask, one bit per P1 input line: directions in the low
+	// nibble, buttons in the high nibble
+	namespace JOYPAD_BUTTON
+	{
+		constexpr u8 RIGHT = 1 << 0;
+		constexpr u8 LEFT = 1 << 1;
+		constexpr u8 UP = 1 << 2;
+		constexpr u8 DOWN = 1 << 3;
+		constexpr u8 A = 1 << 4;
+		constexpr u8 B = 1 << 5;
+		constexpr u8 SELECT = 1 << 6;
+		constexpr u8 START = 1 << 7;
+	}
+
 	class Joypad
 	{
-		Joypad() = default;
 
-		static Joypad* GetJoypad();
+	public:
+
+		Joypad() = default;
 
 	public:
 
-		static void WriteState(u8 newValue);
+		u8 ReadByte();
 
-		static u8 ReadState();
+		void WriteByte(u8 value);
+
+		// Requests the joypad interrupt when a selected line goes from high to low
+		void SetButtons(u8 pressed);
+
+		u8 GetButtons() const
+		{
+			return buttons;
+		}
+
+		// When set, every P1 read samples 'source' first, so a strobe sees the newest
+		// host input instead of what was latched at the last frame boundary
+		void SetLiveInput(const std::atomic<u8>* source)
+		{
+			liveInput = source;
+		}
 
 		static bool IsJoypad_Addr(u16 address);
 
+		void SaveState(StateWriter& writer) const;
+		void LoadState(StateReader& reader);
+
 	private:
 
-		u8 state = 0;
+		// P1 bits 0-3, active low
+		u8 GetInputLines() const;
+
+	private:
+
+		// P1 bits 4-5, a group is selected while its bit is 0
+		u8 select = 0x30;
+		u8 buttons = 0;
+
+		const std::atomic<u8>* liveInput = nullptr;
 	};
 }
\ No newline at end of file
@@ -5,6 +5,9 @@
 
 namespace GB
 {
+	class StateWriter;
+	class StateReader;
+
 	class LCD
 	{
 
@@ -17,6 +20,9 @@ namespace GB
 
 		static bool IsLCDAddress(u16 address);
 
+		void SaveState(StateWriter& writer) const;
+		void LoadState(StateReader& reader);
+
 	public:
 
 		// Control flags
@@ -0,0 +1,90 @@
+#pragma once
+
+#include "common.h"
+
+#include <filesystem>
+#include <vector>
+
+namespace GB
+{
+	// "GBMV"
+	constexpr u32 MOVIE_MAGIC = 0x564D4247;
+	constexpr u16 MOVIE_VERSION = 1;
+
+	// Per-frame joypad input, run-length encoded. Movies start at power-on and
+	// input only changes on frame boundaries, so playback is frame exact.
+	//
+	// File layout: MovieHeader followed by runCount MovieRun entries.
+	struct MovieHeader
+	{
+		u32 magic;
+		u16 version;
+		u16 romChecksum;
+		u32 frameCount;
+		u32 runCount;
+	};
+
+	struct MovieRun
+	{
+		u8 buttons;
+		u8 reserved;
+		u16 frames;
+	};
+
+	class Movie
+	{
+
+	public:
+
+		Movie() = default;
+		~Movie();
+
+	public:
+
+		bool StartRecording(const std::filesystem::path& filePath, u16 romChecksum);
+
+		bool StartPlayback(const std::filesystem::path& filePath, u16 romChecksum);
+
+		// Called once per emulated frame. Records 'liveButtons' or replaces them with
+		// the movie input, returns what the frame uses.
+		u8 NextFrame(u8 liveButtons);
+
+		// Moves the cursor to 'targetFrame' after the machine was put back to that
+		// frame (state load, rewind, reset). A recording drops everything after it
+		// and continues from there. False if the frame lies beyond the movie.
+		bool Seek(u32 targetFrame);
+
+		// Writes a recording out, ends playback
+		void Stop();
+
+		bool IsPlaying() const
+		{
+			return bPlaying;
+		}
+
+		bool IsRecording() const
+		{
+			return bRecording;
+		}
+
+		u32 GetFrame() const
+		{
+			return frame;
+		}
+
+	private:
+
+		std::filesystem::path path;
+		u16 checksum = 0;
+
+		std::vector<MovieRun> runs;
+		u32 frameCount = 0;
+
+		u32 frame = 0;
+		u32 runIndex = 0;
+		u16 runFrame = 0;
+
+		bool bRecording = false;
+		bool bPlaying = false;
+	};
+}
@@ -5,6 +5,9 @@
 
 namespace GB
 {
+	class StateWriter;
+	class StateReader;
+
 	// OAM
 	constexpr u16 TOTAL_OAM_SIZE = 0xA0;
 	constexpr u16 OAM_START = 0xFE00;
@@ -26,16 +29,33 @@ namespace GB
 
 		void Tick();
 
+		// Same result as 'ticks' Tick() calls that do not reach GetTicksToNextEvent
+		void Advance(u32 ticks)
+		{
+			line_ticks += ticks;
+		}
+
+		// Ticks until the one that changes mode or line, UINT32_MAX if none is coming
+		u32 GetTicksToNextEvent() const;
+
 		u32 GetCurrentFrame() const
 		{
 			return current_frame;
 		}
 
+		const std::array<u32, XRES * YRES>& GetVideoBuffer() const
+		{
+			return videoBuffer;
+		}
+
 		u8 ReadOAM_Byte(u16 address) const;
 		void WriteOAM_Byte(u16 address, u8 value);
 
 		static bool IsOAM_Addr(u16 address);
 
+		void SaveState(StateWriter& writer) const;
+		void LoadState(StateReader& reader);
+
 	private:
 
 		void Tick_OAM();
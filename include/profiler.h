@@ -0,0 +1,94 @@
+#pragma once
+
+#include "common.h"
+
+#include <array>
+#include <filesystem>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace GB
+{
+	class ShadowCallStack;
+
+	// 256 opcodes plus the 256 CB prefixed ones
+	constexpr u32 PROFILER_OPCODES = 512;
+
+	// Guest profiler. Counts executions and T-cycles per opcode, per (bank, PC) and
+	// per call path of the shadow call stack. An instruction is charged everything
+	// up to the start of the next one, which puts HALT time on the HALT and
+	// interrupt dispatch on the instruction it interrupted.
+	class Profiler
+	{
+
+	public:
+
+		Profiler();
+
+	public:
+
+		// 'opcodeIndex' is 256 + the second byte for CB instructions, 'key' the
+		// (bank << 16) | PC of the instruction, 'cycles' EMU::GetCycles before it
+		void OnInstruction(u16 opcodeIndex, u32 key, u32 cycles, const ShadowCallStack& callStack);
+
+		// Charges the last instruction, call before reading the results
+		void Finish(u32 cycles);
+
+		// Sorted text report: opcodes, hottest PCs and functions
+		bool WriteReport(const std::filesystem::path& filePath) const;
+
+		// One "outer;inner cycles" line per call path, as read by flamegraph.pl and
+		// speedscope
+		bool WriteFoldedStacks(const std::filesystem::path& filePath) const;
+
+		u64 GetInstructionCount() const
+		{
+			return totalExecutions;
+		}
+
+	private:
+
+		struct Counter
+		{
+			u64 executions = 0;
+			u64 cycles = 0;
+		};
+
+		// A distinct call path. Node 0 is everything outside of any tracked call.
+		struct CallNode
+		{
+			u32 parent = 0;
+			// (bank << 16) | target, ~0 for the root
+			u32 key = 0;
+			bool bInterrupt = false;
+			Counter self;
+			std::unordered_map<u32, u32> children;
+		};
+
+		u32 FindNode(const ShadowCallStack& callStack);
+
+		std::string GetNodeName(const CallNode& node) const;
+
+		static std::string GetOpcodeName(u16 opcodeIndex);
+
+	private:
+
+		std::array<Counter, PROFILER_OPCODES> opcodes{};
+		std::unordered_map<u32, Counter> addresses;
+		std::vector<CallNode> nodes;
+
+		u64 totalExecutions = 0;
+		u64 totalCycles = 0;
+
+		// The instruction that is charged once the next one starts
+		bool bHasPending = false;
+		u16 pendingOpcode = 0;
+		u32 pendingKey = 0;
+		u32 pendingCycles = 0;
+		u32 pendingNode = 0;
+
+		u32 callStackVersion = 0;
+		u32 currentNode = 0;
+	};
+}
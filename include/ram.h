@@ -1,10 +1,15 @@
 #pragma once
 
 #include "common.h"
+#include "cow_memory.h"
+#include "dirty_pages.h"
 #include <array>
 
 namespace GB
 {
+	class StateWriter;
+	class StateReader;
+
 	namespace RAM_ADDR
 	{
 		// VRAM
@@ -69,18 +74,42 @@ namespace GB
 
 		static bool IsHRAM_Addr(u16 address);
 
-	private:
+		void SaveState(StateWriter& writer) const;
+		void LoadState(StateReader& reader);
+
+	public:
 
-		using WRAM_BANK = std::array<u8, RAM_ADDR::WRAM_BANK_SIZE>;
+		// WRAM offsets cover all banks, VRAM offsets both banks
+		using WRAM_Dirty = DirtyPages<RAM_ADDR::TOTAL_WRAM_SIZE>;
+		using VRAM_Dirty = DirtyPages<RAM_ADDR::TOTAL_VRAM_SIZE>;
+		using HRAM_Dirty = DirtyPages<RAM_ADDR::TOTAL_HRAM_SIZE>;
 
-		WRAM_BANK WRAM_Bank_0{};
-		std::array<WRAM_BANK, 7> WRAM_Banks_1_7{};
+		const WRAM_Dirty& GetWRAM_DirtyPages() const
+		{
+			return WRAM_DirtyPages;
+		}
 
-		u8 currentWRAMBank = 0;
+		const VRAM_Dirty& GetVRAM_DirtyPages() const
+		{
+			return VRAM_DirtyPages;
+		}
+
+		const HRAM_Dirty& GetHRAM_DirtyPages() const
+		{
+			return HRAM_DirtyPages;
+		}
 
-		using VRAM_BANK = std::array<u8, RAM_ADDR::VRAM_BANK_SIZE>;
+		// Clears all three and starts a new epoch
+		void ClearDirtyPages();
 
-		std::array<VRAM_BANK, 2> VRAM_Banks{};
+	private:
+
+		// Shared copy-on-write with forked machines. Bank 0 followed by banks 1-7.
+		CowMemory<COW_PAGE_SIZE, RAM_ADDR::TOTAL_WRAM_SIZE / COW_PAGE_SIZE> WRAM;
+
+		u8 currentWRAMBank = 0;
+
+		CowMemory<COW_PAGE_SIZE, RAM_ADDR::TOTAL_VRAM_SIZE / COW_PAGE_SIZE> VRAM;
 
 		u8 currentVRAMBank = 0;
 
@@ -88,6 +117,10 @@ namespace GB
 
 		HRAM HRAM_Mem{};
 
+		WRAM_Dirty WRAM_DirtyPages;
+		VRAM_Dirty VRAM_DirtyPages;
+		HRAM_Dirty HRAM_DirtyPages;
+
 
 	};
 }
\ No newline at end of file
@@ -0,0 +1,64 @@
+#pragma once
+
+#include "common.h"
+
+#include <array>
+#include <filesystem>
+
+namespace GB
+{
+	struct TraceRecord;
+
+	// Reference lines shown before a divergence
+	constexpr u32 REFERENCE_CONTEXT_LINES = 4;
+
+	// A Gameboy Doctor style reference log, memory mapped and compared line by line
+	// against the state before every executed instruction. Nothing of our own is
+	// written, each state is formatted into a stack buffer and compared in place.
+	class ReferenceLog
+	{
+
+	public:
+
+		ReferenceLog() = default;
+		~ReferenceLog();
+
+		ReferenceLog(const ReferenceLog&) = delete;
+		ReferenceLog& operator=(const ReferenceLog&) = delete;
+
+	public:
+
+		bool Open(const std::filesystem::path& filePath);
+
+		// True while the state matches the next reference line. Reports and returns
+		// false at the first divergence and at the end of the log.
+		bool Check(const TraceRecord& record);
+
+		u64 GetMatchedCount() const
+		{
+			return matchedLines;
+		}
+
+	private:
+
+		void ReportDivergence(const char* expected, u32 expectedLength, const char* actual, u32 actualLength) const;
+
+		void Close();
+
+	private:
+
+		const char* data = nullptr;
+		size_t size = 0;
+		size_t offset = 0;
+
+		u64 matchedLines = 0;
+
+		// Offsets of the last matched lines, a ring indexed by matchedLines
+		std::array<size_t, REFERENCE_CONTEXT_LINES> recentLines{};
+
+#if defined(_WIN32)
+		void* fileHandle = nullptr;
+		void* mappingHandle = nullptr;
+#endif
+	};
+}
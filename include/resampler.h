@@ -0,0 +1,58 @@
+#pragma once
+
+#include "common.h"
+
+#include <vector>
+
+namespace GB
+{
+	// Rational L/M polyphase FIR resampler for interleaved stereo i16.
+	// Coefficients are stored reversed and contiguous per phase, and each channel
+	// keeps its own contiguous float history, so the inner loop is a plain dot
+	// product the compiler vectorizes.
+	class PolyphaseResampler
+	{
+
+	public:
+
+		PolyphaseResampler() = default;
+
+	public:
+
+		void Init(u32 inputRate, u32 outputRate);
+
+		// Appends the resampled frames to 'output' (interleaved stereo)
+		void Process(const i16* frames, u32 frameCount, std::vector<i16>& output);
+
+		u32 GetOutputRate() const
+		{
+			return outputRate;
+		}
+
+	public:
+
+		static constexpr u32 TAPS_PER_PHASE = 32;
+		static_assert(TAPS_PER_PHASE % 4 == 0, "Taps are processed four lanes at a time");
+
+	private:
+
+		u32 inputRate = 0;
+		u32 outputRate = 0;
+
+		// Interpolation / decimation factors after reducing the rates
+		u32 interpolation = 1;
+		u32 decimation = 1;
+
+		// Position of the next output sample: input index and phase
+		u64 inputIndex = 0;
+		u32 phase = 0;
+
+		// Index of history[0] in the input stream
+		u64 historyStart = 0;
+
+		std::vector<float> coefficients;
+
+		std::vector<float> historyLeft;
+		std::vector<float> historyRight;
+	};
+}
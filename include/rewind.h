@@ -0,0 +1,73 @@
+#pragma once
+
+#include "common.h"
+
+#include <vector>
+
+namespace GB
+{
+	// Keeps a history of save states in a fixed-size byte ring. Only the newest
+	// state is held in full; every older one is stored as the XOR against its
+	// successor, run-length encoded (WRAM/VRAM barely change between snapshots,
+	// so the XOR is mostly zeros). Popping walks the chain backwards.
+	class RewindBuffer
+	{
+
+	public:
+
+		RewindBuffer() = default;
+
+	public:
+
+		// 'memoryBudget' bounds the delta ring in bytes, 'maxSnapshots' the history
+		// length (0 to only be bound by memory)
+		void Init(u32 memoryBudget, u32 maxSnapshots);
+
+		// Records 'state' as the newest snapshot
+		void Push(const u8* state, u32 size);
+
+		// Replaces 'state' with the snapshot before the newest one and drops the newest.
+		// False when there is no older snapshot left.
+		bool Pop(std::vector<u8>& state, u32& size);
+
+		u32 GetSnapshotCount() const
+		{
+			return recordCount + (latestSize ? 1 : 0);
+		}
+
+		u32 GetMemoryUsed() const
+		{
+			return used;
+		}
+
+		void Clear();
+
+	private:
+
+		// Record layout in the ring: [u32 payloadSize][u32 stateSize][payload][u32 payloadSize]
+		static constexpr u32 RECORD_OVERHEAD = 3 * sizeof(u32);
+
+		static void EncodeDelta(const u8* older, const u8* newer, u32 size, std::vector<u8>& out);
+
+		static void ApplyDelta(const u8* delta, u32 deltaSize, u8* state);
+
+		void EvictOldest();
+
+		void RingWrite(u32 position, const void* data, u32 size);
+
+		void RingRead(u32 position, void* data, u32 size) const;
+
+	private:
+
+		std::vector<u8> ring;
+		u32 head = 0;
+		u32 used = 0;
+		u32 recordCount = 0;
+		u32 maxRecords = 0;
+
+		std::vector<u8> latest;
+		u32 latestSize = 0;
+
+		std::vector<u8> scratch;
+	};
+}
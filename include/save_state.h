@@ -0,0 +1,130 @@
+#pragma once
+
+#include "common.h"
+
+#include <array>
+#include <vector>
+#include <cstring>
+#include <type_traits>
+
+namespace GB
+{
+	// "GBSS"
+	constexpr u32 SAVE_STATE_MAGIC = 0x53534247;
+	constexpr u16 SAVE_STATE_VERSION = 1;
+
+	// Section ids are part of the file format, only ever append
+	enum class StateSection : u32
+	{
+		EMU = 1,
+		CPU,
+		BUS,
+		IO,
+		TIMER,
+		RAM,
+		LCD,
+		PPU,
+		APU,
+		CART,
+		JOYPAD
+	};
+
+	// Upper bound on sections per blob, the writer's table is fixed size
+	constexpr u16 MAX_STATE_SECTIONS = 16;
+	static_assert((u32)StateSection::JOYPAD <= MAX_STATE_SECTIONS, "Grow MAX_STATE_SECTIONS with the section list");
+
+	// Blob layout: header, section payloads back to back, section table at tableOffset
+	struct SaveStateHeader
+	{
+		u32 magic;
+		u16 version;
+		u16 sectionCount;
+		u32 tableOffset;
+		u32 totalSize;
+		u16 romChecksum;
+		u16 reserved;
+	};
+
+	struct SaveStateSection
+	{
+		StateSection id;
+		u32 offset;
+		u32 size;
+	};
+
+	class StateWriter
+	{
+
+	public:
+
+		// Writes into 'blob', growing it only when it is too small. The blob is never
+		// shrunk, so saving repeatedly into the same vector does not allocate.
+		StateWriter(std::vector<u8>& blob, u16 romChecksum);
+
+	public:
+
+		void BeginSection(StateSection id);
+
+		void EndSection();
+
+		template<typename T>
+		void Write(const T& value)
+		{
+			static_assert(std::is_trivially_copyable_v<T>, "Only plain data can be memcpy'd into a save state");
+			WriteBytes(&value, sizeof(T));
+		}
+
+		void WriteBytes(const void* data, u32 size);
+
+		// Appends the section table and header, returns the total size in bytes
+		u32 Finish();
+
+	private:
+
+		void Reserve(u32 size);
+
+	private:
+
+		std::vector<u8>& blob;
+		u32 position = 0;
+
+		u16 romChecksum = 0;
+
+		std::array<SaveStateSection, MAX_STATE_SECTIONS> sections{};
+		u16 sectionCount = 0;
+	};
+
+	class StateReader
+	{
+
+	public:
+
+		StateReader(const u8* data, u32 size);
+
+	public:
+
+		// Validates magic, version, size, section bounds and ROM
+		bool IsValid(u16 romChecksum) const;
+
+		// Positions the reader at a section. False if the blob predates it,
+		// in which case the component keeps its current state.
+		bool BeginSection(StateSection id);
+
+		template<typename T>
+		void Read(T& value)
+		{
+			static_assert(std::is_trivially_copyable_v<T>, "Only plain data can be memcpy'd from a save state");
+			ReadBytes(&value, sizeof(T));
+		}
+
+		void ReadBytes(void* data, u32 size);
+
+	private:
+
+		const u8* data = nullptr;
+		u32 size = 0;
+
+		u32 position = 0;
+		u32 sectionEnd = 0;
+	};
+}
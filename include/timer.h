@@ -4,6 +4,9 @@
 
 namespace GB
 {
+	class StateWriter;
+	class StateReader;
+
 #define CLOCKSPEED 4194304
 
 	class Timer
@@ -17,18 +20,30 @@ namespace GB
 
 		void Tick(const u32 cycleAmount);
 
+		// Same result as 'ticks' single Tick(1) calls, as long as no TIMA overflow
+		// falls into them (see GetTicksToInterrupt)
+		void Advance(u32 ticks);
+
+		// Ticks until the one raising the next timer interrupt, UINT32_MAX if stopped
+		u32 GetTicksToInterrupt() const;
+
 		void WriteByte(u16 address, u8 value);
 
 		u8 ReadByte(u16 address);
 
 		static bool IsTimer_Addr(u16 address);
 
+		void SaveState(StateWriter& writer) const;
+		void LoadState(StateReader& reader);
+
 	private:
 
 		u8 GetClockFrequency() const;
 
 		void UpdateClockFrequency();
 
+		i32 GetClockPeriod() const;
+
 	private:
 
 		u16 div = 0;
@@ -0,0 +1,124 @@
+#pragma once
+
+#include "common.h"
+
+#include <condition_variable>
+#include <cstdio>
+#include <filesystem>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace GB
+{
+	constexpr u32 TRACE_MAGIC = 0x52544247; // "GBTR"
+	constexpr u16 TRACE_VERSION = 1;
+
+	// Records handed to the writer thread at once
+	constexpr u32 TRACE_CHUNK_RECORDS = 4096;
+	// Power of two, 1.5 MB of records
+	constexpr u32 TRACE_RING_RECORDS = TRACE_CHUNK_RECORDS * 16;
+
+	struct TraceFileHeader
+	{
+		u32 magic;
+		u16 version;
+		u16 recordSize;
+		u16 romChecksum;
+		u16 reserved;
+	};
+
+	// Machine state right before an instruction executes, as written to disk.
+	// Decoded offline by gb_trace (see trace/).
+	struct TraceRecord
+	{
+		// EMU::GetCycles, wraps around. The decoder extends it to 64 bit.
+		u32 cycle;
+		u16 pc;
+		u16 sp;
+		// ROM bank mapped at 0x4000 for PCs in 0x4000-0x7FFF, 0 otherwise
+		u8 bank;
+		// Memory at PC..PC+3, the opcode first
+		u8 bytes[4];
+		u8 a, f, b, c, d, e, h, l;
+		u8 ime;
+		u8 reserved[2];
+	};
+
+	static_assert(sizeof(TraceRecord) == 24, "Trace files rely on the record layout");
+
+	// Longest line FormatDoctorLine writes
+	constexpr u32 DOCTOR_LINE_LENGTH = 73;
+
+	// Writes the record as a Gameboy Doctor log line, without the line break, and
+	// returns its length. No allocation and no std::format, the reference log
+	// comparison runs this for every instruction.
+	u32 FormatDoctorLine(const TraceRecord& record, char* line);
+
+	// Binary execution trace. Records go into a fixed ring, whole chunks of it are
+	// written to the trace file by a background thread. The CPU only waits if that
+	// thread falls a full ring behind, so no record is ever dropped. Needs GB_TRACE
+	// at build time, otherwise the CPU never calls Record.
+	class ExecutionTrace
+	{
+
+	public:
+
+		ExecutionTrace() = default;
+		~ExecutionTrace();
+
+		ExecutionTrace(const ExecutionTrace&) = delete;
+		ExecutionTrace& operator=(const ExecutionTrace&) = delete;
+
+	public:
+
+		bool Start(const std::filesystem::path& filePath, u16 romChecksum);
+
+		// Writes what is left in the ring and closes the file
+		void Stop();
+
+		bool IsRunning() const
+		{
+			return file != nullptr;
+		}
+
+		void Record(const TraceRecord& record)
+		{
+			records[head % TRACE_RING_RECORDS] = record;
+			head++;
+
+			if (head % TRACE_CHUNK_RECORDS == 0)
+			{
+				CommitChunk();
+			}
+		}
+
+		u64 GetRecordCount() const
+		{
+			return head;
+		}
+
+	private:
+
+		void CommitChunk();
+
+		void WriterThread();
+
+	private:
+
+		std::vector<TraceRecord> records;
+		u64 head = 0;
+
+		std::FILE* file = nullptr;
+		std::thread writer;
+
+		// Guard everything below
+		std::mutex mutex;
+		std::condition_variable signal;
+		// Records up to 'committed' may be written, up to 'spilled' have been
+		u64 committed = 0;
+		u64 spilled = 0;
+		bool bStopRequested = false;
+		bool bWriteFailed = false;
+	};
+}
@@ -136,6 +136,16 @@ namespace GB
 		LYC = 1 << 6
 	};
 
+	enum class PacingMode : uint8_t
+	{
+		// Sleep at VBlank until the 60 Hz frame time has passed
+		SLEEP = 0,
+		// Block on the audio ring and nudge the resampling ratio to its fill level
+		AUDIO_CLOCK,
+		// Run as fast as possible (headless batch runs)
+		NONE
+	};
+
 	enum class CGB_Flag : uint8_t
 	{
 		NONE = 0,
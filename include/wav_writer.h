@@ -0,0 +1,55 @@
+#pragma once
+
+#include "common.h"
+#include "resampler.h"
+
+#include <filesystem>
+#include <fstream>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+namespace GB
+{
+	// Streams interleaved stereo i16 audio to a 16-bit PCM WAV file. The emulation
+	// thread only appends to a pending block; resampling and disk I/O happen on a
+	// writer thread.
+	class WavWriter
+	{
+
+	public:
+
+		WavWriter() = default;
+		~WavWriter();
+
+	public:
+
+		bool Open(const std::filesystem::path& filePath, u32 inputRate, u32 outputRate);
+
+		void Push(const i16* frames, u32 frameCount);
+
+		// Drains everything queued, patches the header sizes and closes the file
+		void Close();
+
+	private:
+
+		void WriterThread();
+
+		void WriteHeader(u32 dataSize);
+
+	private:
+
+		std::ofstream file;
+		u32 dataSize = 0;
+
+		PolyphaseResampler resampler;
+
+		std::thread writerThread;
+		std::mutex pendingMutex;
+		std::condition_variable pendingSignal;
+
+		std::vector<i16> pending;
+		bool stopRequested = false;
+	};
+}
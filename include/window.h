@@ -6,9 +6,12 @@ struct SDL_Window;
 struct SDL_Renderer;
 struct SDL_Texture;
 struct SDL_Surface;
+union SDL_Event;
 
 namespace GB
 {
+	class AudioRingBuffer;
+
 	constexpr int debugScale = 2;
 
 	class Window
@@ -18,7 +21,8 @@ namespace GB
 
 		Window();
 
-		void HandleEvents();
+		// Blocks for up to 'timeoutMS' until an event arrives, then drains the queue
+		void HandleEvents(u32 timeoutMS);
 
 		void Delay(u32 MS);
 
@@ -26,12 +30,25 @@ namespace GB
 
 		u32 GetTicks() const;
 
+		bool OpenAudio(AudioRingBuffer& buffer);
+
 	protected:
 
 		void UpdateMainWindow();
 
 		void UpdateDebugWindow();
 
+	protected:
+
+		void HandleEvent(const SDL_Event& sdlEvent);
+
+		// Publishes the combined keyboard and controller buttons to the emulation thread
+		void PublishButtons();
+
+	protected:
+
+		static void AudioCallback(void* userData, u8* stream, int length);
+
 	protected:
 
 		void drawTile(u16 tileNum, u16 xDraw, u16 yDraw);
@@ -48,6 +65,11 @@ namespace GB
 		SDL_Texture* debug_sdlTexture = nullptr;
 		SDL_Surface* debug_sdlSurface = nullptr;
 
+		u32 audioDevice = 0;
+
+		u8 keyboardButtons = 0;
+		u8 controllerButtons = 0;
+
 		u16 mainWindowWidth = 1024;
 		u16 mainWindowHeight = 768;
 
@@ -0,0 +1,217 @@
+#include <cpu_registers.h>
+
+#include <cstdio>
+
+using namespace GB;
+
+// Runs every 8-bit ALU op over all operands, carries and incoming flags through the
+// lazy flag path and compares the resulting F with what eager SetFlags produces.
+
+enum class AluOp
+{
+	ADD,
+	ADC,
+	SUB,
+	SBC,
+	CP,
+	AND,
+	OR,
+	XOR,
+	INC,
+	DEC,
+	COUNT
+};
+
+static const char* const ALU_OP_NAMES[] = { "ADD", "ADC", "SUB", "SBC", "CP", "AND", "OR", "XOR", "INC", "DEC" };
+
+// Flag formulas as the handlers computed them before lazy evaluation
+static void RunEager(CPU_Registers& registers, AluOp op, u8 a, u8 b)
+{
+	const u8 carry = registers.GetCarryFlag();
+
+	switch (op)
+	{
+	case AluOp::ADD:
+	case AluOp::ADC:
+	{
+		const u8 c = op == AluOp::ADC ? carry : 0;
+		const u16 result = a + b + c;
+		registers.SetFlags((result & 0xFF) == 0, 0, (a & 0xF) + (b & 0xF) + c > 0xF, result > 0xFF);
+		break;
+	}
+	case AluOp::SUB:
+	case AluOp::SBC:
+	case AluOp::CP:
+	{
+		const u8 c = op == AluOp::SBC ? carry : 0;
+		const i16 result = (i16)a - (i16)b - c;
+		registers.SetFlags((result & 0xFF) == 0, 1, (i16)(a & 0xF) - (i16)(b & 0xF) - c < 0, result < 0);
+		break;
+	}
+	case AluOp::AND:
+		registers.SetFlags((a & b) == 0, 0, 1, 0);
+		break;
+	case AluOp::OR:
+		registers.SetFlags((a | b) == 0, 0, 0, 0);
+		break;
+	case AluOp::XOR:
+		registers.SetFlags((a ^ b) == 0, 0, 0, 0);
+		break;
+	case AluOp::INC:
+		registers.SetFlags(((a + 1) & 0xFF) == 0, 0, (a & 0xF) == 0xF, -1);
+		break;
+	case AluOp::DEC:
+		registers.SetFlags(((a - 1) & 0xFF) == 0, 1, (a & 0xF) == 0, -1);
+		break;
+	default:
+		break;
+	}
+}
+
+// Same calls the handlers in cpu_proc.cpp make
+static void RunLazy(CPU_Registers& registers, AluOp op, u8 a, u8 b)
+{
+	switch (op)
+	{
+	case AluOp::ADD:
+		registers.SetFlagsLazy(FlagOp::ADD, a, b);
+		break;
+	case AluOp::ADC:
+		registers.SetFlagsLazy(FlagOp::ADD, a, b, registers.GetCarryFlag());
+		break;
+	case AluOp::SUB:
+	case AluOp::CP:
+		registers.SetFlagsLazy(FlagOp::SUB, a, b);
+		break;
+	case AluOp::SBC:
+		registers.SetFlagsLazy(FlagOp::SUB, a, b, registers.GetCarryFlag());
+		break;
+	case AluOp::AND:
+		registers.SetFlagsLazy(FlagOp::LOGIC, a & b, 0, 1);
+		break;
+	case AluOp::OR:
+		registers.SetFlagsLazy(FlagOp::LOGIC, a | b);
+		break;
+	case AluOp::XOR:
+		registers.SetFlagsLazy(FlagOp::LOGIC, a ^ b);
+		break;
+	case AluOp::INC:
+		registers.SetFlagsLazy(FlagOp::INC, a);
+		break;
+	case AluOp::DEC:
+		registers.SetFlagsLazy(FlagOp::DEC, a);
+		break;
+	default:
+		break;
+	}
+}
+
+struct PendingInput
+{
+	bool bFound = false;
+	FlagOp op = FlagOp::NONE;
+	u8 a = 0;
+	u8 b = 0;
+	u8 carry = 0;
+};
+
+// A lazy op for each incoming F, so the op under test also runs on top of pending flags.
+// Not every combination can be produced by a single ALU op, those only run resolved.
+static PendingInput pendingInputs[16];
+
+static void FindPendingInputs()
+{
+	const FlagOp ops[] = { FlagOp::ADD, FlagOp::SUB, FlagOp::LOGIC };
+
+	for (const FlagOp op : ops)
+	{
+		for (u16 a = 0; a <= 0xFF; a++)
+		{
+			for (u16 b = 0; b <= 0xFF; b++)
+			{
+				for (u8 carry = 0; carry < 2; carry++)
+				{
+					CPU_Registers registers{};
+					registers.SetFlagsLazy(op, (u8)a, (u8)b, carry);
+
+					PendingInput& input = pendingInputs[registers.Read(RegisterType::F) >> 4];
+					if (!input.bFound)
+					{
+						input = { true, op, (u8)a, (u8)b, carry };
+					}
+				}
+			}
+		}
+	}
+}
+
+static u32 CheckOp(AluOp op)
+{
+	u32 failures = 0;
+
+	for (u8 flagIndex = 0; flagIndex < 16; flagIndex++)
+	{
+		const u8 initialFlags = flagIndex << 4;
+		const PendingInput& pendingInput = pendingInputs[flagIndex];
+
+		for (u8 bPendingInput = 0; bPendingInput < (pendingInput.bFound ? 2 : 1); bPendingInput++)
+		{
+			for (u16 a = 0; a <= 0xFF; a++)
+			{
+				for (u16 b = 0; b <= 0xFF; b++)
+				{
+					CPU_Registers eager{};
+					CPU_Registers lazy{};
+					eager.Set<RegisterType::F>(initialFlags);
+
+					if (bPendingInput)
+					{
+						lazy.SetFlagsLazy(pendingInput.op, pendingInput.a, pendingInput.b, pendingInput.carry);
+					}
+					else
+					{
+						lazy.Set<RegisterType::F>(initialFlags);
+					}
+
+					RunEager(eager, op, (u8)a, (u8)b);
+					RunLazy(lazy, op, (u8)a, (u8)b);
+
+					const u8 expected = (u8)eager.Read(RegisterType::F);
+					const u8 actual = (u8)lazy.Read(RegisterType::F);
+					if (expected != actual)
+					{
+						if (failures < 8)
+						{
+							printf("%s a=%02X b=%02X F=%02X%s: lazy F=%02X, eager F=%02X\n", ALU_OP_NAMES[(u32)op], a, b,
+								   initialFlags, bPendingInput ? " (pending)" : "", actual, expected);
+						}
+						failures++;
+					}
+				}
+			}
+		}
+	}
+
+	return failures;
+}
+
+int main()
+{
+	FindPendingInputs();
+
+	u32 failures = 0;
+
+	for (u32 op = 0; op < (u32)AluOp::COUNT; op++)
+	{
+		failures += CheckOp((AluOp)op);
+	}
+
+	if (failures)
+	{
+		printf("Lazy flags disagree with eager evaluation in %u cases\n", failures);
+		return 1;
+	}
+
+	printf("Lazy flags match eager evaluation\n");
+	return 0;
+}
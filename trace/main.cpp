@@ -0,0 +1,167 @@
+// gb_trace: renders a binary execution trace written by the emulator (--trace=<file>
+// or the T key) as text. Usage:
+//
+//   gb_trace <trace_file> [--format=text|doctor] [--output=<file>]
+//
+// 'text' lists cycle, bank:PC, the instruction and the registers before it ran.
+// 'doctor' is the Gameboy Doctor log format, one line per instruction, for diffing
+// against its reference logs.
+
+#include "Instructions.h"
+#include "trace.h"
+
+#include <cstdio>
+#include <format>
+#include <fstream>
+#include <string>
+
+using namespace GB;
+
+namespace
+{
+	enum class TraceFormat
+	{
+		TEXT,
+		DOCTOR
+	};
+
+	std::string Disassemble(const TraceRecord& record)
+	{
+		const Instruction* instruction = Instruction::GetInstruction(record.bytes[0]);
+		const std::string reg1 = instruction->GetReg1Name();
+		const std::string reg2 = instruction->GetReg2Name();
+		const u8 d8 = record.bytes[1];
+		const u16 d16 = record.bytes[1] | (record.bytes[2] << 8);
+
+		std::string operands;
+
+		switch (instruction->mode)
+		{
+		case AddrMode::R_D16: operands = std::format("{},{:04X}", reg1, d16); break;
+		case AddrMode::R_A16: operands = std::format("{},({:04X})", reg1, d16); break;
+		case AddrMode::R: operands = reg1; break;
+		case AddrMode::R_R: operands = std::format("{},{}", reg1, reg2); break;
+		case AddrMode::MR_R: operands = std::format("({}),{}", reg1, reg2); break;
+		case AddrMode::MR: operands = std::format("({})", reg1); break;
+		case AddrMode::R_MR: operands = std::format("{},({})", reg1, reg2); break;
+		case AddrMode::R_D8: operands = std::format("{},{:02X}", reg1, d8); break;
+		case AddrMode::R_A8: operands = std::format("{},(FF{:02X})", reg1, d8); break;
+		case AddrMode::A8_R: operands = std::format("(FF{:02X}),{}", d8, reg2); break;
+		case AddrMode::R_HLI: operands = std::format("{},({}+)", reg1, reg2); break;
+		case AddrMode::R_HLD: operands = std::format("{},({}-)", reg1, reg2); break;
+		case AddrMode::HLI_R: operands = std::format("({}+),{}", reg1, reg2); break;
+		case AddrMode::HLD_R: operands = std::format("({}-),{}", reg1, reg2); break;
+		case AddrMode::HL_SPD: operands = std::format("{},SP{:+}", reg1, (i8)d8); break;
+		case AddrMode::D8: operands = std::format("{:02X}", d8); break;
+		case AddrMode::D16: operands = std::format("{:04X}", d16); break;
+		case AddrMode::D16_R:
+		case AddrMode::A16_R: operands = std::format("({:04X}),{}", d16, reg2); break;
+		case AddrMode::MR_D8: operands = std::format("({}),{:02X}", reg1, d8); break;
+		default: break;
+		}
+
+		return operands.empty() ? instruction->GetInstructionName() : instruction->GetInstructionName() + " " + operands;
+	}
+
+	std::string FormatText(const TraceRecord& record, u64 cycle)
+	{
+		const u8 f = record.f;
+		const std::string flags = std::format("{}{}{}{}", f & 0x80 ? 'Z' : '-', f & 0x40 ? 'N' : '-', f & 0x20 ? 'H' : '-', f & 0x10 ? 'C' : '-');
+
+		return std::format("{:>12} {:02X}:{:04X}  {:<18} A:{:02X} F:{} BC:{:02X}{:02X} DE:{:02X}{:02X} HL:{:02X}{:02X} SP:{:04X} IME:{}\n",
+						   cycle, record.bank, record.pc, Disassemble(record), record.a, flags,
+						   record.b, record.c, record.d, record.e, record.h, record.l, record.sp, record.ime);
+	}
+
+	std::string FormatDoctor(const TraceRecord& record)
+	{
+		char line[DOCTOR_LINE_LENGTH + 1];
+		const u32 length = FormatDoctorLine(record, line);
+		line[length] = '\n';
+
+		return std::string(line, length + 1);
+	}
+}
+
+int main(int argc, char** argv)
+{
+	if (argc < 2)
+	{
+		printf("Usage: gb_trace <trace_file> [--format=text|doctor] [--output=<file>]\n");
+		return -1;
+	}
+
+	const std::string tracePath = argv[1];
+	TraceFormat format = TraceFormat::TEXT;
+	std::string outputPath;
+
+	for (int i = 2; i < argc; i++)
+	{
+		const std::string option = argv[i];
+
+		if (option == "--format=text" || option == "--format=doctor")
+		{
+			format = option == "--format=doctor" ? TraceFormat::DOCTOR : TraceFormat::TEXT;
+		}
+		else if (option.starts_with("--output="))
+		{
+			outputPath = option.substr(9);
+		}
+		else
+		{
+			printf("Unknown option: %s\n", option.c_str());
+		}
+	}
+
+	std::ifstream input(tracePath, std::ios::binary);
+
+	TraceFileHeader header{};
+	input.read((char*)&header, sizeof(header));
+
+	if (!input || header.magic != TRACE_MAGIC)
+	{
+		printf("Not a trace file: %s\n", tracePath.c_str());
+		return -2;
+	}
+
+	if (header.version != TRACE_VERSION || header.recordSize != sizeof(TraceRecord))
+	{
+		printf("%s was written by another emulator version\n", tracePath.c_str());
+		return -2;
+	}
+
+	std::FILE* output = outputPath.empty() ? stdout : std::fopen(outputPath.c_str(), "w");
+	if (!output)
+	{
+		printf("Failed to write %s\n", outputPath.c_str());
+		return -3;
+	}
+
+	// The recorded cycle counter wraps, records are close enough to unwrap it
+	u64 cycleBase = 0;
+	u32 previousCycle = 0;
+	u64 recordCount = 0;
+
+	TraceRecord record{};
+	while (input.read((char*)&record, sizeof(record)))
+	{
+		if (record.cycle < previousCycle)
+		{
+			cycleBase += 1ull << 32;
+		}
+		previousCycle = record.cycle;
+
+		const std::string line = format == TraceFormat::DOCTOR ? FormatDoctor(record) : FormatText(record, cycleBase + record.cycle);
+		std::fwrite(line.data(), 1, line.size(), output);
+
+		recordCount++;
+	}
+
+	if (output != stdout)
+	{
+		std::fclose(output);
+		printf("%llu instructions decoded to %s\n", (unsigned long long)recordCount, outputPath.c_str());
+	}
+
+	return 0;
+}